@@ -2,9 +2,30 @@
 #include <jescore.h>
 #include "audio.h"
 #include <soc/i2s_reg.h>
+#include "esp_timer.h"
 #include "fsm.h"
+#include "config.h"
+#include "prof.h"
+#include "prof_trace.h"
 
 QueueHandle_t audio_evt_queue_in;
+static uint32_t audio_sr = 0;
+
+typedef struct audio_clock_t{
+    audio_stats_t stats;
+    audio_dropout_t log[AUDIO_DROPOUT_LOG_N];
+    volatile uint8_t resync;    // restart the clock on the next read
+    int64_t t_start_us;         // wall time of the first sample after resync
+    int64_t t_last_us;          // wall time of the last read
+    int32_t baseline;           // slow average of the clock deficit
+    uint8_t confirm;            // frames the deficit exceeded the tolerance
+}audio_clock_t;
+
+static audio_clock_t aclk = {.resync = 1};
+
+/// @brief Advance the sample clock after a read and detect gaps.
+/// @param samples Samples delivered by this read.
+static inline void audio_clock_update(uint32_t samples);
 
 e_syserr_t audio_init(uint32_t sampleRate, uint8_t bclk, uint8_t ws, uint8_t data_rx){
 
@@ -32,8 +53,8 @@ e_syserr_t audio_init(uint32_t sampleRate, uint8_t bclk, uint8_t ws, uint8_t dat
         .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT, //I2S_CHANNEL_FMT_RIGHT_LEFT,
         .communication_format = i2s_comm_format_t(I2S_COMM_FORMAT_STAND_I2S),
         .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 8,
-        .dma_buf_len = 512,
+        .dma_buf_count = AUDIO_I2S_DMA_BUF_COUNT,
+        .dma_buf_len = AUDIO_I2S_DMA_BUF_LEN,
         .use_apll = true,
         .tx_desc_auto_clear = true,
         .fixed_mclk = 0,
@@ -60,37 +81,60 @@ e_syserr_t audio_init(uint32_t sampleRate, uint8_t bclk, uint8_t ws, uint8_t dat
     if (e != ESP_OK) { 
         return e_syserr_driver_fail;
     }
+    audio_sr = sampleRate;
+    audio_resync();
     return e_syserr_none;
 }
 
 e_syserr_t audio_init_default(void){
-    return audio_init(AUDIO_SR_DEFAULT, 
+    return audio_init(cfg_get_rec().sr, 
+                      AUDIO_PIN_MEMS_I2S_BCLK, 
+                      AUDIO_PIN_MEMS_I2S_WS, 
+                      AUDIO_PIN_MEMS_I2S_IN);
+}
+
+e_syserr_t audio_set_sr(uint32_t sr){
+    if(!AUDIO_SR_VALID(sr)) return e_syserr_param;
+    if(sr == audio_sr) return e_syserr_none;
+    return audio_init(sr, 
                       AUDIO_PIN_MEMS_I2S_BCLK, 
                       AUDIO_PIN_MEMS_I2S_WS, 
                       AUDIO_PIN_MEMS_I2S_IN);
 }
 
+uint32_t audio_get_sr(void){
+    return audio_sr;
+}
+
 void audio_sampler(void* p){
     static uint8_t act = 0;
     act = !act;
     job_struct_t* pj = (job_struct_t*)p;
     pj->role = e_role_core;
+    static fsm_state_struct_t* state_last = NULL;
     while(act){
         i2s_event_t evt;
         fsm_state_struct_t* state = (fsm_state_struct_t*) jes_job_get_param();
-        static bool tx_occ = false;
-        static bool rx_occ = false;
         if (xQueueReceive(audio_evt_queue_in, &evt, portMAX_DELAY) == pdPASS){
             if(evt.type == (i2s_event_type_t)I2S_EVENT_RESTART){
                 jes_delay_job_ms(AUDIO_I2S_RESTART_MS);
+                audio_resync();
                 SCOPE_LOG_PJ(pj, "Audio was restarted!");
                 continue;
             }
-            // This triggers as well when a state does not consume audio
-            // if(evt.type != I2S_EVENT_RX_DONE){
-            //     SCOPE_LOG_PJ(pj, "Audio event abnormal: %d", evt.type);
-            // }
+            // Overflows also pile up while a state does not consume audio,
+            // the sample clock tells real gaps apart (see audio_clock_update)
+            if(evt.type == I2S_EVENT_RX_Q_OVF) aclk.stats.rx_q_ovf++;
+            else if(evt.type == I2S_EVENT_DMA_ERROR) aclk.stats.dma_err++;
+            if(state != state_last){
+                audio_resync();
+                state_last = state;
+            }
+            PROF_TRACE_BEGIN(e_prof_trace_audio_frame, state->rt_args.cur_state);
+            PROF_FRAME_BEGIN();
             state->routine(&state->rt_args);
+            PROF_FRAME_END();
+            PROF_TRACE_END(e_prof_trace_audio_frame, state->rt_args.cur_state);
         }
     }
 }
@@ -101,6 +145,64 @@ void audio_read(stereo_sample_t *data, uint32_t len){
     if(e != ESP_OK){
         uart_unif_writef("I2S read fail: %d\n\r", e);
     }
+    if(bytesRead < len * sizeof(stereo_sample_t)){
+        aclk.stats.short_reads++;
+        // keep the frame length fixed for the consumers
+        memset((uint8_t*)data + bytesRead, 0, len * sizeof(stereo_sample_t) - bytesRead);
+    }
+    audio_clock_update(bytesRead / sizeof(stereo_sample_t));
+}
+
+static inline void audio_clock_update(uint32_t samples){
+    int64_t now = esp_timer_get_time();
+    if(aclk.resync){
+        aclk.resync = 0;
+        aclk.stats.samples_read = 0;
+        aclk.t_start_us = now - (int64_t)samples * 1000000 / audio_sr;
+        aclk.t_last_us = now;
+        aclk.baseline = 0;
+        aclk.confirm = 0;
+    }
+    aclk.stats.samples_read += samples;
+    int64_t frame_us = (int64_t)AUDIO_FRAME_LEN * 1000000 / audio_sr;
+    if(now - aclk.t_last_us > 2 * frame_us) aclk.stats.late_frames++;
+    aclk.t_last_us = now;
+
+    int64_t expected = (now - aclk.t_start_us) * audio_sr / 1000000;
+    int32_t deficit = (int32_t)(expected - (int64_t)aclk.stats.samples_read);
+    aclk.stats.clock_deficit = deficit;
+    if(deficit - aclk.baseline > AUDIO_DROPOUT_TOL){
+        // late reads catch up within a few frames, a lost stretch does not
+        if(++aclk.confirm < AUDIO_DROPOUT_CONFIRM) return;
+        audio_dropout_t* d = &aclk.log[aclk.stats.dropouts % AUDIO_DROPOUT_LOG_N];
+        d->len = (uint32_t)(deficit - aclk.baseline);
+        d->pos = aclk.stats.samples_read - (uint64_t)AUDIO_DROPOUT_CONFIRM * samples;
+        aclk.stats.lost_samples += d->len;
+        __atomic_store_n(&aclk.stats.dropouts, aclk.stats.dropouts + 1, __ATOMIC_RELEASE);
+        aclk.baseline = deficit;
+        aclk.confirm = 0;
+        return;
+    }
+    aclk.confirm = 0;
+    aclk.baseline += (deficit - aclk.baseline) >> AUDIO_CLOCK_TRACK_SHIFT;
+}
+
+audio_stats_t audio_get_stats(void){
+    return aclk.stats;
+}
+
+uint32_t audio_get_dropouts(uint32_t since, audio_dropout_t* out, uint32_t max){
+    uint32_t head = __atomic_load_n(&aclk.stats.dropouts, __ATOMIC_ACQUIRE);
+    if(head - since > AUDIO_DROPOUT_LOG_N) since = head - AUDIO_DROPOUT_LOG_N;
+    uint32_t n = 0;
+    for(uint32_t i = since; i != head && n < max; i++){
+        out[n++] = aclk.log[i % AUDIO_DROPOUT_LOG_N];
+    }
+    return n;
+}
+
+void audio_resync(void){
+    aclk.resync = 1;
 }
 
 void audio_suspend_short(void){
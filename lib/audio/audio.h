@@ -18,6 +18,13 @@
 #define AUDIO_SR_VALID(sr)      ((sr) == 44100 || (sr) == 48000 || (sr) == 96000)
 #define AUDIO_I2S_STARTUP       I2S_EVENT_MAX
 #define AUDIO_I2S_RESTART_MS    200     
+#define AUDIO_I2S_DMA_BUF_COUNT 8
+#define AUDIO_I2S_DMA_BUF_LEN   512
+
+#define AUDIO_DROPOUT_LOG_N     32      // most recent dropouts kept
+#define AUDIO_DROPOUT_TOL       AUDIO_I2S_DMA_BUF_LEN  // clock deficit that counts as a gap
+#define AUDIO_DROPOUT_CONFIRM   4       // frames a deficit has to persist
+#define AUDIO_CLOCK_TRACK_SHIFT 8       // baseline follows slow clock drift with 1/256 per frame
 
 #define AUDIO_PIN_MEMS_I2S_BCLK 23
 #define AUDIO_PIN_MEMS_I2S_WS   4
@@ -38,6 +45,24 @@ typedef struct stereo_value{
     float r;
 }stereo_value_t;
 
+/// @brief A detected gap in the captured sample stream.
+typedef struct audio_dropout_t{
+    uint64_t pos;               // samples read before the gap (sample clock)
+    uint32_t len;               // estimated amount of lost samples
+}audio_dropout_t;
+
+/// @brief Capture health counters.
+typedef struct audio_stats_t{
+    uint32_t rx_q_ovf;          // I2S_EVENT_RX_Q_OVF events
+    uint32_t dma_err;           // I2S_EVENT_DMA_ERROR events
+    uint32_t short_reads;       // i2s_read returned less than requested
+    uint32_t late_frames;       // reads more than two frame periods apart
+    uint32_t dropouts;          // total detected gaps (monotonic index)
+    uint64_t lost_samples;      // sum of all gap lengths
+    uint64_t samples_read;      // sample clock, samples delivered since the last resync
+    int32_t clock_deficit;      // wall clock samples minus delivered samples
+}audio_stats_t;
+
 
 /// @brief Initializes the I2S audio interface.
 /// @param sampleRate The sample rate to use.
@@ -52,6 +77,17 @@ e_syserr_t audio_init(uint32_t sampleRate, uint8_t bclk, uint8_t ws, uint8_t dat
 /// @note Is part of the common signature interface for the init routine.
 e_syserr_t audio_init_default(void);
 
+/// @brief Switch the I2S clock to a new sample rate.
+/// @param sr The sample rate to use.
+/// @return Error code indicating success or failure.
+/// @note Goes through the restart path of `audio_init()` with the default pins.
+/// Returns immediately if `sr` is already active.
+e_syserr_t audio_set_sr(uint32_t sr);
+
+/// @brief Get the sample rate the I2S driver currently runs at.
+/// @return Active sample rate, 0 before `audio_init()`.
+uint32_t audio_get_sr(void);
+
 /// @brief Manages the queue ISR for audio I/O.
 /// @param p Pointer to job parameters.
 void audio_sampler(void* p);
@@ -61,6 +97,21 @@ void audio_sampler(void* p);
 /// @param len Length of total data in stereo samples.
 void audio_read(stereo_sample_t* data, uint32_t len);
 
+/// @brief Get a snapshot of the capture counters.
+/// @return Audio stats (by value).
+audio_stats_t audio_get_stats(void);
+
+/// @brief Copy logged dropouts, oldest first.
+/// @param since Dropout index to start at (compare `audio_stats_t.dropouts`).
+/// @param out Array for the dropouts.
+/// @param max Length of `out`.
+/// @return Amount of dropouts copied. Dropouts older than `AUDIO_DROPOUT_LOG_N` are lost.
+uint32_t audio_get_dropouts(uint32_t since, audio_dropout_t* out, uint32_t max);
+
+/// @brief Restart the sample clock without reporting a gap.
+/// @note Called on intentional pauses (restarts, states that don't capture).
+void audio_resync(void);
+
 /// @brief Suspend the audio loop for a short amount of time for state transitions. 
 /// @note The length of suspension is set in `AUDIO_I2S_RESTART_MS`
 void audio_suspend_short(void);
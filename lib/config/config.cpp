@@ -0,0 +1,120 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include "config.h"
+#include "audio.h"
+#include "fsm.h"
+#include "wav_pack.h"
+#include "wav_writer.h"
+#include "dsp_fr1_decim.h"
+
+static Preferences prefs;
+static cfg_rec_t cfg_rec = {
+    .sr = AUDIO_SR_DEFAULT,
+    .bps = FSM_REC_BPS_DEFAULT,
+    .preroll_s = CFG_REC_PREROLL_S_DEFAULT,
+    .decim = 1,
+    .fmt = e_wav_fmt_pcm,
+    .seg_mb = 0,
+    .seg_s = 0
+};
+
+static fsm_vox_cfg_t cfg_vox = {
+    .enabled = 0,
+    .thr_db = FSM_VOX_THR_DB_DEFAULT,
+    .hyst_db = FSM_VOX_HYST_DB_DEFAULT,
+    .hold_ms = FSM_VOX_HOLD_MS_DEFAULT
+};
+
+static cfg_sd_budget_t cfg_sd_budget = {
+    .serial = 0,
+    .kbps = 0,
+    .max_us = 0
+};
+
+e_syserr_t cfg_init(void){
+    if(!prefs.begin(CFG_NVS_NAMESPACE, true)){
+        // namespace does not exist yet (first boot), keep the defaults
+        return e_syserr_none;
+    }
+    uint32_t sr = prefs.getUInt(CFG_KEY_REC_SR, AUDIO_SR_DEFAULT);
+    uint16_t bps = prefs.getUShort(CFG_KEY_REC_BPS, FSM_REC_BPS_DEFAULT);
+    uint16_t pre = prefs.getUShort(CFG_KEY_REC_PREROLL, CFG_REC_PREROLL_S_DEFAULT);
+    uint8_t decim = prefs.getUChar(CFG_KEY_REC_DECIM, 1);
+    uint8_t fmt = prefs.getUChar(CFG_KEY_REC_FMT, e_wav_fmt_pcm);
+    uint16_t seg_mb = prefs.getUShort(CFG_KEY_REC_SEG_MB, 0);
+    uint32_t seg_s = prefs.getUInt(CFG_KEY_REC_SEG_S, 0);
+    uint8_t vox_en = prefs.getUChar(CFG_KEY_VOX_EN, cfg_vox.enabled);
+    int16_t vox_thr = prefs.getShort(CFG_KEY_VOX_THR, cfg_vox.thr_db);
+    uint16_t vox_hyst = prefs.getUShort(CFG_KEY_VOX_HYST, cfg_vox.hyst_db);
+    uint32_t vox_hold = prefs.getUInt(CFG_KEY_VOX_HOLD, cfg_vox.hold_ms);
+    cfg_sd_budget.serial = prefs.getUInt(CFG_KEY_SD_SERIAL, 0);
+    cfg_sd_budget.kbps = prefs.getUInt(CFG_KEY_SD_KBPS, 0);
+    cfg_sd_budget.max_us = prefs.getUInt(CFG_KEY_SD_LAT, 0);
+    prefs.end();
+    if(AUDIO_SR_VALID(sr)) cfg_rec.sr = sr;
+    if(WAV_PACK_BPS_VALID(bps)) cfg_rec.bps = bps;
+    if(pre <= CFG_REC_PREROLL_S_MAX) cfg_rec.preroll_s = pre;
+    if(DSP_FR1_DECIM_VALID(decim)) cfg_rec.decim = decim;
+    if(WAV_FMT_VALID(fmt) && wav_writer_bps_valid(fmt, cfg_rec.bps)) cfg_rec.fmt = fmt;
+    if(seg_mb <= CFG_REC_SEG_MB_MAX) cfg_rec.seg_mb = seg_mb;
+    if(seg_s <= CFG_REC_SEG_S_MAX) cfg_rec.seg_s = seg_s;
+    cfg_vox.enabled = vox_en ? 1 : 0;
+    if(FSM_VOX_THR_VALID(vox_thr)) cfg_vox.thr_db = vox_thr;
+    if(FSM_VOX_HYST_VALID(vox_hyst)) cfg_vox.hyst_db = vox_hyst;
+    if(FSM_VOX_HOLD_VALID(vox_hold)) cfg_vox.hold_ms = vox_hold;
+    return e_syserr_none;
+}
+
+cfg_rec_t cfg_get_rec(void){
+    return cfg_rec;
+}
+
+e_syserr_t cfg_set_rec(cfg_rec_t rec){
+    if(!AUDIO_SR_VALID(rec.sr) || !WAV_PACK_BPS_VALID(rec.bps)) return e_syserr_param;
+    if(rec.preroll_s > CFG_REC_PREROLL_S_MAX) return e_syserr_param;
+    if(!DSP_FR1_DECIM_VALID(rec.decim)) return e_syserr_param;
+    if(!WAV_FMT_VALID(rec.fmt) || !wav_writer_bps_valid(rec.fmt, rec.bps)) return e_syserr_param;
+    if(rec.seg_mb > CFG_REC_SEG_MB_MAX || rec.seg_s > CFG_REC_SEG_S_MAX) return e_syserr_param;
+    if(!prefs.begin(CFG_NVS_NAMESPACE, false)) return e_syserr_driver_fail;
+    prefs.putUInt(CFG_KEY_REC_SR, rec.sr);
+    prefs.putUShort(CFG_KEY_REC_BPS, rec.bps);
+    prefs.putUShort(CFG_KEY_REC_PREROLL, rec.preroll_s);
+    prefs.putUChar(CFG_KEY_REC_DECIM, rec.decim);
+    prefs.putUChar(CFG_KEY_REC_FMT, rec.fmt);
+    prefs.putUShort(CFG_KEY_REC_SEG_MB, rec.seg_mb);
+    prefs.putUInt(CFG_KEY_REC_SEG_S, rec.seg_s);
+    prefs.end();
+    cfg_rec = rec;
+    return e_syserr_none;
+}
+
+fsm_vox_cfg_t cfg_get_vox(void){
+    return cfg_vox;
+}
+
+e_syserr_t cfg_set_vox(fsm_vox_cfg_t vox){
+    if(!FSM_VOX_THR_VALID(vox.thr_db) || !FSM_VOX_HYST_VALID(vox.hyst_db)) return e_syserr_param;
+    if(!FSM_VOX_HOLD_VALID(vox.hold_ms)) return e_syserr_param;
+    if(!prefs.begin(CFG_NVS_NAMESPACE, false)) return e_syserr_driver_fail;
+    prefs.putUChar(CFG_KEY_VOX_EN, vox.enabled);
+    prefs.putShort(CFG_KEY_VOX_THR, vox.thr_db);
+    prefs.putUShort(CFG_KEY_VOX_HYST, vox.hyst_db);
+    prefs.putUInt(CFG_KEY_VOX_HOLD, vox.hold_ms);
+    prefs.end();
+    cfg_vox = vox;
+    return e_syserr_none;
+}
+
+cfg_sd_budget_t cfg_get_sd_budget(void){
+    return cfg_sd_budget;
+}
+
+e_syserr_t cfg_set_sd_budget(cfg_sd_budget_t b){
+    if(!prefs.begin(CFG_NVS_NAMESPACE, false)) return e_syserr_driver_fail;
+    prefs.putUInt(CFG_KEY_SD_SERIAL, b.serial);
+    prefs.putUInt(CFG_KEY_SD_KBPS, b.kbps);
+    prefs.putUInt(CFG_KEY_SD_LAT, b.max_us);
+    prefs.end();
+    cfg_sd_budget = b;
+    return e_syserr_none;
+}
@@ -0,0 +1,89 @@
+/// @file config.h
+/// @brief
+/*
+Persisted device defaults. Values live in NVS (Arduino `Preferences`)
+and are cached in RAM after `cfg_init()`, so getters are cheap and can
+be called from any task.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stdint.h>
+#include "syserr.h"
+#include "fsm_vox_types.h"
+
+#define CFG_MODULE_NAME     "cfg"
+#define CFG_NVS_NAMESPACE   "fr1"
+#define CFG_KEY_REC_SR      "rec_sr"
+#define CFG_KEY_REC_BPS     "rec_bps"
+#define CFG_KEY_REC_PREROLL "rec_pre"
+#define CFG_KEY_REC_DECIM   "rec_dec"
+#define CFG_KEY_REC_FMT     "rec_fmt"
+#define CFG_KEY_REC_SEG_MB  "rec_seg_mb"
+#define CFG_KEY_REC_SEG_S   "rec_seg_s"
+#define CFG_KEY_VOX_EN      "vox_en"
+#define CFG_KEY_VOX_THR     "vox_thr"
+#define CFG_KEY_VOX_HYST    "vox_hyst"
+#define CFG_KEY_VOX_HOLD    "vox_hold"
+#define CFG_KEY_SD_SERIAL   "sd_serial"
+#define CFG_KEY_SD_KBPS     "sd_kbps"
+#define CFG_KEY_SD_LAT      "sd_lat"
+
+#define CFG_REC_PREROLL_S_DEFAULT   2
+#define CFG_REC_PREROLL_S_MAX       10
+#define CFG_REC_SEG_MB_MAX          4095    // FAT32 file size limit
+#define CFG_REC_SEG_S_MAX           86400   // one day
+
+/// @brief Persisted recording defaults.
+typedef struct cfg_rec_t{
+    uint32_t sr;
+    uint16_t bps;
+    uint16_t preroll_s;     // seconds kept ahead of every take, 0 = off
+    uint8_t decim;          // file rate = sr / decim
+    uint8_t fmt;            // e_wav_fmt_t
+    uint16_t seg_mb;        // split takes at this size in MiB, 0 = off
+    uint32_t seg_s;         // split takes at this duration in seconds, 0 = off
+}cfg_rec_t;
+
+/// @brief Measured write budget of one SD card, see `rec_budget_measure()`.
+typedef struct cfg_sd_budget_t{
+    uint32_t serial;        // CID serial of the measured card, 0 = never measured
+    uint32_t kbps;          // sustained write rate of the recording path in KiB/s
+    uint32_t max_us;        // worst single write of the recording path
+}cfg_sd_budget_t;
+
+/// @brief Load the persisted defaults from NVS.
+/// @return FR1 error code.
+/// @note Missing or invalid keys fall back to the compile time defaults.
+e_syserr_t cfg_init(void);
+
+/// @brief Get the recording defaults.
+/// @return Recording defaults (by value).
+cfg_rec_t cfg_get_rec(void);
+
+/// @brief Get the persisted VOX settings.
+/// @return VOX settings (by value).
+fsm_vox_cfg_t cfg_get_vox(void);
+
+/// @brief Validate, cache and persist new VOX settings.
+/// @param vox New VOX settings.
+/// @return FR1 error code.
+e_syserr_t cfg_set_vox(fsm_vox_cfg_t vox);
+
+/// @brief Validate, cache and persist new recording defaults.
+/// @param rec New recording defaults.
+/// @return FR1 error code. Returns `e_syserr_param` for unsupported values.
+e_syserr_t cfg_set_rec(cfg_rec_t rec);
+
+/// @brief Get the persisted write budget of the last benchmarked card.
+/// @return SD budget (by value).
+cfg_sd_budget_t cfg_get_sd_budget(void);
+
+/// @brief Cache and persist the write budget of a benchmarked card.
+/// @param b New SD budget, replaces the one of any previous card.
+/// @return FR1 error code.
+e_syserr_t cfg_set_sd_budget(cfg_sd_budget_t b);
+
+#endif // _CONFIG_H_
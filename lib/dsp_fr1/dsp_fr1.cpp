@@ -32,6 +32,75 @@ stereo_value_t dsp_fr1_samples_to_msqr_32b(stereo_sample_t* data, uint32_t len){
     return msqr;
 }
 
+/*
+The meter works on the 24 bit sample lifted by DSP_FR1_METER_HEADROOM
+bits, so the DC estimate keeps fractional precision while the difference
+still fits 32 bit. Squares of the DC-free 24(+1) bit values go into an
+int64 per channel, the only float math left is the scaling per frame.
+*/
+#define DSP_FR1_METER_MSQR_SCALE (1.0f / (8388608.0f * 8388608.0f))
+
+typedef struct dsp_fr1_meter_ch_t{
+    int64_t acc;
+    int32_t peak_pos;
+    int32_t peak_neg;
+    uint32_t clips;
+}dsp_fr1_meter_ch_t;
+
+static int32_t meter_dc[2] = {0, 0};
+
+static inline void dsp_fr1_meter_sample(int32_t raw, int32_t* dc, dsp_fr1_meter_ch_t* ch){
+    int32_t s = raw >> 8;
+    if(s > ch->peak_pos) ch->peak_pos = s;
+    if(s < ch->peak_neg) ch->peak_neg = s;
+    ch->clips += (s >= DSP_FR1_METER_CLIP_POS) | (s <= DSP_FR1_METER_CLIP_NEG);
+    int32_t d = (s << DSP_FR1_METER_HEADROOM) - *dc;
+    *dc += d >> DSP_FR1_METER_DC_SHIFT;
+    int32_t y = d >> DSP_FR1_METER_HEADROOM;
+    ch->acc += (int64_t)y * y;
+}
+
+static inline float dsp_fr1_meter_peak(const dsp_fr1_meter_ch_t* ch){
+    int32_t p = ch->peak_pos > -ch->peak_neg ? ch->peak_pos : -ch->peak_neg;
+    return (float)p * INT24_SCALE;
+}
+
+template <uint8_t N_CH>
+static inline dsp_fr1_meter_t dsp_fr1_meter_kernel(const stereo_sample_t* data, uint32_t len){
+    dsp_fr1_meter_ch_t l = {0, 0, 0, 0};
+    dsp_fr1_meter_ch_t r = {0, 0, 0, 0};
+    int32_t dc_l = meter_dc[0];
+    int32_t dc_r = meter_dc[1];
+    for(uint32_t i = 0; i < len; i++){
+        dsp_fr1_meter_sample(data[i].l, &dc_l, &l);
+        if(N_CH == 2) dsp_fr1_meter_sample(data[i].r, &dc_r, &r);
+    }
+    meter_dc[0] = dc_l;
+    meter_dc[1] = dc_r;
+    dsp_fr1_meter_t m;
+    m.msqr.l = (float)(l.acc / len) * DSP_FR1_METER_MSQR_SCALE;
+    m.peak.l = dsp_fr1_meter_peak(&l);
+    m.clips_l = l.clips;
+    if(N_CH == 2){
+        m.msqr.r = (float)(r.acc / len) * DSP_FR1_METER_MSQR_SCALE;
+        m.peak.r = dsp_fr1_meter_peak(&r);
+        m.clips_r = r.clips;
+    }else{
+        m.msqr.r = m.msqr.l;
+        m.peak.r = m.peak.l;
+        m.clips_r = m.clips_l;
+    }
+    return m;
+}
+
+dsp_fr1_meter_t dsp_fr1_meter_32b(const stereo_sample_t* data, uint32_t len){
+    if(len == 0){
+        dsp_fr1_meter_t m = {};
+        return m;
+    }
+    return dsp_fr1_meter_kernel<DSP_FR1_METER_N_CH>(data, len);
+}
+
 stereo_value_t dsp_fr1_samples_to_dbfs_32b(stereo_sample_t* data, uint32_t len){
     stereo_value_t msqr = dsp_fr1_samples_to_msqr_32b(data, len);
     stereo_value_t dbfs = {.l = 10*log10f(msqr.l), .r = 10*log10f(msqr.r)};
@@ -13,6 +13,22 @@
 
 #define DSP_FR1_ROLL_AVG_N 10
 
+#define DSP_FR1_METER_DC_SHIFT  10      // integer DC one-pole, alpha = 2^-10 (~0.001)
+#define DSP_FR1_METER_HEADROOM  6       // guard bits of the DC path above 24 bit
+#define DSP_FR1_METER_CLIP_POS  8388607 // 24 bit full scale codes count as clipped
+#define DSP_FR1_METER_CLIP_NEG  (-8388608)
+#ifndef DSP_FR1_METER_N_CH
+#define DSP_FR1_METER_N_CH      1       // MEMS capture is mono (`l`), 2 meters both slots
+#endif
+
+/// @brief Result of the fused metering kernel.
+typedef struct dsp_fr1_meter_t{
+    stereo_value_t msqr;        // DC-removed mean square, full scale = 1
+    stereo_value_t peak;        // highest absolute sample, full scale = 1
+    uint32_t clips_l;           // samples at full scale
+    uint32_t clips_r;
+}dsp_fr1_meter_t;
+
 /// @brief Fast sine approximation based on Bhaskara I algorithm.
 /// @param x Wrapped or unwrapped phase.
 /// @return Sine approximation.
@@ -24,6 +40,14 @@ inline float sin_bhaskara_I(float x);
 /// @return 
 stereo_value_t dsp_fr1_samples_to_msqr_32b(stereo_sample_t* data, uint32_t len);
 
+/// @brief Fixed-point mean square, peak and clip count of a frame in one pass.
+/// @param data I2S frame, MSB-aligned 24 bit samples.
+/// @param len Length of frame in stereo samples.
+/// @return Meter values. With `DSP_FR1_METER_N_CH == 1` only `l` is measured and mirrored to `r`.
+/// @note Keeps its own DC state, use it instead of (not next to) `dsp_fr1_samples_to_msqr_32b()`
+/// on a stream. Accumulates in int64, `len` may be up to 2^13 without overflow.
+dsp_fr1_meter_t dsp_fr1_meter_32b(const stereo_sample_t* data, uint32_t len);
+
 /// @brief 
 /// @param data 
 /// @param len 
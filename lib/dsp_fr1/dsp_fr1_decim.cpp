@@ -0,0 +1,74 @@
+#include "dsp_fr1_decim.h"
+#include <math.h>
+#include <string.h>
+
+#define DSP_FR1_DECIM_S24_MAX   8388607
+#define DSP_FR1_DECIM_S24_MIN   (-8388608)
+
+e_syserr_t dsp_fr1_decim_init(dsp_fr1_decim_t* dec, uint8_t m, uint8_t n_ch){
+    if(dec == NULL) return e_syserr_null;
+    if(!DSP_FR1_DECIM_VALID(m) || n_ch < 1 || n_ch > 2) return e_syserr_param;
+    memset(dec, 0, sizeof(dsp_fr1_decim_t));
+    dec->m = m;
+    dec->n_ch = n_ch;
+    if(m == 1) return e_syserr_none;
+    uint16_t n = DSP_FR1_DECIM_TAPS_PER_M * m;
+    dec->n_taps = n;
+    float fc = DSP_FR1_DECIM_CUTOFF / (float)m;    // cycles per input sample
+    float h[DSP_FR1_DECIM_TAPS_MAX];
+    float sum = 0;
+    for(uint16_t i = 0; i < n; i++){
+        float t = (float)i - (float)(n - 1) / 2.0f;
+        float x = 2.0f * (float)M_PI * fc * t;
+        float s = t == 0 ? 2.0f * fc : sinf(x) / ((float)M_PI * t);
+        float w = 0.42f - 0.5f * cosf(2.0f * (float)M_PI * i / (n - 1))
+                        + 0.08f * cosf(4.0f * (float)M_PI * i / (n - 1));
+        h[i] = s * w;
+        sum += h[i];
+    }
+    // unity DC gain after quantization
+    float scale = (float)(1LL << DSP_FR1_DECIM_COEF_Q) / sum;
+    int64_t q_sum = 0;
+    uint16_t mid = n / 2;
+    for(uint16_t i = 0; i < n; i++){
+        dec->coef[i] = (dsp_fr1_decim_coef_t)lrintf(h[i] * scale);
+        q_sum += dec->coef[i];
+    }
+    dec->coef[mid] += (dsp_fr1_decim_coef_t)((1LL << DSP_FR1_DECIM_COEF_Q) - q_sum);
+    return e_syserr_none;
+}
+
+static inline int32_t dsp_fr1_decim_dot(const dsp_fr1_decim_coef_t* coef, const int32_t* x, uint16_t n){
+    // x points at the newest sample, history runs backwards
+    int64_t acc = 0;
+    for(uint16_t k = 0; k < n; k++) acc += (int64_t)coef[k] * x[-(int32_t)k];
+    acc += 1LL << (DSP_FR1_DECIM_COEF_Q - 1);
+    int64_t y = acc >> DSP_FR1_DECIM_COEF_Q;
+    if(y > DSP_FR1_DECIM_S24_MAX) y = DSP_FR1_DECIM_S24_MAX;
+    if(y < DSP_FR1_DECIM_S24_MIN) y = DSP_FR1_DECIM_S24_MIN;
+    return (int32_t)y;
+}
+
+uint32_t dsp_fr1_decim_process(dsp_fr1_decim_t* dec, stereo_sample_t* data, uint32_t len){
+    if(dec->m <= 1) return len;
+    if(len > AUDIO_FRAME_LEN) len = AUDIO_FRAME_LEN;
+    uint16_t hist = dec->n_taps - 1;
+    uint32_t out = 0;
+    for(uint8_t c = 0; c < dec->n_ch; c++){
+        int32_t* w = dec->work[c];
+        for(uint32_t i = 0; i < len; i++){
+            w[hist + i] = (c == 0 ? data[i].l : data[i].r) >> 8;
+        }
+        // outputs land at or before their newest input, in place is safe
+        uint32_t j = 0;
+        for(uint32_t i = dec->phase; i < len; i += dec->m, j++){
+            int32_t y = dsp_fr1_decim_dot(dec->coef, &w[hist + i], dec->n_taps) << 8;
+            if(c == 0) data[j].l = y;
+            else data[j].r = y;
+        }
+        memmove(w, &w[len], hist * sizeof(int32_t));
+        out = j;
+    }
+    dec->phase = dec->phase + out * dec->m - len;
+    return out;
+}
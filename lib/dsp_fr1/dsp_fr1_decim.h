@@ -0,0 +1,60 @@
+/// @file dsp_fr1_decim.h
+/// @brief
+/*
+Streaming FIR decimator by 2, 3 or 4 (48 kHz -> 24/16/12 kHz). Only every
+M-th output is computed (polyphase in effect, the M-1 discarded phases
+are never evaluated). A Blackman windowed sinc is designed at init and
+quantized to Q31, samples are the 24 bit MEMS values, products accumulate
+in int64. The response is flat within 0.4 dB up to 0.4 * fs_out and at
+least 75 dB down from 0.55 * fs_out. Define DSP_FR1_DECIM_COEF_Q15 to halve
+the coefficient table, its quantization lifts the stopband to about -70 dB.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _DSP_FR1_DECIM_H_
+#define _DSP_FR1_DECIM_H_
+
+#include <stdint.h>
+#include "syserr.h"
+#include "audio.h"
+
+#define DSP_FR1_DECIM_MAX           4
+#define DSP_FR1_DECIM_VALID(m)      ((m) >= 1 && (m) <= DSP_FR1_DECIM_MAX)
+#define DSP_FR1_DECIM_TAPS_PER_M    32
+#define DSP_FR1_DECIM_TAPS_MAX      (DSP_FR1_DECIM_TAPS_PER_M * DSP_FR1_DECIM_MAX)
+#define DSP_FR1_DECIM_CUTOFF        0.45f   // -6 dB point relative to the output rate
+
+#ifdef DSP_FR1_DECIM_COEF_Q15
+typedef int16_t dsp_fr1_decim_coef_t;
+#define DSP_FR1_DECIM_COEF_Q        15
+#else
+typedef int32_t dsp_fr1_decim_coef_t;
+#define DSP_FR1_DECIM_COEF_Q        31
+#endif
+
+/// @brief Decimator context, holds the filter history of both channels.
+typedef struct dsp_fr1_decim_t{
+    uint8_t m;
+    uint8_t n_ch;
+    uint16_t n_taps;
+    uint32_t phase;             // index of the next output in the next frame
+    dsp_fr1_decim_coef_t coef[DSP_FR1_DECIM_TAPS_MAX];
+    int32_t work[2][DSP_FR1_DECIM_TAPS_MAX + AUDIO_FRAME_LEN];
+}dsp_fr1_decim_t;
+
+/// @brief Design the filter and clear the history.
+/// @param dec Decimator context.
+/// @param m Decimation factor, 1 passes frames through.
+/// @param n_ch 1 filters `l` only, 2 filters `l` and `r`.
+/// @return FR1 error code.
+e_syserr_t dsp_fr1_decim_init(dsp_fr1_decim_t* dec, uint8_t m, uint8_t n_ch);
+
+/// @brief Decimate a frame in place.
+/// @param dec Decimator context.
+/// @param data I2S frame, MSB-aligned. The output overwrites its head.
+/// @param len Length of frame in stereo samples, up to `AUDIO_FRAME_LEN`.
+/// @return Amount of output samples at the head of `data`.
+/// @note The amount varies by one from frame to frame if `len` is no multiple of `m`.
+uint32_t dsp_fr1_decim_process(dsp_fr1_decim_t* dec, stereo_sample_t* data, uint32_t len);
+
+#endif // _DSP_FR1_DECIM_H_
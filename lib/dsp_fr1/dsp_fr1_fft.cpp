@@ -0,0 +1,136 @@
+#include "dsp_fr1_fft.h"
+#include <math.h>
+#include <string.h>
+
+static const float dsp_fr1_third_nominal[DSP_FR1_THIRD_BANDS] = {
+    25, 31.5, 40, 50, 63, 80, 100, 125, 160, 200,
+    250, 315, 400, 500, 630, 800, 1000, 1250, 1600, 2000,
+    2500, 3150, 4000, 5000, 6300, 8000, 10000, 12500, 16000, 20000
+};
+#define DSP_FR1_THIRD_EXP_FIRST (-16)   // 25 Hz = 1 kHz * 10^(-16/10)
+#define DSP_FR1_OCT_IN_THIRD    1       // 31.5 Hz is the first octave
+
+uint32_t dsp_fr1_fft_mem_size(uint32_t n){
+    return n * sizeof(float)                // twiddles
+         + n * sizeof(float)                // window
+         + (n / 2) * sizeof(uint16_t);      // bit reversal
+}
+
+e_syserr_t dsp_fr1_fft_init(dsp_fr1_fft_t* fft, uint32_t n, void* mem){
+    if(fft == NULL || mem == NULL) return e_syserr_null;
+    if(n < 4 || n > DSP_FR1_FFT_N_MAX || (n & (n - 1)) != 0) return e_syserr_param;
+    fft->n = n;
+    fft->twiddle = (float*)mem;
+    fft->window = fft->twiddle + n;
+    fft->bitrev = (uint16_t*)(fft->window + n);
+    uint32_t m = n / 2;
+    for(uint32_t k = 0; k < m; k++){
+        float a = 2.0f * (float)M_PI * (float)k / (float)n;
+        fft->twiddle[2*k] = cosf(a);
+        fft->twiddle[2*k + 1] = -sinf(a);
+    }
+    fft->window_pow = 0;
+    for(uint32_t i = 0; i < n; i++){
+        float w = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * (float)i / (float)n);
+        fft->window[i] = w;
+        fft->window_pow += w * w;
+    }
+    uint32_t bits = 0;
+    while((1u << bits) < m) bits++;
+    for(uint32_t i = 0; i < m; i++){
+        uint32_t r = 0;
+        for(uint32_t b = 0; b < bits; b++) r |= ((i >> b) & 1) << (bits - 1 - b);
+        fft->bitrev[i] = (uint16_t)r;
+    }
+    return e_syserr_none;
+}
+
+/// @brief In-place radix-2 DIT on n/2 interleaved complex values.
+static void dsp_fr1_fft_complex(const dsp_fr1_fft_t* fft, float* z){
+    uint32_t m = fft->n / 2;
+    for(uint32_t i = 0; i < m; i++){
+        uint32_t r = fft->bitrev[i];
+        if(i < r){
+            float tr = z[2*i], ti = z[2*i + 1];
+            z[2*i] = z[2*r];
+            z[2*i + 1] = z[2*r + 1];
+            z[2*r] = tr;
+            z[2*r + 1] = ti;
+        }
+    }
+    for(uint32_t size = 2; size <= m; size <<= 1){
+        uint32_t half = size >> 1;
+        uint32_t step = (m / size) * 2;     // W_m^j = W_n^(2j)
+        for(uint32_t i = 0; i < m; i += size){
+            for(uint32_t j = 0; j < half; j++){
+                float wr = fft->twiddle[2 * j * step];
+                float wi = fft->twiddle[2 * j * step + 1];
+                float* a = &z[2 * (i + j)];
+                float* b = &z[2 * (i + j + half)];
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+void dsp_fr1_fft_power(const dsp_fr1_fft_t* fft, float* x, float* pow){
+    uint32_t n = fft->n;
+    uint32_t m = n / 2;
+    for(uint32_t i = 0; i < n; i++) x[i] *= fft->window[i];
+    // even samples are the real, odd samples the imaginary part
+    dsp_fr1_fft_complex(fft, x);
+    float scale = 1.0f / ((float)n * fft->window_pow);
+    for(uint32_t k = 0; k <= m; k++){
+        uint32_t a = k % m;
+        uint32_t b = (m - k) % m;
+        float zr = x[2*a], zi = x[2*a + 1];
+        float cr = x[2*b], ci = -x[2*b + 1];
+        float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+        float or_ = 0.5f * (zi - ci), oi = -0.5f * (zr - cr);
+        float wr = k < m ? fft->twiddle[2*k] : -1.0f;
+        float wi = k < m ? fft->twiddle[2*k + 1] : 0.0f;
+        float xr = er + wr * or_ - wi * oi;
+        float xi = ei + wr * oi + wi * or_;
+        float p = (xr * xr + xi * xi) * scale;
+        pow[k] = (k == 0 || k == m) ? p : 2.0f * p;
+    }
+}
+
+void dsp_fr1_bands_init(dsp_fr1_bands_t* bands, uint8_t fraction, uint32_t n, uint32_t sr){
+    uint8_t third = fraction == 3;
+    bands->n_bands = third ? DSP_FR1_THIRD_BANDS : DSP_FR1_OCT_BANDS;
+    float half_bw = powf(10.0f, third ? 0.05f : 0.15f);     // 10^(3/20b)
+    uint32_t k_max = n / 2 + 1;
+    for(uint16_t i = 0; i < bands->n_bands; i++){
+        int32_t x = third ? DSP_FR1_THIRD_EXP_FIRST + i : DSP_FR1_THIRD_EXP_FIRST + 3 * i + DSP_FR1_OCT_IN_THIRD;
+        float fm = 1000.0f * powf(10.0f, (float)x / 10.0f);
+        uint32_t lo = (uint32_t)ceilf(fm / half_bw * (float)n / (float)sr);
+        uint32_t hi = (uint32_t)ceilf(fm * half_bw * (float)n / (float)sr);
+        if(lo < 1) lo = 1;      // DC is no band
+        if(lo > k_max) lo = k_max;
+        if(hi > k_max) hi = k_max;
+        if(hi < lo) hi = lo;
+        bands->lo[i] = (uint16_t)lo;
+        bands->hi[i] = (uint16_t)hi;
+    }
+}
+
+void dsp_fr1_bands_sum(const dsp_fr1_bands_t* bands, const float* pow, float* db){
+    for(uint16_t i = 0; i < bands->n_bands; i++){
+        float sum = 0;
+        for(uint16_t k = bands->lo[i]; k < bands->hi[i]; k++) sum += pow[k];
+        float l = sum > 0 ? 10.0f * log10f(sum) : DSP_FR1_BAND_FLOOR_DB;
+        db[i] = l < DSP_FR1_BAND_FLOOR_DB ? DSP_FR1_BAND_FLOOR_DB : l;
+    }
+}
+
+float dsp_fr1_band_center(uint8_t fraction, uint16_t idx){
+    if(fraction == 3) return idx < DSP_FR1_THIRD_BANDS ? dsp_fr1_third_nominal[idx] : 0;
+    uint16_t t = 3 * idx + DSP_FR1_OCT_IN_THIRD;
+    return t < DSP_FR1_THIRD_BANDS ? dsp_fr1_third_nominal[t] : 0;
+}
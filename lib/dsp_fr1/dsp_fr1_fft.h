@@ -0,0 +1,77 @@
+/// @file dsp_fr1_fft.h
+/// @brief
+/*
+Real-input FFT and fractional octave band summing. The N point real
+transform runs as an N/2 point complex radix-2 FFT plus a split step.
+Twiddles, bit reversal and the window live in a context that is set up
+once, so the per-frame path does no trigonometry.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _DSP_FR1_FFT_H_
+#define _DSP_FR1_FFT_H_
+
+#include <stdint.h>
+#include "syserr.h"
+
+#define DSP_FR1_FFT_N_MAX       2048
+#define DSP_FR1_OCT_BANDS       10      // 31.5 Hz ... 16 kHz
+#define DSP_FR1_THIRD_BANDS     30      // 25 Hz ... 20 kHz
+#define DSP_FR1_BAND_FLOOR_DB   (-140.0f)
+
+/// @brief FFT context, buffers are owned by the caller.
+typedef struct dsp_fr1_fft_t{
+    uint32_t n;                 // real input length, power of two
+    float* twiddle;             // n/2 cos/sin pairs of the N point transform
+    float* window;              // n Hann coefficients
+    uint16_t* bitrev;           // n/2 bit reversed indices
+    float window_pow;           // sum of the squared window
+}dsp_fr1_fft_t;
+
+/// @brief Band edges in FFT bins for one sample rate.
+typedef struct dsp_fr1_bands_t{
+    uint16_t n_bands;
+    uint16_t lo[DSP_FR1_THIRD_BANDS];
+    uint16_t hi[DSP_FR1_THIRD_BANDS];   // exclusive, `lo == hi` marks a band below the resolution
+}dsp_fr1_bands_t;
+
+/// @brief Get the amount of memory `dsp_fr1_fft_init()` needs.
+/// @param n Real input length.
+/// @return Bytes.
+uint32_t dsp_fr1_fft_mem_size(uint32_t n);
+
+/// @brief Set up twiddles, bit reversal and Hann window.
+/// @param fft FFT context.
+/// @param n Real input length, power of two up to `DSP_FR1_FFT_N_MAX`.
+/// @param mem Buffer of `dsp_fr1_fft_mem_size(n)` bytes, 4 byte aligned.
+/// @return FR1 error code.
+e_syserr_t dsp_fr1_fft_init(dsp_fr1_fft_t* fft, uint32_t n, void* mem);
+
+/// @brief Window and transform a real signal and get its one-sided power spectrum.
+/// @param fft FFT context.
+/// @param x `n` samples, overwritten as scratch.
+/// @param pow Output of `n/2 + 1` bins. Summing bins gives the mean square of
+/// the signal with the convention of `dsp_fr1_samples_to_msqr_32b()`.
+void dsp_fr1_fft_power(const dsp_fr1_fft_t* fft, float* x, float* pow);
+
+/// @brief Map 1/1 or 1/3 octave bands (IEC 61260 base 10) to FFT bins.
+/// @param bands Band table to fill.
+/// @param fraction 1 for octaves, 3 for third octaves.
+/// @param n Real FFT length.
+/// @param sr Sample rate.
+/// @note Bands above Nyquist are left empty.
+void dsp_fr1_bands_init(dsp_fr1_bands_t* bands, uint8_t fraction, uint32_t n, uint32_t sr);
+
+/// @brief Sum a power spectrum into band levels.
+/// @param bands Band table.
+/// @param pow Power spectrum from `dsp_fr1_fft_power()`.
+/// @param db Output of `bands->n_bands` levels in dBFS.
+void dsp_fr1_bands_sum(const dsp_fr1_bands_t* bands, const float* pow, float* db);
+
+/// @brief Get the nominal center frequency of a band.
+/// @param fraction 1 for octaves, 3 for third octaves.
+/// @param idx Band index.
+/// @return Center frequency in Hz.
+float dsp_fr1_band_center(uint8_t fraction, uint16_t idx);
+
+#endif // _DSP_FR1_FFT_H_
@@ -0,0 +1,205 @@
+#include "dsp_fr1_slm.h"
+#include "hal/cpu_hal.h"
+#include <math.h>
+#include <string.h>
+
+// IEC 61672-1 pole frequencies
+#define DSP_FR1_SLM_F1  20.598997f
+#define DSP_FR1_SLM_F2  107.65265f
+#define DSP_FR1_SLM_F3  737.86223f
+#define DSP_FR1_SLM_F4  12194.217f
+
+#define DSP_FR1_SLM_SAMPLE_SCALE (1.0f / 2147483648.0f)
+
+/// @brief Normalized biquad, direct form II transposed.
+typedef struct dsp_fr1_biquad_t{
+    float b0, b1, b2, a1, a2;
+    float z1, z2;
+}dsp_fr1_biquad_t;
+
+typedef struct dsp_fr1_slm_t{
+    dsp_fr1_biquad_t bq[DSP_FR1_SLM_MAX_SECTIONS];
+    uint8_t n_bq;
+    float gain;                 // 0 dB at 1 kHz
+    float k_fast, k_slow, k_imp_rise, k_imp_fall;
+    float ms_fast, ms_slow, ms_imp;
+    double eq_sum;              // sum of squares since reset
+    uint64_t eq_n;
+    float max_ms;
+    float peak;
+    uint32_t sr;
+    dsp_fr1_slm_values_t v;
+    volatile uint8_t redesign;
+    volatile uint8_t reset;
+}dsp_fr1_slm_t;
+
+static dsp_fr1_slm_t slm = {
+    .redesign = 1,
+    .reset = 1,
+};
+
+/// @brief Bilinear transform of (b0 s^2 + b1 s + b2) / (a0 s^2 + a1 s + a2).
+static void dsp_fr1_biquad_bilinear(dsp_fr1_biquad_t* bq, float fs,
+                                    float b0, float b1, float b2,
+                                    float a0, float a1, float a2){
+    float k = 2.0f * fs;
+    float kk = k * k;
+    float n0 = b0 * kk + b1 * k + b2;
+    float n1 = 2.0f * (b2 - b0 * kk);
+    float n2 = b0 * kk - b1 * k + b2;
+    float d0 = a0 * kk + a1 * k + a2;
+    float d1 = 2.0f * (a2 - a0 * kk);
+    float d2 = a0 * kk - a1 * k + a2;
+    bq->b0 = n0 / d0;
+    bq->b1 = n1 / d0;
+    bq->b2 = n2 / d0;
+    bq->a1 = d1 / d0;
+    bq->a2 = d2 / d0;
+    bq->z1 = 0;
+    bq->z2 = 0;
+}
+
+/// @brief Magnitude of a biquad at a frequency.
+static float dsp_fr1_biquad_mag(const dsp_fr1_biquad_t* bq, float f, float fs){
+    float w = 2.0f * (float)M_PI * f / fs;
+    float c1 = cosf(w), s1 = sinf(w);
+    float c2 = cosf(2 * w), s2 = sinf(2 * w);
+    float nr = bq->b0 + bq->b1 * c1 + bq->b2 * c2;
+    float ni = -(bq->b1 * s1 + bq->b2 * s2);
+    float dr = 1.0f + bq->a1 * c1 + bq->a2 * c2;
+    float di = -(bq->a1 * s1 + bq->a2 * s2);
+    return sqrtf((nr * nr + ni * ni) / (dr * dr + di * di));
+}
+
+static inline float dsp_fr1_biquad_run(dsp_fr1_biquad_t* bq, float x){
+    float y = bq->b0 * x + bq->z1;
+    bq->z1 = bq->b1 * x - bq->a1 * y + bq->z2;
+    bq->z2 = bq->b2 * x - bq->a2 * y;
+    return y;
+}
+
+/// @brief One-pole coefficient of a time constant.
+static inline float dsp_fr1_slm_k(float tau, float fs){
+    return 1.0f - expf(-1.0f / (tau * fs));
+}
+
+static void dsp_fr1_slm_design(uint32_t sr){
+    float fs = (float)sr;
+    float w1 = 2.0f * (float)M_PI * DSP_FR1_SLM_F1;
+    float w2 = 2.0f * (float)M_PI * DSP_FR1_SLM_F2;
+    float w3 = 2.0f * (float)M_PI * DSP_FR1_SLM_F3;
+    // the high pole sits close to Nyquist, prewarp it so the roll-off stays in place
+    float w4 = 2.0f * fs * tanf((float)M_PI * DSP_FR1_SLM_F4 / fs);
+    switch(slm.v.weight){
+        case e_dsp_fr1_slm_a:
+            // s^4 / ((s+w1)^2 (s+w2) (s+w3) (s+w4)^2)
+            dsp_fr1_biquad_bilinear(&slm.bq[0], fs, 1, 0, 0, 1, 2 * w1, w1 * w1);
+            dsp_fr1_biquad_bilinear(&slm.bq[1], fs, 1, 0, 0, 1, w2 + w3, w2 * w3);
+            dsp_fr1_biquad_bilinear(&slm.bq[2], fs, 0, 0, 1, 1, 2 * w4, w4 * w4);
+            slm.n_bq = 3;
+            break;
+        case e_dsp_fr1_slm_c:
+            // s^2 / ((s+w1)^2 (s+w4)^2)
+            dsp_fr1_biquad_bilinear(&slm.bq[0], fs, 1, 0, 0, 1, 2 * w1, w1 * w1);
+            dsp_fr1_biquad_bilinear(&slm.bq[1], fs, 0, 0, 1, 1, 2 * w4, w4 * w4);
+            slm.n_bq = 2;
+            break;
+        default:{
+            // second order Butterworth high pass
+            float wz = 2.0f * (float)M_PI * DSP_FR1_SLM_Z_HP_HZ;
+            dsp_fr1_biquad_bilinear(&slm.bq[0], fs, 1, 0, 0, 1, (float)M_SQRT2 * wz, wz * wz);
+            slm.n_bq = 1;
+            break;
+        }
+    }
+    float mag = 1.0f;
+    for(uint8_t i = 0; i < slm.n_bq; i++) mag *= dsp_fr1_biquad_mag(&slm.bq[i], 1000.0f, fs);
+    slm.gain = slm.v.weight == e_dsp_fr1_slm_z ? 1.0f : 1.0f / mag;
+    slm.k_fast = dsp_fr1_slm_k(DSP_FR1_SLM_TAU_FAST_S, fs);
+    slm.k_slow = dsp_fr1_slm_k(DSP_FR1_SLM_TAU_SLOW_S, fs);
+    slm.k_imp_rise = dsp_fr1_slm_k(DSP_FR1_SLM_TAU_IMP_RISE_S, fs);
+    slm.k_imp_fall = dsp_fr1_slm_k(DSP_FR1_SLM_TAU_IMP_FALL_S, fs);
+    slm.sr = sr;
+}
+
+static inline float dsp_fr1_slm_db(float ms){
+    if(ms <= 0) return DSP_FR1_SLM_FLOOR_DB;
+    float db = 10.0f * log10f(ms);
+    return db < DSP_FR1_SLM_FLOOR_DB ? DSP_FR1_SLM_FLOOR_DB : db;
+}
+
+void dsp_fr1_slm_config(dsp_fr1_slm_weight_t weight, dsp_fr1_slm_time_t time){
+    slm.v.weight = weight;
+    slm.v.time = time;
+    slm.redesign = 1;
+    slm.reset = 1;
+}
+
+void dsp_fr1_slm_reset(void){
+    slm.reset = 1;
+}
+
+dsp_fr1_slm_values_t dsp_fr1_slm_process(const stereo_sample_t* data, uint32_t len, uint32_t sr){
+    uint32_t t0 = cpu_hal_get_cycle_count();
+    if(slm.redesign || sr != slm.sr){
+        slm.redesign = 0;
+        dsp_fr1_slm_design(sr);
+        slm.ms_fast = slm.ms_slow = slm.ms_imp = 0;
+        slm.reset = 1;
+    }
+    if(slm.reset){
+        slm.reset = 0;
+        slm.eq_sum = 0;
+        slm.eq_n = 0;
+        slm.max_ms = 0;
+        slm.peak = 0;
+    }
+    // local copies keep the loop in registers
+    float fast = slm.ms_fast, slow = slm.ms_slow, imp = slm.ms_imp;
+    float kf = slm.k_fast, ks = slm.k_slow, kir = slm.k_imp_rise, kif = slm.k_imp_fall;
+    float gain = slm.gain * DSP_FR1_SLM_SAMPLE_SCALE;
+    float sum = 0, peak = slm.peak, max_ms = slm.max_ms;
+    uint8_t n_bq = slm.n_bq;
+    dsp_fr1_slm_time_t time = slm.v.time;
+    for(uint32_t i = 0; i < len; i++){
+        float y = (float)data[i].l * gain;
+        for(uint8_t b = 0; b < n_bq; b++) y = dsp_fr1_biquad_run(&slm.bq[b], y);
+        float y2 = y * y;
+        sum += y2;
+        if(y2 > peak) peak = y2;
+        fast += kf * (y2 - fast);
+        slow += ks * (y2 - slow);
+        imp += (y2 > imp ? kir : kif) * (y2 - imp);
+        float cur = time == e_dsp_fr1_slm_fast ? fast : (time == e_dsp_fr1_slm_slow ? slow : imp);
+        if(cur > max_ms) max_ms = cur;
+    }
+    slm.ms_fast = fast;
+    slm.ms_slow = slow;
+    slm.ms_imp = imp;
+    slm.eq_sum += sum;
+    slm.eq_n += len;
+    slm.peak = peak;
+    slm.max_ms = max_ms;
+
+    dsp_fr1_slm_values_t* v = &slm.v;
+    v->l_fast = dsp_fr1_slm_db(fast);
+    v->l_slow = dsp_fr1_slm_db(slow);
+    v->l_imp = dsp_fr1_slm_db(imp);
+    v->l = time == e_dsp_fr1_slm_fast ? v->l_fast : (time == e_dsp_fr1_slm_slow ? v->l_slow : v->l_imp);
+    v->leq = slm.eq_n ? dsp_fr1_slm_db((float)(slm.eq_sum / (double)slm.eq_n)) : DSP_FR1_SLM_FLOOR_DB;
+    v->lmax = dsp_fr1_slm_db(max_ms);
+    v->lpeak = dsp_fr1_slm_db(peak);
+    if(len > 0){
+        v->cyc_per_sample = (cpu_hal_get_cycle_count() - t0) / len;
+        if(v->cyc_per_sample > DSP_FR1_SLM_BUDGET_CYC) v->over_budget++;
+    }
+    return *v;
+}
+
+const char* dsp_fr1_slm_weight_name(dsp_fr1_slm_weight_t weight){
+    switch(weight){
+        case e_dsp_fr1_slm_a: return "A";
+        case e_dsp_fr1_slm_c: return "C";
+        default: return "Z";
+    }
+}
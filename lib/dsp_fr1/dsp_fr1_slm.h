@@ -0,0 +1,81 @@
+/// @file dsp_fr1_slm.h
+/// @brief
+/*
+Sound level meter. Samples run through an A, C or Z frequency weighting
+(cascaded biquads, bilinear transformed from the IEC 61672 analog poles
+for the active sample rate and normalized to 0 dB at 1 kHz) and then
+through the exponential Fast, Slow and Impulse time weightings. Leq,
+Lmax and Lpeak integrate from the last reset.
+
+Levels are in dBFS with the convention of `dsp_fr1_samples_to_dbfs_32b()`,
+use `DSP_FR1_DBFS_TO_SPL()` for dB SPL. Processing happens in the audio
+task only, settings from other tasks are picked up on the next frame.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _DSP_FR1_SLM_H_
+#define _DSP_FR1_SLM_H_
+
+#include <stdint.h>
+#include "audio.h"
+
+#define DSP_FR1_SLM_MAX_SECTIONS    3
+#define DSP_FR1_SLM_TAU_FAST_S      0.125f
+#define DSP_FR1_SLM_TAU_SLOW_S      1.0f
+#define DSP_FR1_SLM_TAU_IMP_RISE_S  0.035f
+#define DSP_FR1_SLM_TAU_IMP_FALL_S  1.5f
+#define DSP_FR1_SLM_Z_HP_HZ         10.0f   // Z is flat, but the MEMS DC has to go
+#define DSP_FR1_SLM_FLOOR_DB        (-140.0f)
+#define DSP_FR1_SLM_BUDGET_CYC      150     // per sample, frames above are counted
+
+/// @brief Frequency weighting.
+typedef enum{
+    e_dsp_fr1_slm_a,
+    e_dsp_fr1_slm_c,
+    e_dsp_fr1_slm_z
+}dsp_fr1_slm_weight_t;
+
+/// @brief Time weighting shown as the main level.
+typedef enum{
+    e_dsp_fr1_slm_fast,
+    e_dsp_fr1_slm_slow,
+    e_dsp_fr1_slm_imp
+}dsp_fr1_slm_time_t;
+
+/// @brief Sound level meter readings in dBFS.
+typedef struct dsp_fr1_slm_values_t{
+    float l;                    // level of the selected time weighting
+    float l_fast;
+    float l_slow;
+    float l_imp;
+    float leq;                  // since the last reset
+    float lmax;                 // highest `l` since the last reset
+    float lpeak;                // highest weighted sample since the last reset
+    uint32_t cyc_per_sample;    // cost of the last frame
+    uint32_t over_budget;       // frames above `DSP_FR1_SLM_BUDGET_CYC`
+    dsp_fr1_slm_weight_t weight;
+    dsp_fr1_slm_time_t time;
+}dsp_fr1_slm_values_t;
+
+/// @brief Select the weightings and reset the integrators.
+/// @param weight Frequency weighting.
+/// @param time Time weighting of the main level.
+void dsp_fr1_slm_config(dsp_fr1_slm_weight_t weight, dsp_fr1_slm_time_t time);
+
+/// @brief Reset Leq, Lmax and Lpeak.
+void dsp_fr1_slm_reset(void);
+
+/// @brief Run a frame through the meter.
+/// @param data I2S frame, only `l` is measured.
+/// @param len Length of frame in stereo samples.
+/// @param sr Active sample rate. The filters are redesigned when it changes.
+/// @return Readings after this frame (by value).
+/// @note Only call this from the audio task.
+dsp_fr1_slm_values_t dsp_fr1_slm_process(const stereo_sample_t* data, uint32_t len, uint32_t sr);
+
+/// @brief Get a printable name of a weighting.
+/// @param weight Frequency weighting.
+/// @return "A", "C" or "Z".
+const char* dsp_fr1_slm_weight_name(dsp_fr1_slm_weight_t weight);
+
+#endif // _DSP_FR1_SLM_H_
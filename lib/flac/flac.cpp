@@ -0,0 +1,609 @@
+#include "flac.h"
+#include "sdcard.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define FLAC_SUBFRAME_CONSTANT  0x00
+#define FLAC_SUBFRAME_VERBATIM  0x01
+#define FLAC_SUBFRAME_FIXED     0x08
+#define FLAC_SUBFRAME_LPC       0x20
+#define FLAC_FIXED_ORDER_MAX    4
+#define FLAC_RICE_PARAM_MAX     30      // method 1, 5 bit parameters
+#define FLAC_RICE4_PARAM_MAX    14      // method 0, 4 bit parameters
+#define FLAC_RESIDUAL_MAX       ((1L << 30) - 1)
+
+/// @brief MSB first bit writer on top of the frame buffer.
+typedef struct flac_bw_t{
+    uint8_t* buf;
+    uint32_t cap;
+    uint32_t pos;               // whole bytes written
+    uint64_t acc;
+    uint8_t n;                  // bits pending in `acc`
+    uint8_t ovf;
+}flac_bw_t;
+
+static uint8_t crc8_tab[256];
+static uint16_t crc16_tab[256];
+static uint8_t crc_ready = 0;
+
+static void flac_crc_init(void){
+    if(crc_ready) return;
+    for(uint16_t i = 0; i < 256; i++){
+        uint8_t c8 = (uint8_t)i;
+        uint16_t c16 = (uint16_t)(i << 8);
+        for(uint8_t b = 0; b < 8; b++){
+            c8 = (c8 & 0x80) ? (uint8_t)((c8 << 1) ^ 0x07) : (uint8_t)(c8 << 1);
+            c16 = (c16 & 0x8000) ? (uint16_t)((c16 << 1) ^ 0x8005) : (uint16_t)(c16 << 1);
+        }
+        crc8_tab[i] = c8;
+        crc16_tab[i] = c16;
+    }
+    crc_ready = 1;
+}
+
+static uint8_t flac_crc8(const uint8_t* d, uint32_t len){
+    uint8_t c = 0;
+    while(len--) c = crc8_tab[c ^ *d++];
+    return c;
+}
+
+static uint16_t flac_crc16(const uint8_t* d, uint32_t len){
+    uint16_t c = 0;
+    while(len--) c = (uint16_t)((c << 8) ^ crc16_tab[(c >> 8) ^ *d++]);
+    return c;
+}
+
+static inline void flac_bw_put(flac_bw_t* bw, uint32_t val, uint8_t bits){
+    if(bits == 0) return;
+    bw->acc = (bw->acc << bits) | (val & (0xFFFFFFFFUL >> (32 - bits)));
+    bw->n += bits;
+    while(bw->n >= 8){
+        bw->n -= 8;
+        if(bw->pos < bw->cap) bw->buf[bw->pos++] = (uint8_t)(bw->acc >> bw->n);
+        else bw->ovf = 1;
+    }
+}
+
+static inline void flac_bw_zeros(flac_bw_t* bw, uint32_t bits){
+    while(bits > 24){
+        flac_bw_put(bw, 0, 24);
+        bits -= 24;
+    }
+    flac_bw_put(bw, 0, (uint8_t)bits);
+}
+
+static inline uint32_t flac_bw_tell(const flac_bw_t* bw){
+    return bw->pos * 8 + bw->n;
+}
+
+/// @brief Rewind to an earlier `flac_bw_tell()` position.
+static void flac_bw_seek(flac_bw_t* bw, uint32_t bit_pos){
+    bw->pos = bit_pos / 8;
+    bw->n = bit_pos % 8;
+    bw->acc = bw->n ? (bw->buf[bw->pos] >> (8 - bw->n)) : 0;
+    bw->ovf = 0;
+}
+
+static void flac_bw_align(flac_bw_t* bw){
+    if(bw->n) flac_bw_put(bw, 0, 8 - bw->n);
+}
+
+static inline uint32_t flac_zigzag(int32_t r){
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+/// @brief Choose partition order and Rice parameters for a residual.
+/// @param res Residual of `n - order` samples.
+/// @param n Block size.
+/// @param order Predictor order, the first partition is shorter by it.
+/// @param porder Chosen partition order.
+/// @param params Chosen parameter per partition.
+/// @return Estimated size of the coded residual in bits.
+static uint32_t flac_rice_plan(const int32_t* res, uint32_t n, uint8_t order, uint8_t* porder, uint8_t* params){
+    uint64_t sums[1 << FLAC_RICE_PORDER_MAX];
+    uint8_t pmax = 0;
+    while(pmax < FLAC_RICE_PORDER_MAX && (n % (2u << pmax)) == 0 && (n >> (pmax + 1)) > order) pmax++;
+    // sums at the finest order, coarser orders merge neighbours
+    uint32_t parts = 1u << pmax;
+    uint32_t psize = n >> pmax;
+    const int32_t* r = res;
+    for(uint32_t p = 0; p < parts; p++){
+        uint32_t cnt = p == 0 ? psize - order : psize;
+        uint64_t s = 0;
+        for(uint32_t i = 0; i < cnt; i++) s += flac_zigzag(r[i]);
+        sums[p] = s;
+        r += cnt;
+    }
+    uint32_t best = 0xFFFFFFFF;
+    uint8_t tmp[1 << FLAC_RICE_PORDER_MAX];
+    for(int8_t po = pmax; po >= 0; po--){
+        parts = 1u << po;
+        psize = n >> po;
+        uint64_t bits = 4;
+        uint8_t wide = 0;
+        for(uint32_t p = 0; p < parts; p++){
+            uint32_t cnt = p == 0 ? psize - order : psize;
+            uint64_t s = sums[p];
+            uint8_t k = 0;
+            while(k < FLAC_RICE_PARAM_MAX && ((uint64_t)cnt << (k + 1)) <= s) k++;
+            tmp[p] = k;
+            if(k > FLAC_RICE4_PARAM_MAX) wide = 1;
+            bits += (uint64_t)cnt * (k + 1) + (s >> k);
+        }
+        bits += parts * (wide ? 5 : 4);
+        if(bits < best){
+            best = (uint32_t)bits;
+            *porder = (uint8_t)po;
+            memcpy(params, tmp, parts);
+        }
+        if(po > 0){
+            for(uint32_t p = 0; p < parts / 2; p++) sums[p] = sums[2 * p] + sums[2 * p + 1];
+        }
+    }
+    return best;
+}
+
+/// @brief Write the residual section of a FIXED or LPC subframe.
+static void flac_rice_write(flac_bw_t* bw, const int32_t* res, uint32_t n, uint8_t order, uint8_t porder, const uint8_t* params){
+    uint32_t parts = 1u << porder;
+    uint8_t wide = 0;
+    for(uint32_t p = 0; p < parts; p++) if(params[p] > FLAC_RICE4_PARAM_MAX) wide = 1;
+    flac_bw_put(bw, wide, 2);
+    flac_bw_put(bw, porder, 4);
+    uint32_t psize = n >> porder;
+    for(uint32_t p = 0; p < parts && !bw->ovf; p++){
+        uint8_t k = params[p];
+        flac_bw_put(bw, k, wide ? 5 : 4);
+        uint32_t cnt = p == 0 ? psize - order : psize;
+        for(uint32_t i = 0; i < cnt; i++){
+            uint32_t u = flac_zigzag(*res++);
+            flac_bw_zeros(bw, u >> k);
+            flac_bw_put(bw, 1, 1);
+            if(k) flac_bw_put(bw, u, k);
+        }
+    }
+}
+
+/// @brief Pick the FIXED order with the smallest absolute residual sum.
+static uint8_t flac_fixed_order(const int32_t* x, uint32_t n){
+    uint64_t sum[FLAC_FIXED_ORDER_MAX + 1] = {0};
+    int32_t p0 = x[3], p1 = x[3] - x[2];
+    int32_t p2 = p1 - (x[2] - x[1]);
+    int32_t p3 = p2 - (x[2] - 2 * x[1] + x[0]);
+    for(uint32_t i = FLAC_FIXED_ORDER_MAX; i < n; i++){
+        int32_t e0 = x[i];
+        int32_t e1 = e0 - p0;
+        int32_t e2 = e1 - p1;
+        int32_t e3 = e2 - p2;
+        int32_t e4 = e3 - p3;
+        sum[0] += (uint32_t)abs(e0);
+        sum[1] += (uint32_t)abs(e1);
+        sum[2] += (uint32_t)abs(e2);
+        sum[3] += (uint32_t)abs(e3);
+        sum[4] += (uint32_t)abs(e4);
+        p0 = e0; p1 = e1; p2 = e2; p3 = e3;
+    }
+    uint8_t o = 0;
+    for(uint8_t i = 1; i <= FLAC_FIXED_ORDER_MAX; i++) if(sum[i] < sum[o]) o = i;
+    return o;
+}
+
+static void flac_fixed_residual(const int32_t* x, uint32_t n, uint8_t order, int32_t* res){
+    for(uint32_t i = order; i < n; i++){
+        int32_t r;
+        switch(order){
+            case 0: r = x[i]; break;
+            case 1: r = x[i] - x[i - 1]; break;
+            case 2: r = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+            case 3: r = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+            default: r = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+        }
+        res[i - order] = r;
+    }
+}
+
+/// @brief Welch windowed autocorrelation and Levinson-Durbin recursion.
+/// @param w Scratch for the windowed block, `n` floats.
+/// @param qlp Quantized coefficients, `qlp[j]` weighs `x[i - 1 - j]`.
+/// @param shift Quantization shift.
+/// @return Predictor order, 0 if no usable predictor was found.
+static uint8_t flac_lpc_design(const int32_t* x, uint32_t n, uint8_t order, float* w, int32_t* qlp, int8_t* shift){
+    float ac[FLAC_LPC_ORDER_MAX + 1] = {0};
+    float half = (float)(n - 1) / 2.0f;
+    for(uint32_t i = 0; i < n; i++){
+        float t = ((float)i - half) / half;
+        w[i] = (float)x[i] * (1.0f - t * t);
+    }
+    for(uint8_t l = 0; l <= order; l++){
+        float s = 0;
+        for(uint32_t i = l; i < n; i++) s += w[i] * w[i - l];
+        ac[l] = s;
+    }
+    if(ac[0] <= 0) return 0;
+    ac[0] *= 1.0f + 1e-5f;          // light lag window against ill conditioning
+    float a[FLAC_LPC_ORDER_MAX] = {0};
+    float tmp[FLAC_LPC_ORDER_MAX];
+    float err = ac[0];
+    for(uint8_t m = 0; m < order; m++){
+        float r = -ac[m + 1];
+        for(uint8_t j = 0; j < m; j++) r -= a[j] * ac[m - j];
+        r /= err;
+        memcpy(tmp, a, sizeof(float) * m);
+        a[m] = r;
+        for(uint8_t j = 0; j < m; j++) a[j] = tmp[j] + r * tmp[m - 1 - j];
+        err *= 1.0f - r * r;
+        if(err <= 0) return 0;
+    }
+    // predictor x[i] = sum(-a[j] * x[i - 1 - j])
+    float cmax = 0;
+    for(uint8_t j = 0; j < order; j++) if(fabsf(a[j]) > cmax) cmax = fabsf(a[j]);
+    if(cmax <= 0) return 0;
+    int log2cmax;
+    frexpf(cmax, &log2cmax);
+    int s = FLAC_LPC_PRECISION - 1 - log2cmax;
+    if(s > 15) s = 15;
+    if(s < 0) return 0;
+    int32_t qmax = (1 << (FLAC_LPC_PRECISION - 1)) - 1;
+    float e = 0;
+    for(uint8_t j = 0; j < order; j++){
+        e += -a[j] * (float)(1 << s);
+        int32_t q = (int32_t)lrintf(e);
+        if(q > qmax) q = qmax;
+        if(q < -qmax - 1) q = -qmax - 1;
+        qlp[j] = q;
+        e -= (float)q;
+    }
+    *shift = (int8_t)s;
+    return order;
+}
+
+/// @brief Compute the LPC residual.
+/// @return 0 if a residual is out of the codable range.
+static uint8_t flac_lpc_residual(const int32_t* x, uint32_t n, uint8_t order, const int32_t* qlp, int8_t shift, uint16_t bps, int32_t* res){
+    if(bps <= 16){
+        // 16 bit samples times 12 bit coefficients fit an int32 accumulator
+        for(uint32_t i = order; i < n; i++){
+            int32_t acc = 0;
+            for(uint8_t j = 0; j < order; j++) acc += qlp[j] * x[i - 1 - j];
+            res[i - order] = x[i] - (acc >> shift);
+        }
+        return 1;
+    }
+    for(uint32_t i = order; i < n; i++){
+        int64_t acc = 0;
+        for(uint8_t j = 0; j < order; j++) acc += (int64_t)qlp[j] * x[i - 1 - j];
+        int64_t r = (int64_t)x[i] - (acc >> shift);
+        if(r > FLAC_RESIDUAL_MAX || r < -FLAC_RESIDUAL_MAX) return 0;
+        res[i - order] = (int32_t)r;
+    }
+    return 1;
+}
+
+/// @brief Encode one channel of the collected block as the smallest subframe.
+static void flac_subframe(flac_file_t* flac, flac_bw_t* bw, const int32_t* x, uint32_t n){
+    uint16_t bps = flac->bps;
+    uint32_t start = flac_bw_tell(bw);
+    uint32_t verbatim_bits = 8 + n * bps;
+
+    uint8_t constant = 1;
+    for(uint32_t i = 1; i < n && constant; i++) constant = x[i] == x[0];
+    if(constant){
+        flac_bw_put(bw, FLAC_SUBFRAME_CONSTANT << 1, 8);
+        flac_bw_put(bw, (uint32_t)x[0], bps);
+        return;
+    }
+
+    uint8_t type = FLAC_SUBFRAME_VERBATIM;
+    uint8_t order = 0;
+    uint32_t best = verbatim_bits;
+    uint8_t porder = 0;
+    uint8_t params[1 << FLAC_RICE_PORDER_MAX];
+    int32_t qlp[FLAC_LPC_ORDER_MAX];
+    int8_t shift = 0;
+    int32_t* cand = flac->res[0];
+    int32_t* keep = flac->res[1];
+
+    if(n > FLAC_FIXED_ORDER_MAX){
+        uint8_t o = flac_fixed_order(x, n);
+        flac_fixed_residual(x, n, o, cand);
+        uint8_t po, pr[1 << FLAC_RICE_PORDER_MAX];
+        uint32_t bits = 8 + o * bps + 2 + flac_rice_plan(cand, n, o, &po, pr);
+        if(bits < best){
+            best = bits;
+            type = FLAC_SUBFRAME_FIXED;
+            order = o;
+            porder = po;
+            memcpy(params, pr, sizeof(pr));
+            int32_t* t = keep; keep = cand; cand = t;
+        }
+    }
+    if(n > FLAC_LPC_ORDER_MAX * 4){
+        int32_t q[FLAC_LPC_ORDER_MAX];
+        int8_t s;
+        // the candidate buffer holds the windowed block until the residual replaces it
+        uint8_t o = flac_lpc_design(x, n, FLAC_LPC_ORDER_MAX, (float*)cand, q, &s);
+        if(o > 0 && flac_lpc_residual(x, n, o, q, s, bps, cand)){
+            uint8_t po, pr[1 << FLAC_RICE_PORDER_MAX];
+            uint32_t bits = 8 + o * (bps + FLAC_LPC_PRECISION) + 9 + 2 + flac_rice_plan(cand, n, o, &po, pr);
+            if(bits < best){
+                best = bits;
+                type = FLAC_SUBFRAME_LPC;
+                order = o;
+                porder = po;
+                shift = s;
+                memcpy(qlp, q, sizeof(q));
+                memcpy(params, pr, sizeof(pr));
+                int32_t* t = keep; keep = cand; cand = t;
+            }
+        }
+    }
+
+    if(type != FLAC_SUBFRAME_VERBATIM){
+        flac_bw_put(bw, (uint32_t)(type | (type == FLAC_SUBFRAME_LPC ? order - 1 : order)) << 1, 8);
+        for(uint8_t i = 0; i < order; i++) flac_bw_put(bw, (uint32_t)x[i], bps);
+        if(type == FLAC_SUBFRAME_LPC){
+            flac_bw_put(bw, FLAC_LPC_PRECISION - 1, 4);
+            flac_bw_put(bw, (uint32_t)shift, 5);
+            for(uint8_t j = 0; j < order; j++) flac_bw_put(bw, (uint32_t)qlp[j], FLAC_LPC_PRECISION);
+        }
+        flac_rice_write(bw, keep, n, order, porder, params);
+        // the plan is an estimate, never end up above the verbatim size
+        if(!bw->ovf && flac_bw_tell(bw) - start <= verbatim_bits) return;
+        flac_bw_seek(bw, start);
+    }
+    flac_bw_put(bw, FLAC_SUBFRAME_VERBATIM << 1, 8);
+    for(uint32_t i = 0; i < n; i++) flac_bw_put(bw, (uint32_t)x[i], bps);
+}
+
+/// @brief Encode the collected samples as one frame and write it.
+static e_syserr_t flac_encode_frame(flac_file_t* flac){
+    uint32_t n = flac->fill;
+    if(n == 0) return e_syserr_none;
+
+    // MD5 over the interleaved little endian samples, the frame buffer is free yet
+    uint8_t bytes = flac->bps / 8;
+    uint8_t* m = flac->out;
+    for(uint32_t i = 0; i < n; i++){
+        for(uint8_t c = 0; c < flac->n_ch; c++){
+            int32_t s = flac->pcm[c][i];
+            for(uint8_t b = 0; b < bytes; b++) *m++ = (uint8_t)(s >> (8 * b));
+        }
+    }
+    esp_rom_md5_update(&flac->md5, flac->out, n * flac->n_ch * bytes);
+
+    flac_bw_t bw = {flac->out, flac->out_size, 0, 0, 0, 0};
+    uint8_t bs_code;
+    switch(n){
+        case 256:  bs_code = 0x8; break;
+        case 512:  bs_code = 0x9; break;
+        case 1024: bs_code = 0xA; break;
+        case 2048: bs_code = 0xB; break;
+        case 4096: bs_code = 0xC; break;
+        default:   bs_code = n <= 256 ? 0x6 : 0x7; break;
+    }
+    flac_bw_put(&bw, 0xFFF8, 16);                       // sync, fixed block size
+    flac_bw_put(&bw, bs_code, 4);
+    flac_bw_put(&bw, 0x0, 4);                           // sample rate from STREAMINFO
+    flac_bw_put(&bw, flac->n_ch - 1, 4);                // independent channels
+    flac_bw_put(&bw, flac->bps == 16 ? 0x4 : 0x6, 3);
+    flac_bw_put(&bw, 0, 1);
+    // frame number, UTF-8 style
+    uint32_t f = flac->frame_idx;
+    if(f < 0x80){
+        flac_bw_put(&bw, f, 8);
+    }else{
+        uint8_t cont = f < 0x800 ? 1 : f < 0x10000 ? 2 : f < 0x200000 ? 3 : f < 0x4000000 ? 4 : 5;
+        uint8_t lead = (uint8_t)(0xFF00 >> (cont + 1));
+        flac_bw_put(&bw, lead | (f >> (6 * cont)), 8);
+        for(int8_t i = cont - 1; i >= 0; i--) flac_bw_put(&bw, 0x80 | ((f >> (6 * i)) & 0x3F), 8);
+    }
+    if(bs_code == 0x6) flac_bw_put(&bw, n - 1, 8);
+    if(bs_code == 0x7) flac_bw_put(&bw, n - 1, 16);
+    flac_bw_put(&bw, flac_crc8(bw.buf, bw.pos), 8);
+
+    for(uint8_t c = 0; c < flac->n_ch; c++) flac_subframe(flac, &bw, flac->pcm[c], n);
+    flac_bw_align(&bw);
+    uint16_t crc = flac_crc16(bw.buf, bw.pos);
+    flac_bw_put(&bw, crc, 16);
+    if(bw.ovf) return e_syserr_oom;
+
+    if(flac->reserved){
+        sd_wstream_reserve(flac->file, &flac->reserved, FLAC_HEADER_SIZE + flac->bytes_written + bw.pos);
+    }
+    e_syserr_t e = sd_wstream_write(flac->file, bw.buf, bw.pos);
+    if(e != e_syserr_none) return e;
+
+    if(bw.pos < flac->frame_bytes_min || flac->frame_bytes_min == 0) flac->frame_bytes_min = bw.pos;
+    if(bw.pos > flac->frame_bytes_max) flac->frame_bytes_max = bw.pos;
+    flac->bytes_written += bw.pos;
+    flac->samples_transfered += n;
+    flac->frame_idx++;
+    flac->fill = 0;
+    return e_syserr_none;
+}
+
+/// @brief Serialize the stream header with the current STREAMINFO.
+static void flac_header(const flac_file_t* flac, const uint8_t* md5, uint8_t* hdr){
+    memset(hdr, 0, FLAC_HEADER_SIZE);
+    flac_bw_t bw = {hdr, FLAC_HEADER_SIZE, 0, 0, 0, 0};
+    flac_bw_put(&bw, 0x664C6143, 32);                   // "fLaC"
+    flac_bw_put(&bw, 0x00, 8);                          // STREAMINFO
+    flac_bw_put(&bw, FLAC_STREAMINFO_SIZE, 24);
+    flac_bw_put(&bw, FLAC_BLOCK_SIZE, 16);
+    flac_bw_put(&bw, FLAC_BLOCK_SIZE, 16);
+    flac_bw_put(&bw, flac->frame_bytes_min, 24);
+    flac_bw_put(&bw, flac->frame_bytes_max, 24);
+    flac_bw_put(&bw, flac->sr, 20);
+    flac_bw_put(&bw, flac->n_ch - 1, 3);
+    flac_bw_put(&bw, flac->bps - 1, 5);
+    flac_bw_put(&bw, (uint32_t)(flac->samples_transfered >> 32), 4);
+    flac_bw_put(&bw, (uint32_t)flac->samples_transfered, 32);
+    if(md5 != NULL) memcpy(&hdr[bw.pos], md5, 16);
+    bw.pos = FLAC_APP_POS;
+    flac_bw_put(&bw, 0x82, 8);                          // last metadata block, APPLICATION
+    flac_bw_put(&bw, FLAC_APP_SIZE, 24);
+    flac_bw_put(&bw, FLAC_APP_ID, 32);
+    flac_bw_put(&bw, (uint32_t)(flac->bytes_written >> 32), 32);
+    flac_bw_put(&bw, (uint32_t)flac->bytes_written, 32);
+}
+
+/// @brief Allocate from internal RAM if possible, PSRAM otherwise.
+static void* flac_alloc(uint32_t size){
+    void* m = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT);
+    if(m == NULL) m = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_32BIT);
+    return m;
+}
+
+static void flac_free(flac_file_t* flac){
+    for(uint8_t i = 0; i < 2; i++){
+        heap_caps_free(flac->pcm[i]);
+        heap_caps_free(flac->res[i]);
+        flac->pcm[i] = NULL;
+        flac->res[i] = NULL;
+    }
+    heap_caps_free(flac->out);
+    flac->out = NULL;
+}
+
+e_syserr_t flac_open_for_write(flac_file_t* flac, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample){
+    if(flac == NULL || filename == NULL) return e_syserr_param;
+    if(numChannels < 1 || numChannels > 2 || !FLAC_BPS_VALID(bitsPerSample)) return e_syserr_param;
+    if(sampleRate == 0 || sampleRate >= (1UL << 20)) return e_syserr_param;
+    uint64_t reserve = flac->reserve;
+    memset(flac, 0, sizeof(flac_file_t));
+    flac->reserve = reserve;
+    flac_crc_init();
+    strncpy(flac->filename, filename, sizeof(flac->filename) - 1);
+    flac->sr = sampleRate;
+    flac->n_ch = numChannels;
+    flac->bps = bitsPerSample;
+    flac->out_size = FLAC_BLOCK_SIZE * numChannels * sizeof(int32_t) + FLAC_FRAME_SLACK;
+    flac->out = (uint8_t*)flac_alloc(flac->out_size);
+    for(uint8_t i = 0; i < 2; i++){
+        flac->pcm[i] = (int32_t*)flac_alloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+        flac->res[i] = (int32_t*)flac_alloc(FLAC_BLOCK_SIZE * sizeof(int32_t));
+    }
+    if(flac->out == NULL || flac->pcm[0] == NULL || flac->pcm[1] == NULL ||
+       flac->res[0] == NULL || flac->res[1] == NULL){
+        flac_free(flac);
+        return e_syserr_oom;
+    }
+    esp_rom_md5_init(&flac->md5);
+
+    e_syserr_t e = sd_create_file(filename);
+    if(e != e_syserr_none){
+        flac_free(flac);
+        return e;
+    }
+    flac->reserved = FLAC_HEADER_SIZE + flac->reserve;
+    if(flac->reserve == 0 || sd_prealloc(filename, &flac->reserved) != e_syserr_none) flac->reserved = 0;
+    uint8_t hdr[FLAC_HEADER_SIZE];
+    flac_header(flac, NULL, hdr);
+    uint32_t points_written;
+    e = sd_write(hdr, sizeof(uint8_t), FLAC_HEADER_SIZE, filename, "r+b", 0, &points_written);
+    if(e != e_syserr_none || points_written != FLAC_HEADER_SIZE){
+        flac_free(flac);
+        return e_syserr_file_generic;
+    }
+    flac->file = sd_wstream_open(filename, FLAC_HEADER_SIZE, SDCARD_WSTREAM_BACKEND_DEFAULT);
+    if(flac->file == NULL){
+        flac_free(flac);
+        return e_syserr_file_generic;
+    }
+    return e_syserr_none;
+}
+
+e_syserr_t flac_write_samples(flac_file_t* flac, const stereo_sample_t* data, uint32_t len){
+    if(flac == NULL || data == NULL || flac->file == NULL) return e_syserr_param;
+    uint8_t sh = 32 - flac->bps;
+    while(len > 0){
+        uint32_t n = FLAC_BLOCK_SIZE - flac->fill;
+        if(len < n) n = len;
+        int32_t* l = &flac->pcm[0][flac->fill];
+        int32_t* r = &flac->pcm[1][flac->fill];
+        if(flac->n_ch == 2){
+            for(uint32_t i = 0; i < n; i++){
+                l[i] = data[i].l >> sh;
+                r[i] = data[i].r >> sh;
+            }
+        }else{
+            for(uint32_t i = 0; i < n; i++) l[i] = data[i].l >> sh;
+        }
+        flac->fill += n;
+        data += n;
+        len -= n;
+        if(flac->fill == FLAC_BLOCK_SIZE){
+            e_syserr_t e = flac_encode_frame(flac);
+            if(e != e_syserr_none) return e;
+        }
+    }
+    return e_syserr_none;
+}
+
+/// @brief Overwrite the stream header at the start of the file.
+static e_syserr_t flac_rewrite_header(flac_file_t* flac, const uint8_t* md5){
+    uint8_t hdr[FLAC_HEADER_SIZE];
+    flac_header(flac, md5, hdr);
+    uint32_t points_written;
+    e_syserr_t e = sd_write(hdr, sizeof(uint8_t), FLAC_HEADER_SIZE, flac->filename, "r+b", 0, &points_written);
+    if(e == e_syserr_none && points_written != FLAC_HEADER_SIZE) e = e_syserr_file_generic;
+    return e;
+}
+
+e_syserr_t flac_checkpoint(flac_file_t* flac){
+    if(flac == NULL) return e_syserr_param;
+    if(flac->file == NULL) return e_syserr_null;
+    // frames first, the header must never count bytes that are not on the card
+    e_syserr_t e = sd_wstream_sync(flac->file);
+    if(e != e_syserr_none) return e;
+    uint8_t hdr[FLAC_HEADER_SIZE];
+    flac_header(flac, NULL, hdr);
+    e = sd_wstream_write_at(flac->file, hdr, FLAC_HEADER_SIZE, 0);
+    if(e != e_syserr_none) return e;
+    return sd_wstream_sync(flac->file);
+}
+
+e_syserr_t flac_close_for_write(flac_file_t* flac){
+    if(flac == NULL) return e_syserr_param;
+    if(flac->file == NULL) return e_syserr_null;
+    e_syserr_t e = flac_encode_frame(flac);
+    e_syserr_t ec = sd_wstream_close(flac->file);
+    if(e == e_syserr_none) e = ec;
+    flac->file = NULL;
+    if(flac->reserved){
+        e_syserr_t et = sd_truncate(flac->filename, FLAC_HEADER_SIZE + flac->bytes_written);
+        if(e == e_syserr_none) e = et;
+        flac->reserved = 0;
+    }
+    uint8_t md5[16];
+    esp_rom_md5_final(md5, &flac->md5);
+    flac_free(flac);
+    e_syserr_t eh = flac_rewrite_header(flac, md5);
+    return e != e_syserr_none ? e : eh;
+}
+
+e_syserr_t flac_recover(const char* filename, uint8_t* fixed, uint64_t* data_bytes){
+    if(filename == NULL || fixed == NULL || data_bytes == NULL) return e_syserr_null;
+    *fixed = 0;
+    *data_bytes = 0;
+    uint8_t hdr[FLAC_HEADER_SIZE];
+    uint32_t points_read;
+    e_syserr_t e = sd_read(hdr, sizeof(uint8_t), FLAC_HEADER_SIZE, filename, "rb", 0, &points_read);
+    if(e != e_syserr_none) return e;
+    const uint8_t* app = &hdr[FLAC_APP_POS];
+    if(memcmp(hdr, "fLaC", 4) != 0 || (app[0] & 0x7F) != 2 ||
+       app[3] != FLAC_APP_SIZE || memcmp(&app[4], "FR1c", 4) != 0) return e_syserr_param;
+    uint64_t bytes = 0;
+    for(uint8_t i = 0; i < 8; i++) bytes = (bytes << 8) | app[8 + i];
+    *data_bytes = bytes;
+    uint64_t size;
+    e = sd_file_size(filename, &size);
+    if(e != e_syserr_none) return e;
+    if(size <= FLAC_HEADER_SIZE + bytes) return e_syserr_none;
+    // STREAMINFO already matches the checkpoint, only the tail has to go
+    e = sd_truncate(filename, FLAC_HEADER_SIZE + bytes);
+    if(e == e_syserr_none) *fixed = 1;
+    return e;
+}
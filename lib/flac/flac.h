@@ -0,0 +1,102 @@
+/// @file flac.h
+/// @brief
+/*
+Streaming FLAC encoder. Samples are collected into fixed blocks of
+`FLAC_BLOCK_SIZE`, every block becomes one frame written straight to the
+open file stream. Each channel is coded independently as CONSTANT, FIXED
+(order 0-4), LPC (order up to `FLAC_LPC_ORDER_MAX`) or VERBATIM, whichever
+is smallest, residuals are partitioned Rice codes. STREAMINFO (with the
+MD5 of the audio) is written as placeholder on open and finalized on close.
+An APPLICATION block behind it records how many frame bytes each checkpoint
+committed, `flac_recover()` cuts a file left open by a power loss there.
+
+16 and 24 bit only. Instances only share the CRC tables, scratch buffers
+are allocated on open and released on close.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _FLAC_H_
+#define _FLAC_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "syserr.h"
+#include "audio.h"
+#include "esp_rom_md5.h"
+#include "sdcard.h"
+
+#define FLAC_BLOCK_SIZE         AUDIO_FRAME_LEN
+#define FLAC_LPC_ORDER_MAX      8
+#define FLAC_LPC_PRECISION      12      // bits per quantized coefficient
+#define FLAC_RICE_PORDER_MAX    6
+#define FLAC_STREAMINFO_POS     8       // "fLaC" + metadata block header
+#define FLAC_STREAMINFO_SIZE    34
+#define FLAC_APP_ID             0x46523163  // "FR1c", APPLICATION block holding the committed frame bytes
+#define FLAC_APP_SIZE           12          // id + 64 bit byte count
+#define FLAC_APP_POS            (FLAC_STREAMINFO_POS + FLAC_STREAMINFO_SIZE)
+#define FLAC_HEADER_SIZE        (FLAC_APP_POS + 4 + FLAC_APP_SIZE)
+#define FLAC_FRAME_SLACK        64      // frame header, subframe headers, CRC on top of verbatim samples
+#define FLAC_BPS_VALID(bps)     ((bps) == 16 || (bps) == 24)
+#define FLAC_FN_LEN             256
+
+/// @brief FLAC encoder and file context.
+typedef struct flac_file_t{
+    char filename[FLAC_FN_LEN];
+    sd_wstream_t* file;
+    uint32_t sr;
+    uint16_t n_ch;
+    uint16_t bps;
+    uint64_t samples_transfered;    // per channel, written to STREAMINFO
+    uint32_t frame_idx;
+    uint32_t frame_bytes_min;
+    uint32_t frame_bytes_max;
+    uint64_t bytes_written;         // frames only, without header
+    uint32_t fill;                  // samples collected for the next block
+    int32_t* pcm[2];                // FLAC_BLOCK_SIZE per channel
+    int32_t* res[2];                // residual candidate and best residual
+    uint8_t* out;                   // frame buffer
+    uint32_t out_size;
+    md5_context_t md5;
+    uint64_t reserve;               // frame bytes to reserve on open (see `sd_prealloc()`), 0 for none
+    uint64_t reserved;              // reserved end of the file, truncated to the frames on close
+}flac_file_t;
+
+/// @brief Open a new FLAC file and write the stream header.
+/// @param flac Empty FLAC context.
+/// @param filename Name of the file in FS.
+/// @param numChannels 1 or 2.
+/// @param sampleRate Sample rate of the stream.
+/// @param bitsPerSample 16 or 24.
+/// @return FR1 error code.
+/// @note Only `flac->reserve` is kept from the context, it preallocates like `wav_open_for_write()`.
+e_syserr_t flac_open_for_write(flac_file_t* flac, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample);
+
+/// @brief Add I2S frames to the stream. Full blocks are encoded and written.
+/// @param flac Open FLAC context.
+/// @param data I2S frames, MSB-aligned. Mono takes `l`.
+/// @param len Amount of frames.
+/// @return FR1 error code.
+e_syserr_t flac_write_samples(flac_file_t* flac, const stereo_sample_t* data, uint32_t len);
+
+/// @brief Commit the written frames and rewrite STREAMINFO with the current counts.
+/// @param flac Open FLAC context.
+/// @return FR1 error code.
+/// @note The MD5 field is left zero ("unknown") until `flac_close_for_write()`,
+/// the pending partial block is not part of the checkpoint.
+e_syserr_t flac_checkpoint(flac_file_t* flac);
+
+/// @brief Encode the last (short) block, finalize STREAMINFO and close the file.
+/// @param flac Open FLAC context.
+/// @return FR1 error code.
+/// @note Unused reserved space is released.
+e_syserr_t flac_close_for_write(flac_file_t* flac);
+
+/// @brief Finalize a FLAC file that was not closed, at its last checkpoint.
+/// @param filename Name of the file in FS.
+/// @param fixed Set to 1 if the file was cut, 0 if it was complete.
+/// @param data_bytes Set to the frame bytes the file holds afterwards.
+/// @return FR1 error code. `e_syserr_param` for files without the checkpoint block.
+/// @note Frames behind the checkpoint are dropped (reserved space or a partial frame).
+e_syserr_t flac_recover(const char* filename, uint8_t* fixed, uint64_t* data_bytes);
+
+#endif // _FLAC_H_
@@ -8,6 +8,12 @@
 #include "audio.h"
 #include "wav.h"
 #include "adc_base.h"
+#include "recorder.h"
+#include "spectrum.h"
+#include "config.h"
+#include "fsm_vox.h"
+#include "prof.h"
+#include "prof_trace.h"
 
 /// @brief Callback for fetching basic system data. 
 /// @param rta Pointer to runtime arguments. Passed onto routine.
@@ -44,6 +50,11 @@ static inline e_syserr_t fsm_enter_sett(fsm_runtime_args_t* rta);
 /// @return FR1 error code.
 static inline e_syserr_t fsm_enter_file(fsm_runtime_args_t* rta);
 
+/// @brief Enter routine for spectrum analyzer state.
+/// @param rta Pointer to runtime arguments. Passed onto routine.
+/// @return FR1 error code.
+static inline e_syserr_t fsm_enter_spec(fsm_runtime_args_t* rta);
+
 /// @brief Exit routine for idle state.
 /// @param rta Pointer to runtime arguments. Passed onto routine.
 /// @return FR1 error code.
@@ -69,6 +80,11 @@ static inline e_syserr_t fsm_exit_sett(fsm_runtime_args_t* rta);
 /// @return FR1 error code.
 static inline e_syserr_t fsm_exit_file(fsm_runtime_args_t* rta);
 
+/// @brief Exit routine for spectrum analyzer state.
+/// @param rta Pointer to runtime arguments. Passed onto routine.
+/// @return FR1 error code.
+static inline e_syserr_t fsm_exit_spec(fsm_runtime_args_t* rta);
+
 /// @brief Routine to loop over while in idle state.
 /// @param rta Pointer to runtime arguments. Passed onto routine.
 /// @note This function is intended to be called as
@@ -99,6 +115,12 @@ static inline void fsm_sett(fsm_runtime_args_t* rta);
 /// `state_func_t` function pointer in the **audio** loop.
 static inline void fsm_file(fsm_runtime_args_t* rta);
 
+/// @brief Routine to loop over while in spectrum analyzer state.
+/// @param rta Pointer to runtime arguments. Passed onto routine.
+/// @note This function is intended to be called as
+/// `state_func_t` function pointer in the **audio** loop.
+static inline void fsm_spec(fsm_runtime_args_t* rta);
+
 /// @brief Update the runtime args for the global buffer.
 /// @param rta Current runtime args.
 /// @note Can be obtained from outside with `fsm_get_runtime_args()`.
@@ -109,6 +131,13 @@ static inline void fsm_update_runtime_args(fsm_runtime_args_t* rta);
 /// @note Can be obtained from outside with `fsm_get_runtime_values()`.
 static inline void fsm_update_runtime_values(fsm_runtime_values_t* rtv);
 
+/// @brief Switch the capture rate and everything derived from it.
+/// @param rta Runtime args, `sr` is set to the rate audio runs at afterwards.
+/// @param sr New sample rate.
+/// @return FR1 error code.
+/// @note Idle keeps its own copy of the args and the pre-roll its own rate tag, both follow.
+static e_syserr_t fsm_set_sr(fsm_runtime_args_t* rta, uint32_t sr);
+
 static fsm_state_struct_t __idle = {
     .name = e_fsm_state_idle,
     .enter = fsm_enter_idle,
@@ -159,6 +188,16 @@ static fsm_state_struct_t __file = {
     .lock = NULL
 };
 
+static fsm_state_struct_t __spec = {
+    .name = e_fsm_state_spec,
+    .enter = fsm_enter_spec,
+    .routine = fsm_spec,
+    .exit = fsm_exit_spec,
+    .rt_args = {},
+    .rt_vals = {},
+    .lock = NULL
+};
+
 static fsm_state_struct_t __trans = {
     .name = e_fsm_state_trans,
     .enter = NULL,
@@ -171,7 +210,7 @@ static fsm_state_struct_t __trans = {
 
 static fsm_t fsm = {
     .cur_state = e_fsm_state_idle,
-    .states = {__idle, __record, __batt, __sett, __file, __trans},
+    .states = {__idle, __record, __batt, __sett, __file, __spec, __trans},
     .audio_job_handle = NULL,
     // .cur_open_wav = WAV_DEFAULT_HEADER_STRUCT;
 };
@@ -203,9 +242,11 @@ e_syserr_t fsm_init(void){
         .samples_to_process = 0,
         .samples_tot = 0,
         .wav_file = &fsm.cur_open_wav,
-        .sr = AUDIO_SR_DEFAULT,
-        .bps = 32,
-        .n_ch = 1,
+        .sr = audio_get_sr(),
+        .bps = cfg_get_rec().bps,
+        .n_ch = FSM_REC_N_CH_DEFAULT,
+        .decim = 1,
+        .fmt = e_wav_fmt_pcm,
         .sd_mounted = 0,
         .var_args = NULL,
     };
@@ -216,11 +257,15 @@ e_syserr_t fsm_init(void){
         .msqr_avg = {.l = 0., .r = 0.},
         .dbfs = {.l = 0., .r = 0.},
         .dbfs_avg = {.l = 0., .r = 0.},
+        .peak = {.l = 0., .r = 0.},
+        .clips = 0,
+        .slm = {},
         .t_transaction = 0,
         .t_system = 0,
         .lipo_mv = 0,
         .plug_mv = 0,
     };
+    fsm_vox_config(cfg_get_vox());
     lock_interface = xSemaphoreCreateMutex();
     e_syserr_t e = fsm_enter_idle(&rta);
     if(e != e_syserr_none) { return e; }
@@ -240,6 +285,8 @@ e_syserr_t fsm_init(void){
     if(je != e_err_no_err) { return (e_syserr_t)je;}
     je = jes_register_job(FSM_FILE_JOB_NAME, 2048*2, 1, file_job, 1);
     if(je != e_err_no_err) { return (e_syserr_t)je;}
+    je = jes_register_job(FSM_SPECTRUM_JOB_NAME, 2048*2, 1, spec_job, 1);
+    if(je != e_err_no_err) { return (e_syserr_t)je;}
     return e_syserr_none;
 }
 
@@ -273,7 +320,7 @@ fsm_runtime_values_t fsm_get_runtime_values(void){
     return rtv;
 }
 
-static inline void fsm_update_samples_to_process(uint32_t samples){
+static inline void fsm_update_samples_to_process(uint64_t samples){
     if(cur_rt_args.cur_state == e_fsm_state_rec){
         xSemaphoreTake(lock_interface, portMAX_DELAY);
         cur_rt_args.samples_to_process = samples;
@@ -283,37 +330,75 @@ static inline void fsm_update_samples_to_process(uint32_t samples){
 
 static inline void fsm_static_base_cb(fsm_runtime_args_t* rt_args){
     fsm_runtime_values_t rtv = fsm_get_runtime_values();
-    // hardcoded
-    const uint16_t softclock_max = AUDIO_SR_DEFAULT / (AUDIO_FRAME_LEN/FSM_UPDATE_SLOW_RATE_S); 
-    static uint16_t softclock = softclock_max - 1;
+    // frames per slow update period at the active rate
+    const uint16_t softclock_max = (rt_args->sr * FSM_UPDATE_SLOW_RATE_S) / AUDIO_FRAME_LEN; 
+    static uint16_t softclock = UINT16_MAX - 1;
     static uint16_t adc_lipo_last_mv;
     static uint16_t adc_plug_last_mv;
-    if(++softclock == softclock_max){
+    if(++softclock >= softclock_max){
         softclock = 0;
         adc_lipo_last_mv = rtv.lipo_mv = adc_base_get_mv(ADC_LIPO_LEVEL_PIN);
         adc_plug_last_mv = rtv.plug_mv = adc_base_get_mv(ADC_PLUG_DETECT_PIN);
     }
-    uint32_t delta = rt_args->samples_tot - rt_args->samples_to_process;
+    uint64_t delta = rt_args->samples_tot - rt_args->samples_to_process;
     rtv.t_transaction = (uint32_t)(((float)delta/(float)rt_args->sr) * 1000);
     rtv.t_system = esp_timer_get_time() / 1000;
     fsm_update_runtime_values(&rtv);
 }
 
 static inline  void fsm_static_process_cb(stereo_sample_t* buf, uint32_t len, fsm_runtime_args_t* rt_args){
+    static fsm_state_t clips_state = e_fsm_state_trans;
     fsm_runtime_values_t rtv = fsm_get_runtime_values();
     rtv.raw_data = buf;
     rtv.len = AUDIO_FRAME_LEN;
-    rtv.msqr = dsp_fr1_samples_to_msqr_32b(rtv.raw_data, rtv.len);
+    dsp_fr1_meter_t m = dsp_fr1_meter_32b(rtv.raw_data, rtv.len);
+    rtv.msqr = m.msqr;
+    rtv.peak = m.peak;
+    if(rt_args->cur_state != clips_state){
+        // counted per state, every take starts from zero
+        clips_state = rt_args->cur_state;
+        rtv.clips = 0;
+    }
+    rtv.clips += m.clips_l;
     rtv.msqr_avg = dsp_fr1_msqr_rolling_avg(rtv.msqr);
     rtv.dbfs = dsp_fr1_samples_to_dbfs_32b_from_msqr(rtv.msqr);
     rtv.dbfs_avg = dsp_fr1_samples_to_dbfs_32b_from_msqr(rtv.msqr_avg);
+    rtv.slm = dsp_fr1_slm_process(rtv.raw_data, rtv.len, rt_args->sr);
     fsm_update_runtime_values(&rtv);
+
+    float frame_ms = (float)len * 1000.f / (float)rt_args->sr;
+    switch(fsm_vox_update(rtv.dbfs.l, frame_ms, rt_args->cur_state)){
+        case e_fsm_vox_start:
+            jes_launch_job_args(FSM_CTRL_JOB_NAME, FSM_RECORDING_JOB_NAME " start");
+            break;
+        case e_fsm_vox_stop:
+            jes_launch_job_args(FSM_CTRL_JOB_NAME, FSM_RECORDING_JOB_NAME " stop");
+            break;
+        default:
+            break;
+    }
+}
+
+static e_syserr_t fsm_set_sr(fsm_runtime_args_t* rta, uint32_t sr){
+    if(sr == audio_get_sr()){
+        rta->sr = sr;
+        return e_syserr_none;
+    }
+    e_syserr_t e = audio_set_sr(sr);
+    rta->sr = audio_get_sr();
+    fsm.states[e_fsm_state_idle].rt_args.sr = rta->sr;
+    cfg_rec_t cr = cfg_get_rec();
+    rec_preroll_format(rta->sr, FSM_REC_N_CH_DEFAULT, cr.bps);
+    return e;
 }
 
 static inline e_syserr_t fsm_enter_idle(fsm_runtime_args_t* rta){
     fsm_state_struct_t* pstate = &fsm.states[e_fsm_state_idle];
     // xSemaphoreTake(pstate->lock, portMAX_DELAY); // TODO: lock usage
     rta->cur_state = e_fsm_state_idle;
+    // start the pre-roll over in the format the next take will most likely use
+    cfg_rec_t cr = cfg_get_rec();
+    rec_preroll_format(audio_get_sr(), FSM_REC_N_CH_DEFAULT, cr.bps);
     pstate->rt_args = *rta;
     jes_err_t je = __job_set_param(pstate, 
                                    fsm.audio_job_handle);
@@ -324,14 +409,32 @@ static inline e_syserr_t fsm_enter_idle(fsm_runtime_args_t* rta){
 
 static inline e_syserr_t fsm_enter_record(fsm_runtime_args_t* rta){
     fsm_state_struct_t* pstate = &fsm.states[e_fsm_state_rec];
+    uint32_t sr_prev = audio_get_sr();
     fsm.cur_open_wav = *rta->wav_file; // copy wav struct
     rta->wav_file = &fsm.cur_open_wav; // map ref to fsm's instance
-    e_syserr_t e = wav_open_for_write(rta->wav_file, 
-                                      rta->wav_file->filename, 
-                                      rta->n_ch, 
-                                      rta->sr, 
-                                      rta->bps);
-    if(e != e_syserr_none) return e;
+    e_syserr_t e = wav_writer_open(&fsm.cur_writer, 
+                                   rta->fmt, 
+                                   rta->wav_file->filename, 
+                                   rta->n_ch, 
+                                   rta->sr / rta->decim, 
+                                   rta->bps,
+                                   rta->samples_tot / rta->decim);
+    if(e == e_syserr_none) {
+        // I2S restarts only once the file exists, less to undo if it does not
+        e = fsm_set_sr(rta, rta->sr);
+        #if FSM_INTERNAL_VERBOSE == 1
+        if(e != e_syserr_none) SCOPE_LOG("err: %d, could not switch audio to the rate of the take", e);
+        #endif
+        // still the state the take starts from, only idle fed the pre-roll up to now
+        if(e == e_syserr_none) e = rec_start(&fsm.cur_writer, rta->sr, rta->decim, rta->cur_state == e_fsm_state_idle);
+        if(e != e_syserr_none) wav_writer_close(&fsm.cur_writer);
+    }
+    if(e != e_syserr_none) {
+        // the state that is left keeps running at its rate
+        fsm_set_sr(rta, sr_prev);
+        fsm_update_runtime_args(rta);
+        return e;
+    }
     rta->cur_state = e_fsm_state_rec;
     pstate->rt_args = *rta;
     jes_err_t je = __job_set_param(pstate, 
@@ -382,6 +485,19 @@ static inline e_syserr_t fsm_enter_file(fsm_runtime_args_t* rta){
     return e_syserr_none;
 }
 
+static inline e_syserr_t fsm_enter_spec(fsm_runtime_args_t* rta){
+    fsm_state_struct_t* pstate = &fsm.states[e_fsm_state_spec];
+    e_syserr_t e = spec_start(rta->sr);
+    if(e != e_syserr_none) return e;
+    rta->cur_state = e_fsm_state_spec;
+    pstate->rt_args = *rta;
+    jes_err_t je = __job_set_param(pstate, 
+                                   fsm.audio_job_handle);
+    if(je != e_err_no_err) return (e_syserr_t)je;
+    fsm.cur_state = e_fsm_state_spec;
+    return e_syserr_none;
+}
+
 e_syserr_t fsm_enter_state(fsm_state_t s, fsm_runtime_args_t* rta){
     if(s == e_fsm_state_trans) return e_syserr_none;
     rta->target_state = s;
@@ -396,13 +512,33 @@ static inline e_syserr_t fsm_exit_idle(fsm_runtime_args_t* rta){
 static inline e_syserr_t fsm_exit_record(fsm_runtime_args_t* rta){
     audio_suspend_short();
     jes_delay_job_ms(100); // let audio finish the last block
-    e_syserr_t e = wav_close_for_write(rta->wav_file);
+    e_syserr_t e = rec_stop();
     if(e != e_syserr_none) {
+        // the writer task still uses the file, stay in record and retry on the next transition
         #if FSM_INTERNAL_VERBOSE == 1
-        SCOPE_LOG("err: %d, unable to close wav file %x", e, rta->wav_file->file);
+        SCOPE_LOG("err: %d, writer did not drain in time", e);
+        #endif
+        return e;
+    }
+    e = wav_writer_close(&fsm.cur_writer);
+    if(e != e_syserr_none) {
+        #if FSM_INTERNAL_VERBOSE == 1
+        SCOPE_LOG("err: %d, unable to close file <%s>", e, rta->wav_file->filename);
         #endif
         return e; 
     }
+    e = sd_stats_write(rta->wav_file->filename);
+    if(e != e_syserr_none) {
+        #if FSM_INTERNAL_VERBOSE == 1
+        SCOPE_LOG("err: %d, unable to write SD stats", e);
+        #endif
+    }
+    e = rec_write_log(rta->wav_file->filename);
+    if(e != e_syserr_none) {
+        #if FSM_INTERNAL_VERBOSE == 1
+        SCOPE_LOG("err: %d, unable to write gap log", e);
+        #endif
+    }
     // memset(rta->wav_file, 0, sizeof(wav_file_t)); /// TODO:
     e = sd_unmnt();
     rta->sd_mounted = 0;
@@ -436,6 +572,12 @@ static inline e_syserr_t fsm_exit_file(fsm_runtime_args_t* rta){
     return e_syserr_none;
 }
 
+static inline e_syserr_t fsm_exit_spec(fsm_runtime_args_t* rta){
+    spec_stop();
+    fsm.cur_state = e_fsm_state_trans;
+    return e_syserr_none;
+}
+
 e_syserr_t fsm_exit_state(fsm_state_t s, fsm_runtime_args_t* rta){
     if(s == e_fsm_state_trans) return e_syserr_none;
     return fsm.states[s].exit(rta);
@@ -443,20 +585,40 @@ e_syserr_t fsm_exit_state(fsm_state_t s, fsm_runtime_args_t* rta){
 
 static inline void fsm_idle(fsm_runtime_args_t* rta){
     static uint8_t frame_pos = 0;
+    PROF_BEGIN(e_prof_stage_read);
     audio_read(&audio_buf[rta->data_len*(frame_pos)], rta->data_len);
+    PROF_END(e_prof_stage_read);
+    PROF_BEGIN(e_prof_stage_write);
+    rec_preroll_feed(&audio_buf[rta->data_len*(frame_pos)], rta->data_len);
+    PROF_END(e_prof_stage_write);
+    PROF_BEGIN(e_prof_stage_process);
     fsm_static_process_cb(&audio_buf[rta->data_len*(!frame_pos)], rta->data_len, rta);
+    PROF_END(e_prof_stage_process);
+    PROF_BEGIN(e_prof_stage_base);
     fsm_static_base_cb(rta);
+    PROF_END(e_prof_stage_base);
     frame_pos = !frame_pos;
 }
 
 static inline void fsm_record(fsm_runtime_args_t* rta) {
     e_syserr_t e;
-    static uint8_t frame_pos = 0;
-    static uint8_t test = 0;
-    audio_read(&audio_buf[rta->data_len * frame_pos], rta->data_len);
-    fsm_static_process_cb(&audio_buf[rta->data_len*(!frame_pos)], rta->data_len, rta);
+    // capture straight into a ring slot, on overrun (counted by the 
+    // recorder) keep metering in the static buffer and drop the frame
+    stereo_sample_t* frame = rec_acquire_frame();
+    if(frame == NULL) frame = audio_buf;
+    PROF_BEGIN(e_prof_stage_read);
+    audio_read(frame, rta->data_len);
+    PROF_END(e_prof_stage_read);
+    PROF_BEGIN(e_prof_stage_process);
+    fsm_static_process_cb(frame, rta->data_len, rta);
+    PROF_END(e_prof_stage_process);
+    PROF_BEGIN(e_prof_stage_base);
     fsm_static_base_cb(rta);
-    e = wav_write_samples(rta->wav_file, &audio_buf[rta->data_len * (!frame_pos)], rta->data_len);
+    PROF_END(e_prof_stage_base);
+    PROF_BEGIN(e_prof_stage_write);
+    if(frame != audio_buf) rec_commit_frame(frame, rta->data_len);
+    PROF_END(e_prof_stage_write);
+    e = rec_get_error();
     if(e != e_syserr_none && e != e_syserr_oom){
         rta->samples_to_process = 0;
         // this is an assumption:
@@ -469,7 +631,6 @@ static inline void fsm_record(fsm_runtime_args_t* rta) {
     } else {
         rta->samples_to_process = 0;
     }
-    frame_pos = !frame_pos;
     fsm_update_samples_to_process(rta->samples_to_process);
     if (rta->samples_to_process == 0) {
         fsm_transition(e_fsm_state_rec, e_fsm_state_idle, rta);
@@ -488,6 +649,21 @@ static inline void fsm_file(fsm_runtime_args_t* rta){
     fsm_static_base_cb(rta);
 }
 
+static inline void fsm_spec(fsm_runtime_args_t* rta){
+    PROF_BEGIN(e_prof_stage_read);
+    audio_read(audio_buf, rta->data_len);
+    PROF_END(e_prof_stage_read);
+    PROF_BEGIN(e_prof_stage_spec);
+    spec_feed(audio_buf, rta->data_len);
+    PROF_END(e_prof_stage_spec);
+    PROF_BEGIN(e_prof_stage_process);
+    fsm_static_process_cb(audio_buf, rta->data_len, rta);
+    PROF_END(e_prof_stage_process);
+    PROF_BEGIN(e_prof_stage_base);
+    fsm_static_base_cb(rta);
+    PROF_END(e_prof_stage_base);
+}
+
 void fsm_routine_state(fsm_state_t s, fsm_runtime_args_t* rta){
     if(s == e_fsm_state_trans) return;
     fsm.states[s].routine(rta);
@@ -495,6 +671,7 @@ void fsm_routine_state(fsm_state_t s, fsm_runtime_args_t* rta){
 
 e_syserr_t fsm_transition(fsm_state_t from, fsm_state_t to, fsm_runtime_args_t* rta){
     e_syserr_t e;
+    PROF_TRACE_BEGIN(e_prof_trace_fsm, (from << 8) | to);
     #if FSM_INTERNAL_VERBOSE == 1
     SCOPE_LOG("Exiting <%d>!", from);
     #endif
@@ -503,6 +680,7 @@ e_syserr_t fsm_transition(fsm_state_t from, fsm_state_t to, fsm_runtime_args_t*
         #if FSM_INTERNAL_VERBOSE == 1
         SCOPE_LOG("Could not exit <%d>!", from);
         #endif
+        PROF_TRACE_END(e_prof_trace_fsm, (from << 8) | to);
         jes_throw_error((jes_err_t)e);
         return e;
     }
@@ -515,10 +693,12 @@ e_syserr_t fsm_transition(fsm_state_t from, fsm_state_t to, fsm_runtime_args_t*
         #if FSM_INTERNAL_VERBOSE == 1
         SCOPE_LOG("Could not enter <%d>!", to);
         #endif
+        PROF_TRACE_END(e_prof_trace_fsm, (from << 8) | to);
         jes_throw_error((jes_err_t)e);
         return e;
     }
     fsm_update_runtime_args(rta);
+    PROF_TRACE_END(e_prof_trace_fsm, (from << 8) | to);
     return e_syserr_none;
 }
 
@@ -6,22 +6,32 @@
 #include "esp_attr.h"
 #include "sdcard.h"
 #include "wav.h"
+#include "wav_writer.h"
+#include "dsp_fr1_slm.h"
 #include "freertos/semphr.h"
 
 #define UNIF_UART_WRITE_BUF_SIZE 128         // this overwrites a macro in jescore
 #define FSM_RECORDING_MIN_SPACE (1024 * 10) // 10 MB
 
 
-#define FSM_JOB_N               5
+#define FSM_JOB_N               6
 #define FSM_CTRL_JOB_NAME       "fsm" // not counted 
 #define FSM_IDLE_JOB_NAME       "idle"
 #define FSM_RECORDING_JOB_NAME  "record"
 #define FSM_BATTERY_JOB_NAME    "batt"
 #define FSM_SETTINGS_JOB_NAME   "sett"
 #define FSM_FILE_JOB_NAME       "file"
+#define FSM_SPECTRUM_JOB_NAME   "spec"
 
 #define FSM_UPDATE_SLOW_RATE_S  8 // every 8 seconds, the FSM updates "slow" values
 
+#define FSM_REC_BPS_DEFAULT     24 // packed resolution written to SD
+#define FSM_REC_N_CH_DEFAULT    1  // mic is on the left I2S slot only
+
+#ifndef FSM_REC_BUDGET_STRICT
+#define FSM_REC_BUDGET_STRICT   0  // 1 refuses takes beyond the benchmarked card budget, 0 only warns
+#endif // FSM_REC_BUDGET_STRICT
+
 #ifndef FSM_INTERNAL_VERBOSE
 #define FSM_INTERNAL_VERBOSE 0
 #endif // FSM_INTERNAL_VERBOSE
@@ -45,6 +55,7 @@ typedef enum fsm_state_t{
     e_fsm_state_batt,
     e_fsm_state_sett,
     e_fsm_state_file,
+    e_fsm_state_spec,
     e_fsm_state_trans,
     NUM_FSM_STATES
 }fsm_state_t;
@@ -55,12 +66,14 @@ typedef struct fsm_runtime_args_t{
     fsm_state_t cur_state;      // what is currently in the fsm
     stereo_sample_t* data_buf;
     uint32_t data_len;
-    uint32_t samples_to_process;
-    uint32_t samples_tot;
+    uint64_t samples_to_process;
+    uint64_t samples_tot;
     wav_file_t* wav_file;
     uint32_t sr;
     uint32_t bps;
     uint8_t n_ch;
+    uint8_t decim;              // file rate = sr / decim
+    uint8_t fmt;                // e_wav_fmt_t, every format carries its file name in `wav_file`
     uint8_t sd_mounted;
     void* var_args;
 }fsm_runtime_args_t;
@@ -73,6 +86,9 @@ typedef struct fsm_runtime_values_t{
     stereo_value_t msqr_avg;
     stereo_value_t dbfs;
     stereo_value_t dbfs_avg;
+    stereo_value_t peak;
+    uint32_t clips;             // full scale samples (left) since the current state was entered
+    dsp_fr1_slm_values_t slm;
     uint32_t t_transaction;
     int64_t t_system;
     uint32_t lipo_mv;
@@ -105,6 +121,7 @@ typedef struct fsm_t{
     fsm_state_struct_t states[NUM_FSM_STATES];
     job_struct_t* audio_job_handle;
     wav_file_t cur_open_wav;
+    wav_writer_t cur_writer;
 }fsm_t;
 
 /// @brief Initialize the FSM.
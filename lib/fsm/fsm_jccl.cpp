@@ -1,6 +1,14 @@
 #include "fsm.h"
 #include "fsm_jccl.h"
 #include "jescore.h"
+#include "recorder.h"
+#include "spectrum.h"
+#include "wav_pack.h"
+#include "wav_writer.h"
+#include "config.h"
+#include "fsm_vox.h"
+#include "dsp_fr1.h"
+#include "dsp_fr1_decim.h"
 #include <Arduino.h>
 
 const char fsm_jccl_jobs[FSM_JOB_N][8] = {
@@ -8,9 +16,109 @@ const char fsm_jccl_jobs[FSM_JOB_N][8] = {
     FSM_RECORDING_JOB_NAME,
     FSM_BATTERY_JOB_NAME,
     FSM_SETTINGS_JOB_NAME,
-    FSM_FILE_JOB_NAME
+    FSM_FILE_JOB_NAME,
+    FSM_SPECTRUM_JOB_NAME
 };
 
+/// @brief Parse the optional flags of `record start` and `record default`.
+/// @param pj Calling job, used for logging.
+/// @param samples Pointer to variable to hold `-s` (64 bit). Pass NULL to reject the flag.
+/// @param cr Recording settings, only fields of given flags are overwritten.
+/// @param persist 1 for `record default`, which also accepts the device-only flags (`-p`).
+/// @return FR1 error code. Errors are already logged and thrown.
+/// @note Continues the `strtok()` sequence of the caller.
+static e_syserr_t fsm_jccl_parse_rec_flags(job_struct_t* pj, uint64_t* samples, cfg_rec_t* cr, uint8_t persist){
+    char* flag;
+    while((flag = strtok(NULL, " ")) != NULL){
+        char* value = strtok(NULL, " ");
+        if (!value){
+            SCOPE_LOG_PJ(pj, "Flag given but value is missing!");
+            jes_throw_error((jes_err_t)e_syserr_param);
+            return e_syserr_param;
+        }
+        uint32_t n = atoi(value);
+        if (strcmp(flag, "-f") == 0) {
+            if (strcmp(value, "wav") == 0) cr->fmt = e_wav_fmt_pcm;
+            else if (strcmp(value, "flac") == 0) cr->fmt = e_wav_fmt_flac;
+            else if (strcmp(value, "adpcm") == 0) cr->fmt = e_wav_fmt_adpcm;
+            else if (strcmp(value, "ext") == 0) cr->fmt = e_wav_fmt_ext;
+            else {
+                SCOPE_LOG_PJ(pj, "Unsupported format <%s>!", value);
+                jes_throw_error((jes_err_t)e_syserr_param);
+                return e_syserr_param;
+            }
+        }
+        else if (strcmp(flag, "-s") == 0 && samples != NULL) {
+            uint64_t n64 = strtoull(value, NULL, 10);
+            if (n64 == 0){
+                SCOPE_LOG_PJ(pj, "Can't record this amount of samples!");
+                jes_throw_error((jes_err_t)e_syserr_param);
+                return e_syserr_param;
+            }
+            *samples = n64;
+        }
+        else if (strcmp(flag, "-r") == 0) {
+            if (!AUDIO_SR_VALID(n)){
+                SCOPE_LOG_PJ(pj, "Unsupported sample rate <%s>!", value);
+                jes_throw_error((jes_err_t)e_syserr_param);
+                return e_syserr_param;
+            }
+            cr->sr = n;
+        }
+        else if (strcmp(flag, "-b") == 0) {
+            if (!WAV_PACK_BPS_VALID(n)){
+                SCOPE_LOG_PJ(pj, "Unsupported bit depth <%s>!", value);
+                jes_throw_error((jes_err_t)e_syserr_param);
+                return e_syserr_param;
+            }
+            cr->bps = (uint16_t)n;
+        }
+        else if (strcmp(flag, "-d") == 0) {
+            if (!DSP_FR1_DECIM_VALID(n)){
+                SCOPE_LOG_PJ(pj, "Decimation must be 1 to %d!", DSP_FR1_DECIM_MAX);
+                jes_throw_error((jes_err_t)e_syserr_param);
+                return e_syserr_param;
+            }
+            cr->decim = (uint8_t)n;
+        }
+        else if (strcmp(flag, "-m") == 0) {
+            if (n > CFG_REC_SEG_MB_MAX){
+                SCOPE_LOG_PJ(pj, "Segments are limited to %d MiB!", CFG_REC_SEG_MB_MAX);
+                jes_throw_error((jes_err_t)e_syserr_param);
+                return e_syserr_param;
+            }
+            cr->seg_mb = (uint16_t)n;
+        }
+        else if (strcmp(flag, "-l") == 0) {
+            if (n > CFG_REC_SEG_S_MAX){
+                SCOPE_LOG_PJ(pj, "Segments are limited to %d s!", CFG_REC_SEG_S_MAX);
+                jes_throw_error((jes_err_t)e_syserr_param);
+                return e_syserr_param;
+            }
+            cr->seg_s = (uint32_t)n;
+        }
+        else if (strcmp(flag, "-p") == 0 && persist) {
+            if (n > CFG_REC_PREROLL_S_MAX){
+                SCOPE_LOG_PJ(pj, "Pre-roll is limited to %d s!", CFG_REC_PREROLL_S_MAX);
+                jes_throw_error((jes_err_t)e_syserr_param);
+                return e_syserr_param;
+            }
+            cr->preroll_s = (uint16_t)n;
+        }
+        else {
+            SCOPE_LOG_PJ(pj, "Unknown flag <%s>!", flag);
+            jes_throw_error((jes_err_t)e_syserr_param);
+            return e_syserr_param;
+        }
+    }
+    if (!wav_writer_bps_valid(cr->fmt, cr->bps)){
+        SCOPE_LOG_PJ(pj, "%s takes can't be %d bit!", wav_writer_get_ops(cr->fmt)->name, cr->bps);
+        jes_throw_error((jes_err_t)e_syserr_param);
+        return e_syserr_param;
+    }
+    return e_syserr_none;
+}
+
 void fsm_job(void* p){
     job_struct_t* pj = (job_struct_t*)p;
     char* args = jes_job_get_args();
@@ -66,6 +174,41 @@ void idle_job(void* p){
         rta = fsm_get_runtime_args();
         e_syserr_t e;
 
+        if(arg != NULL && strcmp(arg, "slm") == 0){
+            fsm_runtime_values_t rtv = fsm_get_runtime_values();
+            dsp_fr1_slm_weight_t w = rtv.slm.weight;
+            dsp_fr1_slm_time_t t = rtv.slm.time;
+            char* opt = strtok(NULL, " ");
+            if(opt == NULL){
+                const char* tn[] = {"F", "S", "I"};
+                SCOPE_LOG_PJ(pj, "L%s%s %.1f, Leq %.1f, Lmax %.1f, Lpeak %.1f dB SPL", 
+                             dsp_fr1_slm_weight_name(w), tn[t],
+                             DSP_FR1_DBFS_TO_SPL(rtv.slm.l), DSP_FR1_DBFS_TO_SPL(rtv.slm.leq),
+                             DSP_FR1_DBFS_TO_SPL(rtv.slm.lmax), DSP_FR1_DBFS_TO_SPL(rtv.slm.lpeak));
+                SCOPE_LOG_PJ(pj, "%d cycles/sample (budget %d), %d frames over budget", 
+                             rtv.slm.cyc_per_sample, DSP_FR1_SLM_BUDGET_CYC, rtv.slm.over_budget);
+                SCOPE_LOG_PJ(pj, "Usage: idle slm [a, c, z, fast, slow, imp, reset].");
+                continue;
+            }
+            if(strcmp(opt, "reset") == 0){
+                dsp_fr1_slm_reset();
+                continue;
+            }
+            if(strcmp(opt, "a") == 0) w = e_dsp_fr1_slm_a;
+            else if(strcmp(opt, "c") == 0) w = e_dsp_fr1_slm_c;
+            else if(strcmp(opt, "z") == 0) w = e_dsp_fr1_slm_z;
+            else if(strcmp(opt, "fast") == 0) t = e_dsp_fr1_slm_fast;
+            else if(strcmp(opt, "slow") == 0) t = e_dsp_fr1_slm_slow;
+            else if(strcmp(opt, "imp") == 0) t = e_dsp_fr1_slm_imp;
+            else{
+                SCOPE_LOG_PJ(pj, "Unknown argument for slm.");
+                jes_throw_error((jes_err_t)e_syserr_param);
+                continue;
+            }
+            dsp_fr1_slm_config(w, t);
+            continue;
+        }
+
         if(rta.cur_state == e_fsm_state_rec){
             if(arg == NULL){
                 SCOPE_LOG_PJ(pj, "Device is still recording. Use 'idle home' to force idle state.");
@@ -96,7 +239,121 @@ void record_job(void* p){
         e_syserr_t e;
 
         if(arg == NULL){
-            SCOPE_LOG_PJ(pj, "Usage: record [start, stop, toggle] (-s samples).");
+            SCOPE_LOG_PJ(pj, "Usage: record [start, stop, toggle, stats, bench, default, vox] (-s samples) (-r rate) (-b bits) (-d decimation) (-f wav|flac|adpcm|ext) (-m segment MiB) (-l segment s) (-p preroll s, default only).");
+            continue;
+        }
+
+        if(strcmp(arg, "default") == 0){
+            cfg_rec_t cr = cfg_get_rec();
+            if(fsm_jccl_parse_rec_flags(pj, NULL, &cr, 1) != e_syserr_none) continue;
+            e = cfg_set_rec(cr);
+            if(e != e_syserr_none){
+                SCOPE_LOG_PJ(pj, "Could not store defaults.");
+                jes_throw_error((jes_err_t)e);
+                continue;
+            }
+            rec_preroll_set(cr.preroll_s);
+            SCOPE_LOG_PJ(pj, "Default: %s, %d Hz / %d, %d bit, %d s pre-roll, segments %d MiB / %d s.", 
+                         wav_writer_get_ops(cr.fmt)->name, cr.sr, cr.decim, cr.bps, cr.preroll_s,
+                         cr.seg_mb, cr.seg_s);
+            continue;
+        }
+
+        if(strcmp(arg, "vox") == 0){
+            fsm_vox_cfg_t vc = cfg_get_vox();
+            char* opt = strtok(NULL, " ");
+            if(opt == NULL){
+                SCOPE_LOG_PJ(pj, "VOX %s, start > %d dBFS, stop < %d dBFS after %d ms.", 
+                             vc.enabled ? "on" : "off", vc.thr_db, vc.thr_db - vc.hyst_db, vc.hold_ms);
+                SCOPE_LOG_PJ(pj, "Usage: record vox [on, off] (-t dBFS) (-y hysteresis dB) (-h hold ms).");
+                continue;
+            }
+            if(strcmp(opt, "on") == 0) vc.enabled = 1;
+            else if(strcmp(opt, "off") == 0) vc.enabled = 0;
+            else{
+                SCOPE_LOG_PJ(pj, "Unknown argument for vox.");
+                jes_throw_error((jes_err_t)e_syserr_param);
+                continue;
+            }
+            char* flag;
+            e = e_syserr_none;
+            while(e == e_syserr_none && (flag = strtok(NULL, " ")) != NULL){
+                char* value = strtok(NULL, " ");
+                if(value == NULL) { e = e_syserr_param; break; }
+                int32_t n = atoi(value);
+                if(strcmp(flag, "-t") == 0 && FSM_VOX_THR_VALID(n)) vc.thr_db = (int16_t)n;
+                else if(strcmp(flag, "-y") == 0 && FSM_VOX_HYST_VALID(n)) vc.hyst_db = (uint16_t)n;
+                else if(strcmp(flag, "-h") == 0 && FSM_VOX_HOLD_VALID(n)) vc.hold_ms = (uint32_t)n;
+                else e = e_syserr_param;
+            }
+            if(e != e_syserr_none){
+                SCOPE_LOG_PJ(pj, "Invalid vox flag or value!");
+                jes_throw_error((jes_err_t)e);
+                continue;
+            }
+            e = cfg_set_vox(vc);
+            if(e != e_syserr_none){
+                SCOPE_LOG_PJ(pj, "Could not store vox settings.");
+                jes_throw_error((jes_err_t)e);
+                continue;
+            }
+            fsm_vox_config(vc);
+            SCOPE_LOG_PJ(pj, "VOX %s.", vc.enabled ? "armed" : "off");
+            continue;
+        }
+
+        if(strcmp(arg, "stats") == 0){
+            rec_stats_t rs = rec_get_stats();
+            SCOPE_LOG_PJ(pj, "ring: %d/%d slots (max %d), depth %d ms", 
+                         rs.fill_cur, rs.n_slots, rs.fill_max, rs.depth_ms);
+            SCOPE_LOG_PJ(pj, "frames in/out: %d/%d, overruns: %d (%d samples lost)", 
+                         rs.frames_in, rs.frames_out, rs.overruns, rs.dropped_samples);
+            SCOPE_LOG_PJ(pj, "pre-roll: %d ms, segments: %d, checkpoints: %d", 
+                         rs.preroll_ms, rs.segments, rs.checkpoints);
+            audio_stats_t as = audio_get_stats();
+            SCOPE_LOG_PJ(pj, "i2s: %d dropouts (%d this take, %llu samples lost), clock deficit %d", 
+                         as.dropouts, rs.i2s_dropouts, as.lost_samples, as.clock_deficit);
+            SCOPE_LOG_PJ(pj, "i2s: rx_q_ovf %d, dma_err %d, short reads %d, late frames %d", 
+                         as.rx_q_ovf, as.dma_err, as.short_reads, as.late_frames);
+            continue;
+        }
+
+        if(strcmp(arg, "bench") == 0){
+            char* value = strtok(NULL, " ");
+            uint32_t mb = value != NULL ? strtoul(value, NULL, 10) : SDCARD_BENCH_MB_DEFAULT;
+            if(rta.cur_state == e_fsm_state_rec){
+                SCOPE_LOG_PJ(pj, "Cannot benchmark while recording.");
+                jes_throw_error((jes_err_t)e_syserr_locked);
+                continue;
+            }
+            e = sd_mnt();
+            if(e != e_syserr_none){
+                SCOPE_LOG_PJ(pj, "Cannot mount SD.");
+                jes_throw_error((jes_err_t)e_syserr_sdcard_unmnted);
+                continue;
+            }
+            cfg_sd_budget_t b = {};
+            e = rec_budget_measure(mb, &b);
+            if(e != e_syserr_none){
+                SCOPE_LOG_PJ(pj, "Could not measure the budget of this card. (%d)", e);
+                jes_throw_error((jes_err_t)e);
+                continue;
+            }
+            uint32_t sr = 0;
+            uint16_t bps = 0;
+            rec_stats_t rs = rec_get_stats();
+            e = rec_budget_max(FSM_REC_N_CH_DEFAULT, &sr, &bps);
+            if(e != e_syserr_none){
+                SCOPE_LOG_PJ(pj, "Budget stored, no format check possible. (%d)", e);
+                continue;
+            }
+            if(sr == 0){
+                SCOPE_LOG_PJ(pj, "Card %08x: %d KiB/s, %d us worst, sustains no PCM format with %d ring slots.",
+                             b.serial, b.kbps, b.max_us, rs.n_slots);
+                continue;
+            }
+            SCOPE_LOG_PJ(pj, "Card %08x: %d KiB/s, %d us worst, sustains %d Hz / %d bit PCM with %d ring slots.",
+                         b.serial, b.kbps, b.max_us, sr, bps, rs.n_slots);
             continue;
         }
         
@@ -126,7 +383,6 @@ void record_job(void* p){
             jes_throw_error((jes_err_t)e_syserr_oom);
             continue;
         }
-        uint32_t max_samples = free_kbytes * 1024 * sizeof(stereo_sample_t); 
 
         if(strcmp(arg, "toggle") == 0){
             if(rta.cur_state == e_fsm_state_rec){
@@ -142,31 +398,49 @@ void record_job(void* p){
                 SCOPE_LOG_PJ(pj, "Already recording.");
                 continue;
             }
-            char* flag = strtok(NULL, " ");
-            if (flag){
-                char* value = strtok(NULL, " ");
-                if (!value){
-                    SCOPE_LOG_PJ(pj, "Flag given but value is missing!");
-                    jes_throw_error((jes_err_t)e_syserr_param);
+            cfg_rec_t cr = cfg_get_rec();
+            uint64_t n = 0;
+            if(fsm_jccl_parse_rec_flags(pj, &n, &cr, 0) != e_syserr_none) continue;
+            // RF64 lifts the 4 GiB WAV limit, FAT32 still caps single files unless the take is split
+            uint64_t max_bytes = (uint64_t)free_kbytes * 1024;
+            uint64_t max_file = sd_get_file_size_max();
+            uint64_t seg_bytes = (uint64_t)cr.seg_mb * 1024 * 1024;
+            if ((seg_bytes == 0 || seg_bytes > max_file) && max_bytes > max_file) max_bytes = max_file;
+            if (max_bytes <= WAV_HEADER_SIZE_TOTAL){
+                SCOPE_LOG_PJ(pj, "Cannot record, card is full.");
+                jes_throw_error((jes_err_t)e_syserr_oom);
+                continue;
+            }
+            max_bytes -= WAV_HEADER_SIZE_TOTAL;
+            uint64_t max_samples = wav_writer_max_samples(cr.fmt, FSM_REC_N_CH_DEFAULT, cr.bps, max_bytes);
+            if (n > max_samples){
+                SCOPE_LOG_PJ(pj, "Can't record this amount of samples!");
+                jes_throw_error((jes_err_t)e_syserr_param);
+                continue;
+            }
+            if (n != 0) max_samples = n;
+            // the FSM counts captured samples, the limit counts samples in the file
+            max_samples *= cr.decim;
+            // a card slower than the take overruns the ring, unknown cards are not checked
+            if(rec_budget_check(cr.fmt, FSM_REC_N_CH_DEFAULT, cr.sr, cr.bps, cr.decim) == e_syserr_prohibited){
+                if(FSM_REC_BUDGET_STRICT){
+                    SCOPE_LOG_PJ(pj, "Cannot record, the format exceeds the budget of this card (record bench).");
+                    jes_throw_error((jes_err_t)e_syserr_prohibited);
                     continue;
-                };
-                if (strcmp(flag, "-s") == 0) {
-                    uint32_t n = atoi(value);
-                    if (n == 0 || n > max_samples){
-                        SCOPE_LOG_PJ(pj, "Can't record this amount of samples!");
-                        jes_throw_error((jes_err_t)e_syserr_param);
-                        continue;
-                    }
-                    max_samples = n;
                 }
+                SCOPE_LOG_PJ(pj, "Warning: the format exceeds the budget of this card (record bench), expect overruns.");
             }
-            SCOPE_LOG_PJ(pj, "Starting recording of %d samples...", max_samples);
+            SCOPE_LOG_PJ(pj, "Starting recording of %llu samples (%s, %d Hz, %d bit)...", 
+                         (unsigned long long)(max_samples / cr.decim), wav_writer_get_ops(cr.fmt)->name, cr.sr / cr.decim, 
+                         wav_writer_file_bps(cr.fmt, cr.bps));
             wav_file_t wav = {
                 /*.filename =*/SDCARD_BASE_PATH "/" SDCARD_DEFAULT_FNAME_WAV,
                 /*.file =*/NULL,
+                /*.out =*/NULL,
                 /*.header =*/{0},
                 /*.samples_transfered =*/0
             };
+            strcpy(wav.filename, wav_writer_get_ops(cr.fmt)->fname);
             e = sd_get_unique_fname(wav.filename);
             
             if(e != e_syserr_none){
@@ -183,9 +457,12 @@ void record_job(void* p){
             rta.samples_to_process = max_samples;
             rta.samples_tot = max_samples;
             rta.wav_file = &wav;
-            rta.sr = AUDIO_SR_DEFAULT;
-            rta.bps = 32;
-            rta.n_ch = 1;
+            rta.sr = cr.sr;         // audio switches once the file is open
+            rta.bps = cr.bps;
+            rta.n_ch = FSM_REC_N_CH_DEFAULT;
+            rta.decim = cr.decim;
+            rta.fmt = cr.fmt;
+            rec_split_set(cr.seg_mb, cr.seg_s);
 
             FSM_JCCL_TRANSITION_OR_CONTINUE(rta.cur_state, e_fsm_state_rec, &rta);
         }
@@ -256,4 +533,46 @@ void file_job(void* p){
         }
         FSM_JCCL_TRANSITION_OR_CONTINUE(rta.cur_state, e_fsm_state_file, &rta);
     }
-}
\ No newline at end of file
+}
+
+void spec_job(void* p){
+    job_struct_t* pj = (job_struct_t*)p;
+    fsm_runtime_args_t rta;
+    pj->role = e_role_core;
+    while(1){
+        jes_wait_for_notification();
+        char* args = jes_job_get_args();
+        char* arg = strtok(args, " ");
+        rta = fsm_get_runtime_args();
+        e_syserr_t e;
+
+        if(arg != NULL && strcmp(arg, "print") == 0){
+            if(rta.cur_state != e_fsm_state_spec){
+                SCOPE_LOG_PJ(pj, "Spectrum analyzer is not running.");
+                continue;
+            }
+            spec_result_t r = spec_get();
+            uint8_t third = r.fraction == 3;
+            uint16_t n = third ? DSP_FR1_THIRD_BANDS : DSP_FR1_OCT_BANDS;
+            for(uint16_t i = 0; i < n; i++){
+                float l = third ? r.third[i] : r.oct[i];
+                SCOPE_LOG_PJ(pj, "%7.1f Hz: %6.1f dB SPL", dsp_fr1_band_center(r.fraction, i), 
+                             l <= DSP_FR1_BAND_FLOOR_DB ? l : DSP_FR1_DBFS_TO_SPL(l));
+            }
+            SCOPE_LOG_PJ(pj, "%d blocks, %d skipped, fft %d cycles, bands %d cycles", 
+                         r.blocks, r.skipped, r.cyc_fft, r.cyc_bands);
+            continue;
+        }
+        if(arg != NULL){
+            if(strcmp(arg, "oct") == 0) spec_set_fraction(1);
+            else if(strcmp(arg, "third") == 0) spec_set_fraction(3);
+            else{
+                SCOPE_LOG_PJ(pj, "Usage: spec [oct, third, print].");
+                jes_throw_error((jes_err_t)e_syserr_param);
+                continue;
+            }
+        }
+        if(rta.cur_state == e_fsm_state_spec) continue;
+        FSM_JCCL_TRANSITION_OR_CONTINUE(rta.cur_state, e_fsm_state_spec, &rta);
+    }
+}
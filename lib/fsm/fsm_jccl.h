@@ -37,4 +37,8 @@ void sett_job(void* p);
 /// @param p Pointer to job parameters (set by jescore).
 void file_job(void* p);
 
+/// @brief Spectrum job. Handles the spectrum analyzer state transition.
+/// @param p Pointer to job parameters (set by jescore).
+void spec_job(void* p);
+
 #endif // _FSM_JCCL_H_
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "fsm_vox.h"
+
+typedef struct fsm_vox_t{
+    fsm_vox_cfg_t cfg;
+    volatile uint8_t rearm;     // set by config, consumed by the audio task
+    float t_above_ms;           // time spent above the start threshold
+    float t_below_ms;           // time spent below the stop threshold
+    float t_request_ms;         // time since the last request
+    uint8_t requested;          // transition requested, waiting for the FSM
+    fsm_state_t req_state;      // state the request was issued in
+    uint8_t owns_take;          // the running take was started by VOX
+}fsm_vox_t;
+
+static fsm_vox_t vox = {
+    .cfg = {
+        .enabled = 0,
+        .thr_db = FSM_VOX_THR_DB_DEFAULT,
+        .hyst_db = FSM_VOX_HYST_DB_DEFAULT,
+        .hold_ms = FSM_VOX_HOLD_MS_DEFAULT
+    },
+    .rearm = 1,
+};
+
+void fsm_vox_config(fsm_vox_cfg_t cfg){
+    vox.cfg = cfg;
+    vox.rearm = 1;
+}
+
+fsm_vox_cfg_t fsm_vox_get_config(void){
+    return vox.cfg;
+}
+
+fsm_vox_action_t fsm_vox_update(float dbfs, float frame_ms, fsm_state_t state){
+    if(vox.rearm){
+        vox.rearm = 0;
+        vox.t_above_ms = 0;
+        vox.t_below_ms = 0;
+        vox.requested = 0;
+        vox.owns_take = 0;
+    }
+    if(!vox.cfg.enabled) return e_fsm_vox_none;
+
+    if(vox.requested){
+        vox.t_request_ms += frame_ms;
+        if(state != vox.req_state){
+            // FSM followed, the take (if any) now belongs to us
+            vox.requested = 0;
+            vox.owns_take = (state == e_fsm_state_rec);
+        }
+        else if(vox.t_request_ms < FSM_VOX_RETRY_MS){
+            return e_fsm_vox_none;
+        }
+        vox.requested = 0;
+    }
+
+    if(state == e_fsm_state_idle){
+        vox.owns_take = 0;
+        vox.t_below_ms = 0;
+        vox.t_above_ms = (dbfs >= vox.cfg.thr_db) ? vox.t_above_ms + frame_ms : 0;
+        if(vox.t_above_ms < FSM_VOX_ATTACK_MS) return e_fsm_vox_none;
+        vox.t_above_ms = 0;
+        vox.requested = 1;
+        vox.req_state = state;
+        vox.t_request_ms = 0;
+        return e_fsm_vox_start;
+    }
+
+    if(state == e_fsm_state_rec && vox.owns_take){
+        float thr_stop = (float)(vox.cfg.thr_db - (int16_t)vox.cfg.hyst_db);
+        vox.t_below_ms = (dbfs < thr_stop) ? vox.t_below_ms + frame_ms : 0;
+        if(vox.t_below_ms < vox.cfg.hold_ms) return e_fsm_vox_none;
+        vox.t_below_ms = 0;
+        vox.requested = 1;
+        vox.req_state = state;
+        vox.t_request_ms = 0;
+        return e_fsm_vox_stop;
+    }
+    return e_fsm_vox_none;
+}
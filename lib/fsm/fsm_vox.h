@@ -0,0 +1,44 @@
+/// @file fsm_vox.h
+/// @brief
+/*
+VOX trigger, starts a take when the level stays above the threshold for
+`FSM_VOX_ATTACK_MS` and stops it once it stayed below threshold minus
+hysteresis for the hold time. The audio task feeds it one level per frame
+and turns the returned action into an FSM transition.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _FSM_VOX_H_
+#define _FSM_VOX_H_
+
+#include <stdint.h>
+#include "fsm.h"
+#include "fsm_vox_types.h"
+
+#define FSM_VOX_ATTACK_MS       40      // time above threshold before a take starts
+#define FSM_VOX_RETRY_MS        5000    // re-arm if a requested transition never happened
+
+/// @brief Action requested by the VOX trigger.
+typedef enum fsm_vox_action_t{
+    e_fsm_vox_none,
+    e_fsm_vox_start,
+    e_fsm_vox_stop
+}fsm_vox_action_t;
+
+/// @brief Apply new VOX settings. Re-arms the trigger.
+/// @param cfg New settings.
+void fsm_vox_config(fsm_vox_cfg_t cfg);
+
+/// @brief Get the active VOX settings.
+/// @return VOX settings (by value).
+fsm_vox_cfg_t fsm_vox_get_config(void);
+
+/// @brief Feed the level of one frame into the trigger.
+/// @param dbfs Frame level in dBFS.
+/// @param frame_ms Duration of the frame in ms.
+/// @param state Current FSM state.
+/// @return Action to request from the FSM. Every action is only returned once.
+/// @note Audio task only. Only takes started by VOX are stopped by VOX.
+fsm_vox_action_t fsm_vox_update(float dbfs, float frame_ms, fsm_state_t state);
+
+#endif // _FSM_VOX_H_
@@ -0,0 +1,31 @@
+/// @file fsm_vox_types.h
+/// @brief
+/*
+VOX settings and their limits, shared by the trigger (`fsm_vox.h`), the
+persisted defaults (`config.h`) and the `record vox` command. Kept apart
+from the trigger so the config does not pull in the FSM.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _FSM_VOX_TYPES_H_
+#define _FSM_VOX_TYPES_H_
+
+#include <stdint.h>
+
+#define FSM_VOX_THR_DB_DEFAULT  (-50)   // dBFS
+#define FSM_VOX_HYST_DB_DEFAULT 6       // stop threshold = thr - hyst
+#define FSM_VOX_HOLD_MS_DEFAULT 3000    // time below stop threshold before a take ends
+
+#define FSM_VOX_THR_VALID(db)   ((db) < 0 && (db) > -120)
+#define FSM_VOX_HYST_VALID(db)  ((int32_t)(db) >= 0 && (db) < 40)
+#define FSM_VOX_HOLD_VALID(ms)  ((ms) > 0)
+
+/// @brief VOX (level triggered recording) settings.
+typedef struct fsm_vox_cfg_t{
+    uint8_t enabled;
+    int16_t thr_db;
+    uint16_t hyst_db;
+    uint32_t hold_ms;
+}fsm_vox_cfg_t;
+
+#endif // _FSM_VOX_TYPES_H_
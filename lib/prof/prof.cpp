@@ -0,0 +1,97 @@
+#include <Arduino.h>
+#include <jescore.h>
+#include "prof.h"
+#include "prof_trace.h"
+#include "audio.h"
+#include "fsm.h"
+
+typedef struct prof_ctx_t{
+    prof_stage_t st[e_prof_stage_n];
+    uint32_t read_cyc;          // read of the running frame
+    volatile uint8_t reset;     // clear the counters on the next record
+}prof_ctx_t;
+
+static prof_ctx_t prof = {.reset = 1};
+
+e_syserr_t prof_init(void){
+    jes_err_t je = jes_register_job(PROF_JOB_NAME, 3072, 1, prof_job, 0);
+    if(je != e_err_no_err && je != e_err_duplicate) return (e_syserr_t)je;
+    return prof_trace_init();
+}
+
+void prof_record(uint8_t stage, uint32_t cyc){
+    if(prof.reset){
+        prof.reset = 0;
+        memset(prof.st, 0, sizeof(prof.st));
+    }
+    if(stage >= e_prof_stage_n) return;
+    prof_stage_t* s = &prof.st[stage];
+    if(s->n == 0 || cyc < s->min) s->min = cyc;
+    if(cyc > s->max) s->max = cyc;
+    s->sum += cyc;
+    s->n++;
+    if(stage == e_prof_stage_read) prof.read_cyc += cyc;
+}
+
+void prof_frame_end(uint32_t cyc){
+    uint32_t read = prof.read_cyc;
+    prof.read_cyc = 0;
+    prof_record(e_prof_stage_frame, cyc);
+    prof_record(e_prof_stage_busy, cyc > read ? cyc - read : 0);
+}
+
+void prof_reset(void){
+    prof.reset = 1;
+}
+
+prof_stage_t prof_get(uint8_t stage){
+    prof_stage_t s = {};
+    if(stage < e_prof_stage_n && !prof.reset) s = prof.st[stage];
+    return s;
+}
+
+void prof_job(void* p){
+    job_struct_t* pj = (job_struct_t*)p;
+    #ifndef FR1_PROFILE
+    SCOPE_LOG_PJ(pj, "Profiler not compiled in, build with -DFR1_PROFILE.");
+    jes_throw_error((jes_err_t)e_syserr_prohibited);
+    return;
+    #else
+    static const char* names[e_prof_stage_n] = {"read", "process", "base", "write", "spec", "frame", "busy"};
+    char* args = jes_job_get_args();
+    char* arg = strtok(args, " ");
+    if(arg != NULL && strcmp(arg, "reset") == 0){
+        prof_reset();
+        SCOPE_LOG_PJ(pj, "Cleared.");
+        return;
+    }
+    if(arg != NULL){
+        SCOPE_LOG_PJ(pj, "Usage: prof (reset).");
+        return;
+    }
+    uint32_t sr = audio_get_sr();
+    uint32_t mhz = getCpuFrequencyMhz();
+    if(sr == 0 || mhz == 0){
+        SCOPE_LOG_PJ(pj, "Audio not running.");
+        return;
+    }
+    uint64_t budget = (uint64_t)AUDIO_FRAME_LEN * mhz * 1000000 / sr;
+    SCOPE_LOG_PJ(pj, "budget: %llu us/frame (%d @ %d Hz), %d MHz",
+                 budget / mhz, AUDIO_FRAME_LEN, sr, mhz);
+    SCOPE_LOG_PJ(pj, "stage        n   min us   avg us   max us  avg %%  max %%");
+    for(uint8_t i = 0; i < e_prof_stage_n; i++){
+        prof_stage_t s = prof_get(i);
+        if(s.n == 0) continue;
+        uint32_t avg = (uint32_t)(s.sum / s.n);
+        SCOPE_LOG_PJ(pj, "%-8s %5d %8d %8d %8d %6d %6d", names[i], s.n,
+                     s.min / mhz, avg / mhz, s.max / mhz,
+                     (uint32_t)(avg * 100ULL / budget), (uint32_t)(s.max * 100ULL / budget));
+    }
+    prof_stage_t b = prof_get(e_prof_stage_busy);
+    if(b.n == 0) return;
+    uint32_t avg_pct = (uint32_t)(b.sum / b.n * 100 / budget);
+    uint32_t max_pct = (uint32_t)(b.max * 100ULL / budget);
+    SCOPE_LOG_PJ(pj, "headroom: %d%% on average, %d%% in the worst frame",
+                 avg_pct < 100 ? 100 - avg_pct : 0, max_pct < 100 ? 100 - max_pct : 0);
+    #endif
+}
@@ -0,0 +1,88 @@
+/// @file prof.h
+/// @brief
+/*
+Per-stage cycle profiler of the audio loop. Every routine the audio task
+runs per frame (I2S read, metering, slow updates, handing the frame to the
+recorder, spectrum feed) is bracketed with `PROF_BEGIN()` / `PROF_END()`,
+the whole routine with `PROF_FRAME_BEGIN()` / `PROF_FRAME_END()`. Stages
+are timed with the CCOUNT register of the core the audio task runs on and
+kept as min/avg/max, the `prof` job prints them against the frame budget
+(`AUDIO_FRAME_LEN / sr`).
+
+The read stage mostly waits for the I2S DMA, `busy` is the routine without
+it and tells the headroom left for more DSP.
+
+Only compiled in with `-DFR1_PROFILE`, the macros are empty otherwise.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+#include <stdint.h>
+#include "syserr.h"
+
+#define PROF_JOB_NAME           "prof"
+
+/// @brief Profiled stages of the audio loop.
+typedef enum{
+    e_prof_stage_read,          // `audio_read()`, includes the wait for the I2S DMA
+    e_prof_stage_process,       // `fsm_static_process_cb()`, metering, SLM and VOX
+    e_prof_stage_base,          // `fsm_static_base_cb()`, slow values
+    e_prof_stage_write,         // `rec_commit_frame()` or `rec_preroll_feed()`, decimation and packing
+    e_prof_stage_spec,          // `spec_feed()`
+    e_prof_stage_frame,         // whole state routine
+    e_prof_stage_busy,          // whole state routine without the read
+    e_prof_stage_n
+}e_prof_stage_t;
+
+/// @brief Cycle counts of one stage.
+typedef struct prof_stage_t{
+    uint32_t n;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+}prof_stage_t;
+
+#ifdef FR1_PROFILE
+#include "hal/cpu_hal.h"
+#define PROF_BEGIN(stage)       uint32_t __prof_t0_##stage = cpu_hal_get_cycle_count()
+#define PROF_END(stage)         prof_record(stage, cpu_hal_get_cycle_count() - __prof_t0_##stage)
+#define PROF_FRAME_BEGIN()      uint32_t __prof_t0_frame = cpu_hal_get_cycle_count()
+#define PROF_FRAME_END()        prof_frame_end(cpu_hal_get_cycle_count() - __prof_t0_frame)
+#else
+#define PROF_BEGIN(stage)
+#define PROF_END(stage)
+#define PROF_FRAME_BEGIN()
+#define PROF_FRAME_END()
+#endif
+
+/// @brief Register the `prof` job and the `trace` job (see `prof_trace.h`).
+/// @return FR1 error code.
+/// @note Also registered without `FR1_PROFILE`, the job then only says so.
+e_syserr_t prof_init(void);
+
+/// @brief Account one run of a stage.
+/// @param stage `e_prof_stage_t` value.
+/// @param cyc Cycles the stage took.
+/// @note Only call this from the audio task, use `PROF_END()`.
+void prof_record(uint8_t stage, uint32_t cyc);
+
+/// @brief Account a whole routine and derive its busy time.
+/// @param cyc Cycles the routine took.
+/// @note Only call this from the audio task, use `PROF_FRAME_END()`.
+void prof_frame_end(uint32_t cyc);
+
+/// @brief Clear the counters, applied by the audio task before its next record.
+void prof_reset(void);
+
+/// @brief Get a snapshot of one stage.
+/// @param stage `e_prof_stage_t` value.
+/// @return Stage counters (by value), all zero for invalid stages.
+prof_stage_t prof_get(uint8_t stage);
+
+/// @brief jescore job printing the profile, `prof reset` clears it.
+/// @param p Job struct.
+void prof_job(void* p);
+
+#endif // _PROF_H_
@@ -0,0 +1,111 @@
+#include <Arduino.h>
+#include <jescore.h>
+#include "prof_trace.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "fsm.h"
+
+#define PROF_TRACE_SETTLE_MS    2       // in-flight events finish while the rings are frozen
+
+typedef struct prof_trace_ring_t{
+    prof_trace_rec_t rec[PROF_TRACE_LEN];
+    uint32_t head;              // events ever claimed, slot = head % PROF_TRACE_LEN
+}prof_trace_ring_t;
+
+typedef struct prof_trace_ctx_t{
+    prof_trace_ring_t ring[PROF_TRACE_CORES];
+    volatile uint8_t on;
+}prof_trace_ctx_t;
+
+#ifdef FR1_TRACE
+static DRAM_ATTR prof_trace_ctx_t trace = {.on = 1};
+#endif
+
+e_syserr_t prof_trace_init(void){
+    jes_err_t je = jes_register_job(PROF_TRACE_JOB_NAME, 3072, 1, prof_trace_job, 0);
+    if(je != e_err_no_err && je != e_err_duplicate) return (e_syserr_t)je;
+    return e_syserr_none;
+}
+
+#ifdef FR1_TRACE
+void IRAM_ATTR prof_trace_emit(uint8_t evt, uint8_t ph, uint16_t arg){
+    if(!trace.on) return;
+    // a task moved to the other core in between only lands on the other ring
+    prof_trace_ring_t* r = &trace.ring[xPortGetCoreID()];
+    uint32_t i = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED);
+    prof_trace_rec_t* rec = &r->rec[i % PROF_TRACE_LEN];
+    rec->ts_us = (uint32_t)esp_timer_get_time();
+    rec->evt = evt;
+    rec->ph = ph;
+    rec->arg = arg;
+}
+
+void prof_trace_enable(uint8_t on){
+    trace.on = on;
+}
+
+void prof_trace_clear(void){
+    uint8_t on = trace.on;
+    trace.on = 0;
+    vTaskDelay(pdMS_TO_TICKS(PROF_TRACE_SETTLE_MS));
+    for(uint8_t c = 0; c < PROF_TRACE_CORES; c++){
+        __atomic_store_n(&trace.ring[c].head, 0, __ATOMIC_RELAXED);
+    }
+    trace.on = on;
+}
+
+void prof_trace_dump(void){
+    static const char* names[e_prof_trace_n] = {"audio_frame", "sd_write", "sd_sync", "fsm", "ui_redraw", "button"};
+    uint8_t on = trace.on;
+    trace.on = 0;
+    vTaskDelay(pdMS_TO_TICKS(PROF_TRACE_SETTLE_MS));
+    uart_unif_writef(PROF_TRACE_DUMP_BEGIN "\n\r");
+    for(uint8_t i = 0; i < e_prof_trace_n; i++){
+        uart_unif_writef("#evt %d %s\n\r", i, names[i]);
+    }
+    for(uint8_t c = 0; c < PROF_TRACE_CORES; c++){
+        prof_trace_ring_t* r = &trace.ring[c];
+        uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        uint32_t first = head > PROF_TRACE_LEN ? head - PROF_TRACE_LEN : 0;
+        uart_unif_writef("#core %d events %d lost %d\n\r", c, head - first, first);
+        for(uint32_t i = first; i != head; i++){
+            const prof_trace_rec_t* rec = &r->rec[i % PROF_TRACE_LEN];
+            uart_unif_writef("T %d %u %c %d %d\n\r", c, (unsigned)rec->ts_us, rec->ph, rec->evt, rec->arg);
+        }
+    }
+    uart_unif_writef(PROF_TRACE_DUMP_END "\n\r");
+    trace.on = on;
+}
+#else
+void prof_trace_emit(uint8_t evt, uint8_t ph, uint16_t arg){}
+void prof_trace_enable(uint8_t on){}
+void prof_trace_clear(void){}
+void prof_trace_dump(void){}
+#endif
+
+void prof_trace_job(void* p){
+    job_struct_t* pj = (job_struct_t*)p;
+    #ifndef FR1_TRACE
+    SCOPE_LOG_PJ(pj, "Tracer not compiled in, build with -DFR1_TRACE.");
+    jes_throw_error((jes_err_t)e_syserr_prohibited);
+    return;
+    #else
+    char* args = jes_job_get_args();
+    char* arg = strtok(args, " ");
+    if(arg == NULL){
+        uint32_t n[PROF_TRACE_CORES];
+        for(uint8_t c = 0; c < PROF_TRACE_CORES; c++) n[c] = __atomic_load_n(&trace.ring[c].head, __ATOMIC_RELAXED);
+        SCOPE_LOG_PJ(pj, "Tracing %s, events per core: %d/%d (ring %d).", trace.on ? "on" : "off", n[0], n[1], PROF_TRACE_LEN);
+        SCOPE_LOG_PJ(pj, "Usage: trace [on, off, clear, dump].");
+        return;
+    }
+    if(strcmp(arg, "on") == 0) prof_trace_enable(1);
+    else if(strcmp(arg, "off") == 0) prof_trace_enable(0);
+    else if(strcmp(arg, "clear") == 0) prof_trace_clear();
+    else if(strcmp(arg, "dump") == 0) prof_trace_dump();
+    else{
+        SCOPE_LOG_PJ(pj, "Unknown argument <%s>.", arg);
+        jes_throw_error((jes_err_t)e_syserr_param);
+    }
+    #endif
+}
@@ -0,0 +1,96 @@
+/// @file prof_trace.h
+/// @brief
+/*
+Timeline tracer. Begin, end and instant events of audio frames, SD writes,
+FSM transitions, UI redraws and button ISRs go to a RAM ring per core,
+timestamped with `esp_timer` (one clock for both cores). Writers claim a
+slot with an atomic increment on the ring of the core they run on, tasks
+and ISRs never wait for each other. The ring keeps the latest
+`PROF_TRACE_LEN` events per core.
+
+`trace dump` prints the rings over UART between `PROF_TRACE_DUMP_BEGIN`
+and `PROF_TRACE_DUMP_END`, `tools/trace2chrome.py` turns a captured log
+into Chrome trace JSON (chrome://tracing, Perfetto).
+
+Only compiled in with `-DFR1_TRACE`, the macros are empty otherwise.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _PROF_TRACE_H_
+#define _PROF_TRACE_H_
+
+#include <stdint.h>
+#include "syserr.h"
+
+#define PROF_TRACE_JOB_NAME     "trace"
+#ifndef PROF_TRACE_LEN
+#define PROF_TRACE_LEN          1024    // events per core, power of two, 8 byte each
+#endif
+#define PROF_TRACE_CORES        2
+#define PROF_TRACE_DUMP_BEGIN   "#trace begin"
+#define PROF_TRACE_DUMP_END     "#trace end"
+
+/// @brief Traced events, each gets its own track per core.
+typedef enum{
+    e_prof_trace_audio_frame,   // state routine of the audio task, arg: state
+    e_prof_trace_sd_write,      // write burst or header rewrite, arg: KiB
+    e_prof_trace_sd_sync,       // FatFs sync
+    e_prof_trace_fsm,           // `fsm_transition()`, arg: from << 8 | to
+    e_prof_trace_ui_redraw,     // one `uio_job` update, arg: priority
+    e_prof_trace_button,        // button ISR, arg: pin
+    e_prof_trace_n
+}e_prof_trace_evt_t;
+
+/// @brief Event phases, the values are the Chrome trace phases.
+typedef enum{
+    e_prof_trace_begin = 'B',
+    e_prof_trace_end = 'E',
+    e_prof_trace_instant = 'i'
+}e_prof_trace_ph_t;
+
+/// @brief One traced event.
+typedef struct prof_trace_rec_t{
+    uint32_t ts_us;             // low word of `esp_timer_get_time()`
+    uint8_t evt;                // e_prof_trace_evt_t
+    uint8_t ph;                 // e_prof_trace_ph_t
+    uint16_t arg;
+}prof_trace_rec_t;
+
+#ifdef FR1_TRACE
+#define PROF_TRACE_BEGIN(evt, arg)      prof_trace_emit(evt, e_prof_trace_begin, arg)
+#define PROF_TRACE_END(evt, arg)        prof_trace_emit(evt, e_prof_trace_end, arg)
+#define PROF_TRACE_INSTANT(evt, arg)    prof_trace_emit(evt, e_prof_trace_instant, arg)
+#else
+#define PROF_TRACE_BEGIN(evt, arg)
+#define PROF_TRACE_END(evt, arg)
+#define PROF_TRACE_INSTANT(evt, arg)
+#endif
+
+/// @brief Register the `trace` job.
+/// @return FR1 error code.
+/// @note Also registered without `FR1_TRACE`, the job then only says so.
+e_syserr_t prof_trace_init(void);
+
+/// @brief Append an event to the ring of the calling core.
+/// @param evt `e_prof_trace_evt_t` value.
+/// @param ph `e_prof_trace_ph_t` value.
+/// @param arg Event argument.
+/// @note Lock-free and in IRAM, safe from tasks and ISRs. Use the macros.
+void prof_trace_emit(uint8_t evt, uint8_t ph, uint16_t arg);
+
+/// @brief Start or stop recording events. Tracing is on after boot.
+/// @param on 1 to record, 0 to freeze the rings.
+void prof_trace_enable(uint8_t on);
+
+/// @brief Drop all recorded events.
+void prof_trace_clear(void);
+
+/// @brief Print the rings over UART, oldest event first per core.
+/// @note Freezes the rings while printing and restores the previous state.
+void prof_trace_dump(void);
+
+/// @brief jescore job controlling the tracer, `trace [on, off, clear, dump]`.
+/// @param p Job struct.
+void prof_trace_job(void* p);
+
+#endif // _PROF_TRACE_H_
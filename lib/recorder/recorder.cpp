@@ -0,0 +1,542 @@
+#include <jescore.h>
+#include "recorder.h"
+#include "wav_pack.h"
+#include "config.h"
+#include "sdcard.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+
+/// @brief Circular pre-roll of packed frames. Mutated by the audio task only,
+/// read by the writer once the audio task left idle.
+typedef struct rec_preroll_t{
+    uint8_t* mem;               // PSRAM arena of REC_PREROLL_MAX_BYTES
+    uint32_t seconds;
+    uint32_t sr;
+    uint16_t n_ch;
+    uint16_t bps;
+    uint32_t frame_bytes;       // packed bytes per audio frame
+    uint32_t n_frames;          // capacity in frames for `seconds`
+    uint32_t head;              // frames fed since last (re)configuration
+    volatile uint8_t reconfig;  // audio task shall apply the format below
+    uint32_t next_sr;
+    uint16_t next_n_ch;
+    uint16_t next_bps;
+    volatile uint8_t pending;   // writer shall flush before the first slot
+    uint32_t flushed_ms;
+}rec_preroll_t;
+
+/// @brief Gap log of the running take. Positions are on the audio sample clock.
+typedef struct rec_gaps_t{
+    audio_dropout_t ovf[REC_GAP_LOG_N];
+    uint32_t n_ovf;
+    uint32_t i2s_since;         // audio dropout index at take start
+    uint32_t rx_q_since;        // audio event queue overflows at take start
+    uint64_t clk_base;          // sample clock at the first committed frame
+    uint8_t clk_valid;
+    uint32_t pre_samples;       // pre-roll put in front of the first frame
+}rec_gaps_t;
+
+typedef struct rec_ctx_t{
+    ringbuf_t ring;
+    rec_preroll_t pre;
+    rec_gaps_t gaps;
+    TaskHandle_t writer;
+    SemaphoreHandle_t drained;
+    wav_writer_t* w;            // bound take, NULL while not recording
+    uint32_t sr;
+    uint32_t seg_mb;            // segment limits for the next take
+    uint32_t seg_s;
+    uint64_t seg_units;         // units per segment of the running take, 0 = unlimited
+    uint64_t seg_bytes;         // file bytes per segment of the running take, 0 = unlimited
+    uint64_t seg_done;          // units in the current segment, writer task only
+    volatile uint32_t segments;
+    volatile uint32_t checkpoints;
+    TickType_t ckpt_tick;       // last header commit, writer task only
+    dsp_fr1_decim_t dec;        // capture rate -> file rate, audio task only
+    volatile uint8_t active;    // producer may enqueue
+    volatile uint8_t draining;  // writer shall signal an empty ring
+    volatile e_syserr_t err;    // first writer error
+    volatile uint32_t frames_in;
+    volatile uint32_t frames_out;
+    volatile uint32_t overruns;
+    volatile uint32_t dropped_samples;
+}rec_ctx_t;
+
+static rec_ctx_t rec;
+
+/// @brief Writer task. Drains the ring into the bound take.
+/// @param p Unused.
+/// @note Runs pinned to `REC_WRITER_CORE`, outside of jescore.
+static void rec_writer_task(void* p);
+
+/// @brief Log a dropped frame, back to back drops are merged into one event.
+/// @param len Dropped samples, the frame about to be read is the one lost.
+/// @note Audio task only.
+static void rec_log_overrun(uint32_t len);
+
+/// @brief Reset the counters and the decimator for a new take.
+/// @note Binding the file is left to the caller, it activates the producer side.
+static e_syserr_t rec_prepare(uint32_t sr, uint16_t numChannels, uint8_t decim);
+
+/// @brief Write encoded bytes to the bound take, splitting it into segments on the way.
+/// @note Writer task only.
+static e_syserr_t rec_write(const uint8_t* data, uint32_t bytes);
+
+/// @brief Commit the bound take if the last checkpoint is older than `period`.
+/// @note Writer task only.
+static void rec_checkpoint(TickType_t period);
+
+/// @brief Write the pre-roll in front of the first frame of the bound take.
+/// @note Writer task only.
+static void rec_preroll_flush(void);
+
+e_syserr_t rec_init(uint32_t ring_seconds, uint32_t preroll_seconds){
+    if(ring_seconds == 0) return e_syserr_param;
+    if(rec.writer != NULL) return e_syserr_none;
+    memset(&rec, 0, sizeof(rec_ctx_t));
+    rec.err = e_syserr_none;
+    rec.pre.mem = (uint8_t*)heap_caps_malloc(REC_PREROLL_MAX_BYTES, MALLOC_CAP_SPIRAM);
+    rec.pre.seconds = preroll_seconds;
+    #ifdef REC_RING_IN_DMA_RAM
+    e_syserr_t e = ringbuf_init(&rec.ring, REC_RING_DMA_SLOTS, REC_RING_SLOT_SIZE,
+                                REC_RING_SLOT_ALIGN, MALLOC_CAP_DMA);
+    #else
+    uint32_t n_slots = (ring_seconds * AUDIO_SR_MAX + AUDIO_FRAME_LEN - 1) / AUDIO_FRAME_LEN;
+    e_syserr_t e = ringbuf_init(&rec.ring, n_slots, REC_RING_SLOT_SIZE, 
+                                REC_RING_SLOT_ALIGN, MALLOC_CAP_SPIRAM);
+    if(e == e_syserr_oom){
+        // no (or too little) PSRAM, keep going with a minimal ring
+        e = ringbuf_init(&rec.ring, REC_RING_FALLBACK_SLOTS, REC_RING_SLOT_SIZE, 
+                         REC_RING_SLOT_ALIGN, MALLOC_CAP_DMA);
+    }
+    #endif
+    if(e != e_syserr_none) return e;
+    rec.drained = xSemaphoreCreateBinary();
+    if(rec.drained == NULL) return e_syserr_null;
+    BaseType_t ret = xTaskCreatePinnedToCore(rec_writer_task,
+                                             REC_WRITER_TASK_NAME,
+                                             REC_WRITER_TASK_MEM,
+                                             NULL,
+                                             REC_WRITER_TASK_PRIO,
+                                             &rec.writer,
+                                             REC_WRITER_CORE);
+    if(ret != pdPASS) return e_syserr_oom;
+    return e_syserr_none;
+}
+
+e_syserr_t rec_init_default(void){
+    return rec_init(REC_RING_SECONDS_DEFAULT, cfg_get_rec().preroll_s);
+}
+
+static e_syserr_t rec_prepare(uint32_t sr, uint16_t numChannels, uint8_t decim){
+    if(rec.writer == NULL) return e_syserr_uninitialized;
+    if(rec.active || rec.w != NULL) return e_syserr_locked; // a timed out take is still bound
+    ringbuf_reset(&rec.ring);
+    rec.frames_in = 0;
+    rec.frames_out = 0;
+    rec.overruns = 0;
+    rec.dropped_samples = 0;
+    rec.err = e_syserr_none;
+    rec.sr = sr;
+    e_syserr_t e = dsp_fr1_decim_init(&rec.dec, decim, numChannels);
+    if(e != e_syserr_none) return e;
+    rec.draining = 0;
+    memset(&rec.gaps, 0, sizeof(rec_gaps_t));
+    audio_stats_t as = audio_get_stats();
+    rec.gaps.i2s_since = as.dropouts;
+    rec.gaps.rx_q_since = as.rx_q_ovf;
+    rec.pre.flushed_ms = 0;
+    rec.pre.pending = 0;
+    xSemaphoreTake(rec.drained, 0);
+    return e_syserr_none;
+}
+
+e_syserr_t rec_start(wav_writer_t* w, uint32_t sr, uint8_t decim, uint8_t preroll){
+    if(w == NULL || w->ops == NULL) return e_syserr_null;
+    e_syserr_t e = rec_prepare(sr, w->n_ch, decim);
+    if(e != e_syserr_none) return e;
+    rec.pre.pending = (preroll &&
+                       w->ops->packed_pcm &&
+                       decim == 1 &&
+                       !rec.pre.reconfig &&
+                       rec.pre.head > 0 &&
+                       rec.pre.sr == sr &&
+                       rec.pre.n_ch == w->n_ch &&
+                       rec.pre.bps == w->bps);
+    rec.seg_units = (uint64_t)rec.seg_s * w->sr / w->unit_samples;
+    rec.seg_bytes = (uint64_t)rec.seg_mb * 1024 * 1024;
+    if(rec.seg_bytes != 0 && w->fmt != e_wav_fmt_flac){
+        // ring bytes are file bytes, the size limit is exact as well
+        uint64_t units = rec.seg_bytes / w->unit_bytes;
+        if(rec.seg_units == 0 || units < rec.seg_units) rec.seg_units = units;
+    }
+    rec.seg_done = 0;
+    rec.segments = 0;
+    rec.checkpoints = 0;
+    // a write that outlasts one capture frame has to be absorbed by the ring
+    sd_stats_reset(sr ? (uint32_t)((uint64_t)AUDIO_FRAME_LEN * 1000000 / sr) : 0);
+    rec.ckpt_tick = xTaskGetTickCount();
+    if(rec.seg_units != 0 || rec.seg_bytes != 0){
+        // later files only need room for one segment
+        uint64_t seg = rec.seg_units * w->unit_bytes;
+        if(w->fmt == e_wav_fmt_flac){
+            seg = wav_writer_max_bytes(w->fmt, w->n_ch, w->bps, rec.seg_units * w->unit_samples);
+            if(rec.seg_bytes != 0 && (seg == 0 || rec.seg_bytes < seg)) seg = rec.seg_bytes;
+        }
+        if(seg < w->reserve) w->reserve = seg;
+        // open the second file now, while nothing is waiting for the writer
+        e = wav_writer_prepare_next(w);
+        if(e != e_syserr_none) return e;
+    }
+    rec.w = w;
+    rec.active = 1;
+    return e_syserr_none;
+}
+
+stereo_sample_t* rec_acquire_frame(void){
+    if(!rec.active) return NULL;
+    stereo_sample_t* slot = (stereo_sample_t*)ringbuf_acquire(&rec.ring);
+    if(slot == NULL){
+        rec.overruns++;
+        rec.dropped_samples += AUDIO_FRAME_LEN;
+        rec_log_overrun(AUDIO_FRAME_LEN);
+    }
+    return slot;
+}
+
+void rec_commit_frame(stereo_sample_t* frame, uint32_t len){
+    if(!rec.gaps.clk_valid){
+        // latched after the first read of the take, a pending resync restarts the clock inside it
+        uint64_t read = audio_get_stats().samples_read;
+        rec.gaps.clk_base = read > len ? read - len : 0;
+        rec.gaps.clk_valid = 1;
+    }
+    len = dsp_fr1_decim_process(&rec.dec, frame, len);
+    ringbuf_commit(&rec.ring, wav_writer_encode(rec.w, frame, frame, len));
+    rec.frames_in++;
+    xTaskNotifyGive(rec.writer);
+}
+
+e_syserr_t rec_stop(void){
+    if(rec.w == NULL) return e_syserr_none;
+    rec.active = 0;
+    rec.draining = 1;
+    xTaskNotifyGive(rec.writer);
+    // the writer may still be inside a write, `rec.w` stays bound until it acknowledged,
+    // `draining` stays set so a later call picks up the acknowledgement
+    if(xSemaphoreTake(rec.drained, pdMS_TO_TICKS(REC_DRAIN_TIMEOUT_MS)) != pdTRUE) return e_syserr_locked;
+    rec.w = NULL;
+    return e_syserr_none;
+}
+
+void rec_split_set(uint32_t seg_mb, uint32_t seg_s){
+    rec.seg_mb = seg_mb;
+    rec.seg_s = seg_s;
+}
+
+void rec_preroll_set(uint32_t seconds){
+    rec.pre.seconds = seconds;
+    rec.pre.next_sr = rec.pre.sr;
+    rec.pre.next_n_ch = rec.pre.n_ch;
+    rec.pre.next_bps = rec.pre.bps;
+    rec.pre.reconfig = 1;
+}
+
+void rec_preroll_format(uint32_t sr, uint16_t numChannels, uint16_t bitsPerSample){
+    // frames from before idle was left would be spliced to the new ones, always start over
+    rec.pre.next_sr = sr;
+    rec.pre.next_n_ch = numChannels;
+    rec.pre.next_bps = bitsPerSample;
+    rec.pre.reconfig = 1;
+}
+
+void rec_preroll_feed(const stereo_sample_t* data, uint32_t len){
+    rec_preroll_t* pre = &rec.pre;
+    if(pre->mem == NULL || len != AUDIO_FRAME_LEN) return;
+    if(pre->reconfig){
+        pre->sr = pre->next_sr;
+        pre->n_ch = pre->next_n_ch;
+        pre->bps = pre->next_bps;
+        pre->head = 0;
+        pre->n_frames = 0;
+        pre->frame_bytes = AUDIO_FRAME_LEN * wav_pack_frame_size(pre->n_ch, pre->bps);
+        if(pre->frame_bytes != 0 && pre->sr != 0){
+            uint32_t want = (pre->seconds * pre->sr + AUDIO_FRAME_LEN - 1) / AUDIO_FRAME_LEN;
+            uint32_t cap = REC_PREROLL_MAX_BYTES / pre->frame_bytes;
+            pre->n_frames = want < cap ? want : cap;
+        }
+        pre->reconfig = 0;
+    }
+    if(pre->n_frames == 0) return;
+    uint8_t* dst = &pre->mem[(pre->head % pre->n_frames) * pre->frame_bytes];
+    wav_pack_frames(data, dst, len, pre->n_ch, pre->bps);
+    pre->head++;
+}
+
+static void rec_log_overrun(uint32_t len){
+    rec_gaps_t* g = &rec.gaps;
+    uint64_t pos = audio_get_stats().samples_read;
+    if(g->n_ovf > 0){
+        audio_dropout_t* last = &g->ovf[(g->n_ovf - 1) % REC_GAP_LOG_N];
+        if(last->pos + last->len == pos){
+            last->len += len;
+            return;
+        }
+    }
+    if(g->n_ovf >= REC_GAP_LOG_N){
+        g->n_ovf++;             // counted, but not logged
+        return;
+    }
+    g->ovf[g->n_ovf].pos = pos;
+    g->ovf[g->n_ovf].len = len;
+    g->n_ovf++;
+}
+
+e_syserr_t rec_write_log(const char* wav_fname){
+    if(wav_fname == NULL) return e_syserr_null;
+    rec_gaps_t* g = &rec.gaps;
+    audio_dropout_t i2s[AUDIO_DROPOUT_LOG_N];
+    uint32_t n_i2s = audio_get_dropouts(g->i2s_since, i2s, AUDIO_DROPOUT_LOG_N);
+    uint32_t n_ovf = g->n_ovf < REC_GAP_LOG_N ? g->n_ovf : REC_GAP_LOG_N;
+
+    char fname[__WAV_FN_LEN];
+    uint32_t flen = strlen(wav_fname);
+    if(flen + 1 > sizeof(fname)) return e_syserr_too_long;
+    strcpy(fname, wav_fname);
+    char* ext = strrchr(fname, '.');
+    if(ext == NULL || strchr(ext, '/') != NULL) ext = &fname[flen];
+    if((uint32_t)(ext - fname) + sizeof(REC_GAP_LOG_EXT) > sizeof(fname)) return e_syserr_too_long;
+    strcpy(ext, REC_GAP_LOG_EXT);
+
+    FILE* f = sd_stream_open(fname, "w");
+    if(f == NULL) return e_syserr_file_generic;
+    // both lists are ordered on the sample clock, merge them into file positions
+    uint64_t lost = 0;
+    uint32_t io = 0, ii = 0;
+    uint32_t points_w;
+    e_syserr_t e = e_syserr_none;
+    char line[REC_GAP_LOG_LINE_LEN];
+    while((io < n_ovf || ii < n_i2s) && e == e_syserr_none){
+        uint8_t take_ovf = (ii >= n_i2s) || (io < n_ovf && g->ovf[io].pos <= i2s[ii].pos);
+        audio_dropout_t* d = take_ovf ? &g->ovf[io++] : &i2s[ii++];
+        uint64_t clk = d->pos > g->clk_base ? d->pos - g->clk_base : 0;
+        // the sample clock runs at the capture rate
+        uint64_t pos = g->pre_samples + (clk > lost ? clk - lost : 0) / rec.dec.m;
+        if(take_ovf) lost += d->len;
+        int n = snprintf(line, sizeof(line), "%llu %lu %s\n",
+                         (unsigned long long)pos, (unsigned long)(d->len / rec.dec.m), take_ovf ? "ovf" : "i2s");
+        e = sd_stream_in(line, sizeof(char), n, f, &points_w);
+    }
+    if(e == e_syserr_none){
+        audio_stats_t as = audio_get_stats();
+        int n = snprintf(line, sizeof(line), "# ovf %lu (%lu samples), i2s %lu, rx_q_ovf %lu\n",
+                         (unsigned long)rec.overruns, (unsigned long)rec.dropped_samples,
+                         (unsigned long)(as.dropouts - g->i2s_since), (unsigned long)(as.rx_q_ovf - g->rx_q_since));
+        e = sd_stream_in(line, sizeof(char), n, f, &points_w);
+    }
+    sd_stream_close(f);
+    return e;
+}
+
+e_syserr_t rec_recover(uint32_t* n_fixed, uint32_t* n_removed){
+    if(n_fixed == NULL || n_removed == NULL) return e_syserr_null;
+    *n_fixed = 0;
+    *n_removed = 0;
+    if(rec.active) return e_syserr_locked;
+    DIR* dir = opendir(SDCARD_BASE_PATH);
+    if(dir == NULL) return e_syserr_file_generic;
+    struct dirent* entry;
+    char fname[SDCARD_PATH_MAX_CHAR];
+    while((entry = readdir(dir)) != NULL){
+        if(strncmp(entry->d_name, REC_RECOVER_PREFIX, strlen(REC_RECOVER_PREFIX)) != 0) continue;
+        const char* ext = strrchr(entry->d_name, '.');
+        if(ext == NULL) continue;
+        int n = snprintf(fname, sizeof(fname), "%s/%s", SDCARD_BASE_PATH, entry->d_name);
+        if(n < 0 || (uint32_t)n >= sizeof(fname)) continue;
+        uint8_t fixed = 0;
+        uint64_t data_bytes = 0;
+        e_syserr_t e = e_syserr_param;
+        // foreign or damaged headers are left alone
+        if(strcmp(ext, ".wav") == 0) e = wav_recover(fname, &fixed, &data_bytes);
+        else if(strcmp(ext, ".flac") == 0) e = flac_recover(fname, &fixed, &data_bytes);
+        if(e != e_syserr_none) continue;
+        if(data_bytes == 0){
+            // a segment opened ahead of a split that never came, or a take cut before its first checkpoint
+            if(sd_delete_file(fname) == e_syserr_none) (*n_removed)++;
+            continue;
+        }
+        *n_fixed += fixed;
+    }
+    closedir(dir);
+    return e_syserr_none;
+}
+
+e_syserr_t rec_get_error(void){
+    return rec.err;
+}
+
+rec_stats_t rec_get_stats(void){
+    rec_stats_t s;
+    s.frames_in = rec.frames_in;
+    s.frames_out = rec.frames_out;
+    s.overruns = rec.overruns;
+    s.dropped_samples = rec.dropped_samples;
+    s.fill_cur = ringbuf_fill(&rec.ring);
+    s.fill_max = rec.ring.fill_max;
+    s.n_slots = rec.ring.n_slots;
+    uint32_t sr = rec.sr ? rec.sr : AUDIO_SR_DEFAULT;
+    s.depth_ms = (uint32_t)((uint64_t)s.n_slots * AUDIO_FRAME_LEN * 1000 / sr);
+    s.preroll_ms = rec.pre.flushed_ms;
+    s.i2s_dropouts = audio_get_stats().dropouts - rec.gaps.i2s_since;
+    s.segments = rec.segments;
+    s.checkpoints = rec.checkpoints;
+    return s;
+}
+
+e_syserr_t rec_budget_check(uint8_t fmt, uint16_t numChannels, uint32_t sr, uint16_t bitsPerSample, uint8_t decim){
+    if(!AUDIO_SR_VALID(sr) || !DSP_FR1_DECIM_VALID(decim)) return e_syserr_param;
+    if(!WAV_FMT_VALID(fmt) || !wav_writer_bps_valid(fmt, bitsPerSample)) return e_syserr_param;
+    cfg_sd_budget_t b = cfg_get_sd_budget();
+    if(b.serial == 0 || b.serial != sd_get_card_serial() || rec.ring.n_slots == 0) return e_syserr_uninitialized;
+    // one second of the file, FLAC is bounded by verbatim frames
+    uint64_t need = wav_writer_max_bytes(fmt, numChannels, bitsPerSample, sr / decim);
+    uint64_t have = (uint64_t)b.kbps * 1024 * REC_BUDGET_MARGIN_PCT / 100;
+    // the ring fills at the capture rate while the card stalls
+    uint64_t ring_us = (uint64_t)rec.ring.n_slots * AUDIO_FRAME_LEN * 1000000 / sr;
+    if(need > have || (uint64_t)b.max_us * 100 > ring_us * REC_BUDGET_MARGIN_PCT) return e_syserr_prohibited;
+    return e_syserr_none;
+}
+
+e_syserr_t rec_budget_measure(uint32_t mb, cfg_sd_budget_t* b){
+    if(b == NULL) return e_syserr_null;
+    if(rec.active || rec.w != NULL) return e_syserr_locked;
+    // a take writes whole stages into a preallocated file, the closest benchmark cell is its budget
+    uint32_t chunk = SDCARD_BENCH_CHUNK_MIN;
+    while(chunk * 2 <= SDCARD_WSTREAM_STAGE_SIZE && chunk * 2 <= SDCARD_BENCH_CHUNK_MAX) chunk *= 2;
+    sd_bench_row_t row;
+    e_syserr_t e = sd_bench(chunk, 1, mb, &row);
+    if(e != e_syserr_none) return e;
+    b->serial = sd_get_card_serial();
+    b->kbps = row.write_kbps;
+    b->max_us = row.write_max_us;
+    if(b->kbps == 0) return e_syserr_driver_fail;
+    return cfg_set_sd_budget(*b);
+}
+
+e_syserr_t rec_budget_max(uint16_t numChannels, uint32_t* sr, uint16_t* bitsPerSample){
+    if(sr == NULL || bitsPerSample == NULL) return e_syserr_null;
+    static const uint32_t rates[] = {AUDIO_SR_96000, AUDIO_SR_48000, AUDIO_SR_44100};
+    static const uint16_t depths[] = {32, 24, 16};
+    *sr = 0;
+    *bitsPerSample = 0;
+    for(uint8_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++){
+        for(uint8_t j = 0; j < sizeof(depths) / sizeof(depths[0]); j++){
+            e_syserr_t e = rec_budget_check(e_wav_fmt_pcm, numChannels, rates[i], depths[j], 1);
+            if(e == e_syserr_prohibited) continue;
+            if(e == e_syserr_none){
+                *sr = rates[i];
+                *bitsPerSample = depths[j];
+            }
+            return e;
+        }
+    }
+    return e_syserr_none;
+}
+
+static e_syserr_t rec_write(const uint8_t* data, uint32_t bytes){
+    wav_writer_t* w = rec.w;
+    while(bytes > 0){
+        uint32_t n = bytes;
+        if(rec.seg_units != 0){
+            uint64_t left = (rec.seg_units - rec.seg_done) * w->unit_bytes;
+            if(n > left) n = (uint32_t)left;
+        }
+        e_syserr_t e = wav_writer_write_block(w, data, n);
+        if(e != e_syserr_none) return e;
+        rec.seg_done += n / w->unit_bytes;
+        data += n;
+        bytes -= n;
+        if((rec.seg_units != 0 && rec.seg_done >= rec.seg_units) ||
+           (rec.seg_bytes != 0 && wav_writer_size(w) >= rec.seg_bytes)){
+            e = wav_writer_next(w);
+            if(e != e_syserr_none) return e;
+            rec.seg_done = 0;
+            rec.segments++;
+            rec.ckpt_tick = xTaskGetTickCount();    // the finished file is final, the new one is empty
+            // the ring still has slack right after the switch, open the following file now
+            e = wav_writer_prepare_next(w);
+            if(e != e_syserr_none) return e;
+        }
+    }
+    return e_syserr_none;
+}
+
+static void rec_checkpoint(TickType_t period){
+    wav_writer_t* w = rec.w;
+    // a stopping take is finalized by its owner, no commit in between
+    if(w == NULL || !rec.active || rec.err != e_syserr_none) return;
+    TickType_t now = xTaskGetTickCount();
+    if(now - rec.ckpt_tick < period) return;
+    rec.ckpt_tick = now;
+    e_syserr_t e = wav_writer_checkpoint(w);
+    if(e != e_syserr_none){
+        rec.err = e;
+        return;
+    }
+    rec.checkpoints++;
+}
+
+static void rec_preroll_flush(void){
+    rec_preroll_t* pre = &rec.pre;
+    pre->pending = 0;
+    uint32_t count = pre->head < pre->n_frames ? pre->head : pre->n_frames;
+    uint32_t first = (pre->head - count) % pre->n_frames;
+    uint32_t run = count < pre->n_frames - first ? count : pre->n_frames - first;
+    uint32_t frames_per_run[2] = {run, count - run};
+    uint8_t* runs[2] = {&pre->mem[first * pre->frame_bytes], pre->mem};
+    for(uint8_t i = 0; i < 2 && rec.err == e_syserr_none; i++){
+        if(frames_per_run[i] == 0) continue;
+        uint32_t bytes = frames_per_run[i] * pre->frame_bytes;
+        e_syserr_t e = rec_write(runs[i], bytes);
+        if(e != e_syserr_none) rec.err = e;
+    }
+    pre->flushed_ms = (uint32_t)((uint64_t)count * AUDIO_FRAME_LEN * 1000 / pre->sr);
+    rec.gaps.pre_samples = count * AUDIO_FRAME_LEN;
+    // the content now belongs to this take, start over on the next idle
+    pre->next_sr = pre->sr;
+    pre->next_n_ch = pre->n_ch;
+    pre->next_bps = pre->bps;
+    pre->reconfig = 1;
+}
+
+static void rec_writer_task(void* p){
+    while(1){
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(REC_WRITER_IDLE_MS));
+        uint32_t len;
+        uint8_t* slot;
+        while((slot = ringbuf_peek(&rec.ring, &len)) != NULL){
+            // a committed slot means the audio task left idle, the pre-roll is stable
+            if(rec.pre.pending && rec.w != NULL) rec_preroll_flush();
+            wav_writer_t* w = rec.w;
+            if(w != NULL && rec.err == e_syserr_none && len > 0){
+                e_syserr_t e = rec_write(slot, len);
+                if(e != e_syserr_none) rec.err = e;
+            }
+            ringbuf_release(&rec.ring);
+            rec.frames_out++;
+            // a writer that never catches up still commits, just later
+            rec_checkpoint(pdMS_TO_TICKS(2 * REC_CHECKPOINT_MS));
+        }
+        rec_checkpoint(pdMS_TO_TICKS(REC_CHECKPOINT_MS));
+        if(rec.draining){
+            if(rec.pre.pending && rec.w != NULL) rec_preroll_flush();
+            rec.draining = 0;
+            xSemaphoreGive(rec.drained);
+        }
+    }
+}
@@ -0,0 +1,218 @@
+/// @file recorder.h
+/// @brief
+/*
+Decoupled recording back end. The audio task only enqueues frames into
+an SPSC ring held in PSRAM, a dedicated writer task pinned to the other
+core drains the ring into the open take. SD stalls (FAT cluster
+allocation, card housekeeping) are absorbed by the ring instead of the
+8x512 I2S DMA queue. The file format is hidden behind `wav_writer_t`:
+its `encode` step runs in place on the audio task (PCM packing, IMA-ADPCM),
+its `write_block` step on the writer task (FLAC keeps the frames unpacked
+in the ring and encodes there, away from the capture core).
+
+Takes can be split into segments by size or duration. The writer task
+cuts the stream on a unit boundary of the format and continues in the next
+file, which was opened ahead of time. The ring absorbs the header rewrite,
+no frame is dropped and the segments concatenate to the whole take.
+
+Every `REC_CHECKPOINT_MS` the writer commits the data and rewrites the
+header through the open file, preferably once it has caught up with the
+ring. A power loss costs at most the audio since the last checkpoint,
+`rec_recover()` finalizes such takes on the next boot.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include "syserr.h"
+#include "audio.h"
+#include "wav_writer.h"
+#include "ringbuf.h"
+#include "dsp_fr1_decim.h"
+#include "config.h"
+
+#define REC_WRITER_TASK_NAME    "recw"
+#define REC_WRITER_TASK_MEM     (6144)  // FLAC encoding runs on this stack
+#define REC_WRITER_TASK_PRIO    2
+#define REC_WRITER_CORE         0       // PRO core, Arduino/jescore jobs live on the APP core
+#define REC_WRITER_IDLE_MS      50
+#define REC_DRAIN_TIMEOUT_MS    3000
+
+#define REC_RING_SECONDS_DEFAULT 2      // guaranteed at AUDIO_SR_MAX
+#define REC_RING_SLOT_SIZE      (AUDIO_FRAME_LEN * sizeof(stereo_sample_t))
+#define REC_RING_SLOT_ALIGN     SDCARD_PAGE_SIZE_BYTE
+#define REC_RING_FALLBACK_SLOTS 8       // internal RAM if PSRAM is unavailable
+
+/*
+Slots are lent to the I2S reader, metered and packed in place and
+handed to the file's write stream. SPI DMA can't reach PSRAM on the
+ESP32, so the direct stream (see `sd_wstream_open()`) copies PSRAM slots
+into its DMA-capable stage. Define REC_RING_IN_DMA_RAM to trade ring
+depth for slots in DMA-capable internal RAM (REC_RING_DMA_SLOTS slots are
+allocated), whole sectors then go to the card straight from the slot.
+That only holds while every slot is a sector multiple: decimated frames
+(e.g. 341 samples of 3 byte at -d 3) leave the file position inside a
+sector and are staged like PSRAM slots.
+*/
+#ifdef REC_RING_IN_DMA_RAM
+#ifndef REC_RING_DMA_SLOTS
+#define REC_RING_DMA_SLOTS      8
+#endif
+#endif
+
+#define REC_PREROLL_MAX_BYTES   (1024 * 1024)   // PSRAM arena, caps the seconds at high rates
+
+#define REC_CHECKPOINT_MS       5000    // header commit period of the open take
+#define REC_RECOVER_PREFIX      "fr1_rec_"  // only takes of the recorder are recovered
+
+#define REC_GAP_LOG_N           32      // ring overrun events kept per take
+#define REC_GAP_LOG_EXT         ".txt"  // sidecar next to the audio file
+#define REC_GAP_LOG_LINE_LEN    64
+
+#define REC_BUDGET_MARGIN_PCT   70      // share of the benchmarked card rate and ring depth a take may use
+
+/// @brief Recorder health counters.
+typedef struct rec_stats_t{
+    uint32_t frames_in;         // frames enqueued by the audio task
+    uint32_t frames_out;        // frames written by the writer task
+    uint32_t overruns;          // frames dropped because the ring was full
+    uint32_t dropped_samples;   // samples lost to overruns
+    uint32_t fill_cur;          // current fill level in slots
+    uint32_t fill_max;          // highest fill level in slots since start
+    uint32_t n_slots;           // ring capacity in slots
+    uint32_t depth_ms;          // ring capacity in ms at the active rate
+    uint32_t preroll_ms;        // pre-roll flushed to the head of the file
+    uint32_t i2s_dropouts;      // capture gaps detected by the audio sample clock during the take
+    uint32_t segments;          // files finished by splitting during the take
+    uint32_t checkpoints;       // header commits during the take
+}rec_stats_t;
+
+/// @brief Allocate the ring and the pre-roll arena and launch the writer task.
+/// @param ring_seconds Ring depth in seconds at `AUDIO_SR_MAX`.
+/// @param preroll_seconds Pre-roll length in seconds, 0 disables it.
+/// @return FR1 error code.
+/// @note A missing PSRAM only disables the pre-roll, it is not an error.
+e_syserr_t rec_init(uint32_t ring_seconds, uint32_t preroll_seconds);
+
+/// @brief Initialize the recorder with default parameters.
+/// @return FR1 error code.
+/// @note Is part of the common signature interface for the init routine.
+e_syserr_t rec_init_default(void);
+
+/// @brief Bind an opened take to the writer and reset the counters.
+/// If the pre-roll matches the packed PCM format of the take, the writer puts it in front of the first frame.
+/// @param w Opened writer (see `wav_writer_open()`). Must stay valid until `rec_stop()`.
+/// @param sr Active capture rate, used for the stats only.
+/// @param decim Decimation factor between capture and file (1 to `DSP_FR1_DECIM_MAX`).
+/// The pre-roll is kept at the capture rate and is skipped for decimated takes.
+/// @param preroll 1 if the take starts straight from idle, the pre-roll then ends right
+/// before the first frame. 0 skips it, its content is not contiguous with the take.
+/// @return FR1 error code.
+/// @note Call this before the audio task starts enqueueing.
+e_syserr_t rec_start(wav_writer_t* w, uint32_t sr, uint8_t decim, uint8_t preroll);
+
+/// @brief Borrow the next free ring slot as capture buffer. Never blocks.
+/// @return Slot for `AUDIO_FRAME_LEN` stereo samples or NULL on overrun (counted).
+/// @note Only call this from the audio task. The slot is owned by the caller
+/// until it is handed over with `rec_commit_frame()`.
+stereo_sample_t* rec_acquire_frame(void);
+
+/// @brief Decimate and encode a borrowed slot in place and hand it over to the writer.
+/// @param frame Slot obtained with `rec_acquire_frame()`.
+/// @param len Length of frame in stereo samples.
+/// @note Only call this from the audio task. The caller must not touch `frame` afterwards.
+void rec_commit_frame(stereo_sample_t* frame, uint32_t len);
+
+/// @brief Stop accepting frames, wait until the writer drained the ring and unbind the take.
+/// @return FR1 error code. Returns `e_syserr_locked` if the writer did not drain in time,
+/// the take then stays bound and the writer must not be closed yet. Call again to keep waiting.
+/// @note The caller still owns the writer and has to close it with `wav_writer_close()`
+/// once this returned `e_syserr_none`.
+e_syserr_t rec_stop(void);
+
+/// @brief Write the gap log of the last take next to its audio file.
+/// Every line holds `position length source` in samples of the file,
+/// `ovf` for ring overruns and `i2s` for capture gaps, followed by a summary.
+/// @param wav_fname File name of the audio file, its extension is replaced by `REC_GAP_LOG_EXT`.
+/// @return FR1 error code. A take without gaps still gets a log holding only the summary.
+/// @note Call this after `rec_stop()`. Positions are exact for overruns and
+/// estimated from the sample clock for I2S gaps. Split takes get one log next
+/// to the first segment, positions run over the concatenated segments.
+e_syserr_t rec_write_log(const char* wav_fname);
+
+/// @brief Finalize takes a power loss left open, at their last checkpoint.
+/// @param n_fixed Amount of files that were cut.
+/// @param n_removed Amount of files without audio that were deleted.
+/// @return FR1 error code.
+/// @note Call this once after mounting, before recording. Checks every
+/// `REC_RECOVER_PREFIX` file of `SDCARD_REC_EXTS` in `SDCARD_BASE_PATH`.
+/// Files left without audio (a segment opened ahead of a split that never
+/// came) are deleted instead of being kept as empty takes.
+e_syserr_t rec_recover(uint32_t* n_fixed, uint32_t* n_removed);
+
+/// @brief Set the segment limits of the next takes.
+/// @param seg_mb Maximum size of a segment in MiB, 0 disables the size limit.
+/// @param seg_s Maximum duration of a segment in seconds, 0 disables the duration limit.
+/// @note Takes effect on the next `rec_start()`. Splits land on whole units of the format:
+/// duration splits are exact for PCM and FLAC, ADPCM segments are rounded down to whole
+/// blocks (`WAV_ADPCM_SAMPLES_PER_BLOCK`). Size splits happen at the end of the slot that
+/// reached the limit for FLAC.
+void rec_split_set(uint32_t seg_mb, uint32_t seg_s);
+
+/// @brief Set the pre-roll length.
+/// @param seconds Pre-roll length in seconds, 0 disables it.
+/// @note Takes effect on the next `rec_preroll_format()`.
+void rec_preroll_set(uint32_t seconds);
+
+/// @brief Set the format the pre-roll is kept in and drop its content.
+/// @param sr Active sample rate.
+/// @param numChannels Number of audio channels.
+/// @param bitsPerSample Sample resolution.
+/// @note Call this whenever idle is entered, before feeding. A later `rec_start()`
+/// only flushes the pre-roll if the take is packed PCM of the same format.
+void rec_preroll_format(uint32_t sr, uint16_t numChannels, uint16_t bitsPerSample);
+
+/// @brief Pack a frame into the circular pre-roll, overwriting the oldest one.
+/// @param data Audio frame.
+/// @param len Length of frame in stereo samples, must be `AUDIO_FRAME_LEN`.
+/// @note Only call this from the audio task while idle.
+void rec_preroll_feed(const stereo_sample_t* data, uint32_t len);
+
+/// @brief Get the first error the writer task ran into since `rec_start()`.
+/// @return FR1 error code.
+e_syserr_t rec_get_error(void);
+
+/// @brief Get a snapshot of the recorder counters.
+/// @return Recorder stats (by value).
+rec_stats_t rec_get_stats(void);
+
+/// @brief Check a format against the benchmarked write budget of the mounted card.
+/// The take may need up to `REC_BUDGET_MARGIN_PCT` of the measured rate, the
+/// slowest measured write may take up to that share of the ring depth.
+/// @param fmt File format (`e_wav_fmt_t`).
+/// @param numChannels Number of audio channels.
+/// @param sr Capture rate.
+/// @param bitsPerSample Sample resolution.
+/// @param decim Decimation factor between capture and file.
+/// @return FR1 error code. Returns `e_syserr_prohibited` if the format exceeds the
+/// budget and `e_syserr_uninitialized` if the card was never benchmarked (`rec_budget_measure()`).
+e_syserr_t rec_budget_check(uint8_t fmt, uint16_t numChannels, uint32_t sr, uint16_t bitsPerSample, uint8_t decim);
+
+/// @brief Benchmark the recording path of the mounted card and persist it as its budget.
+/// @param mb MiB to write, up to `SDCARD_BENCH_MB_MAX`.
+/// @param b Measured budget.
+/// @return FR1 error code. Returns `e_syserr_locked` while a take is bound.
+/// @note Runs `sd_bench()` on a preallocated file with the largest chunk up to
+/// `SDCARD_WSTREAM_STAGE_SIZE`, the way a take writes. Replaces the budget of any previous card.
+e_syserr_t rec_budget_measure(uint32_t mb, cfg_sd_budget_t* b);
+
+/// @brief Find the highest packed PCM format within the budget of the mounted card.
+/// @param numChannels Number of audio channels.
+/// @param sr Highest capture rate that fits, 0 if none does.
+/// @param bitsPerSample Highest resolution that fits at `sr`.
+/// @return FR1 error code, see `rec_budget_check()`.
+/// @note Uses the current ring depth, call it after `rec_init()`.
+e_syserr_t rec_budget_max(uint16_t numChannels, uint32_t* sr, uint16_t* bitsPerSample);
+
+#endif // _RECORDER_H_
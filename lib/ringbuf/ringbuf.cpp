@@ -0,0 +1,79 @@
+#include "ringbuf.h"
+#include "esp_heap_caps.h"
+#include <string.h>
+
+#define RINGBUF_LOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define RINGBUF_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+e_syserr_t ringbuf_init(ringbuf_t* rb, uint32_t n_slots, uint32_t slot_size, uint32_t align, uint32_t caps){
+    if(rb == NULL) return e_syserr_null;
+    if(n_slots == 0 || slot_size == 0) return e_syserr_param;
+    if(align == 0 || (align & (align - 1)) != 0) return e_syserr_param;
+    memset(rb, 0, sizeof(ringbuf_t));
+    slot_size = (slot_size + align - 1) & ~(align - 1);
+    rb->mem = (uint8_t*)heap_caps_aligned_alloc(align, n_slots * slot_size, caps);
+    if(rb->mem == NULL) return e_syserr_oom;
+    rb->slot_len = (uint32_t*)heap_caps_calloc(n_slots, sizeof(uint32_t), MALLOC_CAP_INTERNAL);
+    if(rb->slot_len == NULL){
+        heap_caps_free(rb->mem);
+        rb->mem = NULL;
+        return e_syserr_oom;
+    }
+    rb->n_slots = n_slots;
+    rb->slot_size = slot_size;
+    return e_syserr_none;
+}
+
+void ringbuf_deinit(ringbuf_t* rb){
+    if(rb == NULL) return;
+    heap_caps_free(rb->mem);
+    heap_caps_free(rb->slot_len);
+    memset(rb, 0, sizeof(ringbuf_t));
+}
+
+void ringbuf_reset(ringbuf_t* rb){
+    RINGBUF_STORE(&rb->head, 0);
+    RINGBUF_STORE(&rb->tail, 0);
+    rb->fill_max = 0;
+}
+
+uint8_t* ringbuf_acquire(ringbuf_t* rb){
+    uint32_t head = rb->head;
+    uint32_t tail = RINGBUF_LOAD(&rb->tail);
+    if(head - tail >= rb->n_slots) return NULL;
+    return &rb->mem[(head % rb->n_slots) * rb->slot_size];
+}
+
+void ringbuf_commit(ringbuf_t* rb, uint32_t len){
+    uint32_t head = rb->head;
+    rb->slot_len[head % rb->n_slots] = len;
+    RINGBUF_STORE(&rb->head, head + 1);
+    uint32_t fill = head + 1 - RINGBUF_LOAD(&rb->tail);
+    if(fill > rb->fill_max) rb->fill_max = fill;
+}
+
+e_syserr_t ringbuf_push(ringbuf_t* rb, const void* data, uint32_t len){
+    if(len > rb->slot_size) return e_syserr_param;
+    uint8_t* slot = ringbuf_acquire(rb);
+    if(slot == NULL) return e_syserr_oom;
+    memcpy(slot, data, len);
+    ringbuf_commit(rb, len);
+    return e_syserr_none;
+}
+
+uint8_t* ringbuf_peek(ringbuf_t* rb, uint32_t* len){
+    uint32_t tail = rb->tail;
+    uint32_t head = RINGBUF_LOAD(&rb->head);
+    if(head == tail) return NULL;
+    uint32_t idx = tail % rb->n_slots;
+    *len = rb->slot_len[idx];
+    return &rb->mem[idx * rb->slot_size];
+}
+
+void ringbuf_release(ringbuf_t* rb){
+    RINGBUF_STORE(&rb->tail, rb->tail + 1);
+}
+
+uint32_t ringbuf_fill(ringbuf_t* rb){
+    return RINGBUF_LOAD(&rb->head) - RINGBUF_LOAD(&rb->tail);
+}
@@ -0,0 +1,83 @@
+/// @file ringbuf.h
+/// @brief
+/*
+Lock-free single-producer/single-consumer ring of fixed size slots.
+The producer acquires a free slot, fills it and commits it with the
+amount of valid bytes. The consumer peeks the oldest committed slot,
+consumes it and releases it. Head and tail are free running counters,
+so no slot is wasted to tell "full" from "empty".
+
+Exactly one task may produce and exactly one task may consume.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _RINGBUF_H_
+#define _RINGBUF_H_
+
+#include <stdint.h>
+#include "syserr.h"
+
+/// @brief SPSC slot ring context.
+typedef struct ringbuf_t{
+    uint8_t* mem;               // slot arena, n_slots * slot_size bytes
+    uint32_t* slot_len;         // valid bytes per committed slot
+    uint32_t slot_size;         // capacity of one slot in bytes
+    uint32_t n_slots;           // amount of slots in arena
+    uint32_t head;              // written by producer only
+    uint32_t tail;              // written by consumer only
+    uint32_t fill_max;          // highest observed fill level in slots
+}ringbuf_t;
+
+/// @brief Allocate the slot arena and reset the ring.
+/// @param rb Empty ring context.
+/// @param n_slots Amount of slots.
+/// @param slot_size Size of a single slot in byte. Rounded up to a multiple of `align`.
+/// @param align Alignment of the arena and of every slot in byte (power of two, e.g. 512 for sectors).
+/// @param caps `heap_caps_malloc` capabilities of the arena (e.g. `MALLOC_CAP_SPIRAM`).
+/// @return FR1 error code. Returns `e_syserr_oom` if the arena can't be allocated.
+e_syserr_t ringbuf_init(ringbuf_t* rb, uint32_t n_slots, uint32_t slot_size, uint32_t align, uint32_t caps);
+
+/// @brief Free the slot arena.
+/// @param rb Ring context.
+void ringbuf_deinit(ringbuf_t* rb);
+
+/// @brief Drop all committed slots.
+/// @param rb Ring context.
+/// @note Only call this while neither producer nor consumer is active.
+void ringbuf_reset(ringbuf_t* rb);
+
+/// @brief Get the next free slot (producer side).
+/// @param rb Ring context.
+/// @return Pointer to `slot_size` writable bytes or NULL if the ring is full.
+/// @note The slot is handed to the consumer only after `ringbuf_commit()`.
+uint8_t* ringbuf_acquire(ringbuf_t* rb);
+
+/// @brief Publish the slot obtained with `ringbuf_acquire()` (producer side).
+/// @param rb Ring context.
+/// @param len Amount of valid bytes in the slot.
+void ringbuf_commit(ringbuf_t* rb, uint32_t len);
+
+/// @brief Copy data into the next free slot (producer side).
+/// @param rb Ring context.
+/// @param data Data to enqueue.
+/// @param len Length of data in byte. Must not exceed `slot_size`.
+/// @return FR1 error code. Returns `e_syserr_oom` if the ring is full.
+e_syserr_t ringbuf_push(ringbuf_t* rb, const void* data, uint32_t len);
+
+/// @brief Get the oldest committed slot (consumer side).
+/// @param rb Ring context.
+/// @param len Pointer to variable to hold the amount of valid bytes.
+/// @return Pointer to slot data or NULL if the ring is empty.
+/// @note The slot stays owned by the consumer until `ringbuf_release()`.
+uint8_t* ringbuf_peek(ringbuf_t* rb, uint32_t* len);
+
+/// @brief Return the slot obtained with `ringbuf_peek()` (consumer side).
+/// @param rb Ring context.
+void ringbuf_release(ringbuf_t* rb);
+
+/// @brief Get the amount of committed slots.
+/// @param rb Ring context.
+/// @return Fill level in slots.
+uint32_t ringbuf_fill(ringbuf_t* rb);
+
+#endif // _RINGBUF_H_
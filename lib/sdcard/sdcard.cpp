@@ -5,19 +5,94 @@
 #include "driver/spi_master.h"
 #include "driver/sdspi_host.h"
 #include "driver/gpio.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "soc/soc_memory_layout.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 #include <dirent.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "utils.h"
 #include "fsm.h"
+#include "prof_trace.h"
 
 static sdmmc_host_t host = SDSPI_HOST_DEFAULT();
 static sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
 static esp_vfs_fat_sdmmc_mount_config_t mount_config;
 static sdmmc_card_t* card;
 static uint8_t mounted = 0;
+static uint32_t cluster_bytes = 0;     // allocation unit of the mounted volume, 0 if unknown
 static spi_bus_config_t bus_cfg;
 static SemaphoreHandle_t stream_lock;
+static FIL ff_file;                    // direct FatFs access, guarded by `stream_lock`
+
+typedef struct sd_vbuf_t{
+    FILE* f;
+    uint8_t* buf;               // DMA-capable, installed with `setvbuf()`
+}sd_vbuf_t;
+
+static sd_vbuf_t vbufs[SDCARD_MAX_FILES_DEFAULT];  // buffers of open write streams, guarded by `stream_lock`
+
+struct sd_wstream_t{
+    uint8_t backend;
+    FILE* f;                    // stdio backend
+    FIL fil;                    // direct backend, only touched by the SD server
+    uint8_t* stage;             // `n_stages` batches of SDCARD_WSTREAM_STAGE_SIZE, DMA-capable, allocated on the first write
+    uint8_t n_stages;
+    uint8_t slot;               // batch being filled
+    uint8_t owned;              // the batch being filled was taken from `free`
+    uint32_t fill;              // staged bytes, they follow `pos`
+    uint32_t lim;               // stage fill that ends on a sector boundary of the file
+    uint64_t pos;               // file position of the batch being filled
+    sd_req_t req[SDCARD_WSTREAM_STAGES];
+    SemaphoreHandle_t free;     // counts the batches that are not in flight
+    volatile e_syserr_t err;    // first error of a batch written in the background
+};
+
+struct sd_rstream_t{
+    FIL fil;                    // only touched by the SD server
+    uint8_t* buf;               // SDCARD_RSTREAM_BUFS units of SDCARD_RSTREAM_BUF_SIZE, DMA-capable
+    uint8_t cur;                // unit being consumed
+    uint8_t have;               // `cur` was taken from `ready`
+    uint8_t pending;            // units in flight or filled
+    uint32_t off;               // consumed bytes of `cur`
+    uint64_t pos;               // position of the reader
+    uint64_t next;              // file position of the next read-ahead
+    sd_req_t req[SDCARD_RSTREAM_BUFS];
+    SemaphoreHandle_t ready;    // counts the filled units
+};
+
+typedef struct sd_srv_t{
+    QueueHandle_t queue;        // sd_req_t pointers
+    TaskHandle_t task;
+    sd_srv_stats_t stats;
+}sd_srv_t;
+
+static sd_srv_t srv;
+
+typedef struct sd_stats_ctx_t{
+    sd_stats_t st;              // percentiles are filled in by `sd_stats_get()`
+    uint32_t slices[SDCARD_STATS_WIN_SLICES];  // bytes per slice of the rate window
+    uint8_t slice;              // slice being filled
+    uint32_t filled;            // closed slices since the window (re)started
+    int64_t slice_t0;           // start of the slice being filled
+}sd_stats_ctx_t;
+
+static sd_stats_ctx_t stats;    // written by the SD server and stdio writers
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/// @brief Account one write of the instrumentation, `t0` is the time of the call.
+static void sd_stats_record(uint32_t bytes, int64_t t0);
+
+/// @brief Move the rate window up to `now`, closing the slices on the way.
+/// @note Call with `stats_mux` held.
+static void sd_stats_advance(int64_t now);
+
+/// @brief SD server task. Executes the queued requests in order.
+/// @param p Unused.
+/// @note Runs pinned to `SDCARD_SRV_CORE`, outside of jescore.
+static void sd_srv_task(void* p);
 
 e_syserr_t sd_init(int32_t max_files, uint32_t max_freq_khz){
     if(max_freq_khz > SDMMC_FREQ_52M) return e_syserr_param;
@@ -33,7 +108,7 @@ e_syserr_t sd_init(int32_t max_files, uint32_t max_freq_khz){
     bus_cfg.sclk_io_num = PIN_SDSPI_SCK;
     bus_cfg.quadwp_io_num = -1;
     bus_cfg.quadhd_io_num = -1;
-    bus_cfg.max_transfer_sz = 4000;
+    bus_cfg.max_transfer_sz = SDCARD_SPI_MAX_TRANSFER_SZ;
 
     mount_config.format_if_mount_failed = false;
     mount_config.max_files = max_files;
@@ -47,6 +122,18 @@ e_syserr_t sd_init(int32_t max_files, uint32_t max_freq_khz){
         return e_syserr_driver_fail;
     }
     stream_lock = xSemaphoreCreateMutex();
+    if(srv.task == NULL){
+        srv.queue = xQueueCreate(SDCARD_SRV_QUEUE_LEN, sizeof(sd_req_t*));
+        if(srv.queue == NULL) return e_syserr_oom;
+        BaseType_t rt = xTaskCreatePinnedToCore(sd_srv_task,
+                                                SDCARD_SRV_TASK_NAME,
+                                                SDCARD_SRV_TASK_MEM,
+                                                NULL,
+                                                SDCARD_SRV_TASK_PRIO,
+                                                &srv.task,
+                                                SDCARD_SRV_CORE);
+        if(rt != pdPASS) return e_syserr_oom;
+    }
     jes_err_t je;
     je = jes_register_job(SDCARD_SERVER_JOB_NAME, 2*4096, 1, sd_job, 0);
     if(je != e_err_no_err) { jes_throw_error(je); return (e_syserr_t)je;}
@@ -57,7 +144,8 @@ e_syserr_t sd_init_default(){
     return sd_init(SDCARD_MAX_FILES_DEFAULT, SDCARD_MAX_FREQ_BUS_DEFAULT);
 }
 
-e_syserr_t sd_mnt(){
+/// @brief Mount the card, SD server side of `sd_mnt()`.
+static e_syserr_t sd_mnt_now(void){
     if (mounted) return e_syserr_none;
     esp_err_t ret = esp_vfs_fat_sdspi_mount(
         SDCARD_BASE_PATH,
@@ -68,10 +156,18 @@ e_syserr_t sd_mnt(){
     );
     if (ret != ESP_OK) return e_syserr_driver_fail;
     mounted = 1;
+    // stdio buffers are sized to it on every open, read it once here
+    FATFS *fs;
+    DWORD fre_clust;
+    cluster_bytes = 0;
+    if (f_getfree(SDCARD_FF_DRIVE, &fre_clust, &fs) == FR_OK) {
+        cluster_bytes = fs->csize * card->csd.sector_size;
+    }
     return e_syserr_none;
 }
 
-e_syserr_t sd_unmnt(){
+/// @brief Unmount the card, SD server side of `sd_unmnt()`.
+static e_syserr_t sd_unmnt_now(void){
     if (!mounted) return e_syserr_none;
     esp_err_t stat = esp_vfs_fat_sdcard_unmount(SDCARD_BASE_PATH, card);
     if(stat != ESP_OK) return e_syserr_driver_fail;
@@ -81,6 +177,20 @@ e_syserr_t sd_unmnt(){
     return e_syserr_none;
 }
 
+e_syserr_t sd_mnt(){
+    if (mounted) return e_syserr_none;
+    sd_req_t r = {};
+    r.cmd = sd_cmd_mnt;
+    return sd_srv_call(&r);
+}
+
+e_syserr_t sd_unmnt(){
+    if (!mounted) return e_syserr_none;
+    sd_req_t r = {};
+    r.cmd = sd_cmd_unmnt;
+    return sd_srv_call(&r);
+}
+
 uint8_t sd_is_mounted(void){
     return mounted;
 }
@@ -94,11 +204,23 @@ e_syserr_t sd_get_free_kbytes(uint32_t* free_bytes, uint32_t* all_bytes){
     if(res != FR_OK) return e_syserr_driver_fail;
     
     uint32_t bytes_per_cluster = fs->csize * card->csd.sector_size;
-    *free_bytes = (uint32_t)fre_clust * bytes_per_cluster / 1024;
-    *all_bytes = (uint32_t)(fs->n_fatent - 2) * bytes_per_cluster / 1024;
+    // cards beyond 4 GiB overflow 32 bit byte counts, only the KiB fit
+    *free_bytes = (uint32_t)((uint64_t)fre_clust * bytes_per_cluster / 1024);
+    *all_bytes = (uint32_t)((uint64_t)(fs->n_fatent - 2) * bytes_per_cluster / 1024);
     return e_syserr_none;
 }
 
+uint64_t sd_get_file_size_max(void){
+    #if FF_FS_EXFAT
+    FATFS *fs;
+    DWORD fre_clust;
+    if (mounted && f_getfree("0:", &fre_clust, &fs) == FR_OK && fs->fs_type == FS_EXFAT) {
+        return UINT64_MAX;
+    }
+    #endif
+    return SDCARD_FAT32_FILE_SIZE_MAX;
+}
+
 e_syserr_t sd_create_file(const char* path) {
     if (!mounted) return e_syserr_sdcard_unmnted;
     FILE* file = fopen(path, "w");
@@ -167,23 +289,27 @@ e_syserr_t sd_read_txt(char* data, uint32_t len, const char* fname, uint32_t pos
     return e;
 }
 
-e_syserr_t sd_stream_in(stereo_sample_t* data, uint32_t len, FILE* f, uint32_t* points_w){
+e_syserr_t sd_stream_in(const void* data, uint16_t type_size, uint32_t len, FILE* f, uint32_t* points_w){
     if (!mounted) return e_syserr_sdcard_unmnted;    // TODO: should this be checked every time?
     if (f == NULL) return e_syserr_file_generic;    // TODO: should this be checked every time?
+    int64_t t0 = esp_timer_get_time();
+    PROF_TRACE_BEGIN(e_prof_trace_sd_write, (type_size * len) / 1024);
     xSemaphoreTake(stream_lock, portMAX_DELAY);
-    *points_w = fwrite(data, sizeof(stereo_sample_t), len, f);
+    *points_w = fwrite(data, type_size, len, f);
     xSemaphoreGive(stream_lock);
+    PROF_TRACE_END(e_prof_trace_sd_write, (*points_w * type_size) / 1024);
+    sd_stats_record(*points_w * type_size, t0);
     if(*points_w != len) { 
         return e_syserr_oom; 
     }
     return e_syserr_none;
 }
 
-e_syserr_t sd_stream_out(stereo_sample_t* data, uint32_t len, FILE* f, uint32_t* points_r){
+e_syserr_t sd_stream_out(void* data, uint16_t type_size, uint32_t len, FILE* f, uint32_t* points_r){
     if (!mounted) return e_syserr_sdcard_unmnted;    // TODO: should this be checked every time?
     if (f == NULL) return e_syserr_file_generic;    // TODO: should this be checked every time?
     xSemaphoreTake(stream_lock, portMAX_DELAY);
-    *points_r = fread(data, sizeof(stereo_sample_t), len, f);
+    *points_r = fread(data, type_size, len, f);
     xSemaphoreGive(stream_lock);
     if(*points_r != len) { 
         return e_syserr_oom; 
@@ -203,15 +329,876 @@ FILE* sd_stream_read_open(const char* fname){
     return f;
 }
 
+uint32_t sd_stream_buf_size(void){
+    if (!mounted) return 0;
+    if (SDCARD_STDIO_BUF_SIZE != 0) return SDCARD_STDIO_BUF_SIZE;
+    if (cluster_bytes == 0) return SDCARD_PAGE_SIZE_BYTE;
+    return cluster_bytes < SDCARD_STDIO_BUF_MAX ? cluster_bytes : SDCARD_STDIO_BUF_MAX;
+}
+
+/// @brief Install a DMA-capable buffer on a write stream.
+/// @note Falls back to unbuffered without memory or a free slot, the
+/// caller's buffers then go straight to FatFs.
+static void sd_stream_setvbuf(FILE* f){
+    uint32_t size = sd_stream_buf_size();
+    uint8_t* buf = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_DMA);
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < SDCARD_MAX_FILES_DEFAULT && buf != NULL; i++){
+        if (vbufs[i].f != NULL) continue;
+        if (setvbuf(f, (char*)buf, _IOFBF, size) != 0) break;
+        vbufs[i].f = f;
+        vbufs[i].buf = buf;
+        xSemaphoreGive(stream_lock);
+        return;
+    }
+    xSemaphoreGive(stream_lock);
+    heap_caps_free(buf);
+    setvbuf(f, NULL, _IONBF, 0);
+}
+
 FILE* sd_stream_write_open(const char* fname){
     if (!mounted) return NULL;
     FILE* f = fopen(fname, "ab");
+    if (f == NULL) return NULL;
+    sd_stream_setvbuf(f);
+    return f;
+}
+
+FILE* sd_stream_write_open_at(const char* fname, uint32_t pos){
+    if (!mounted) return NULL;
+    FILE* f = fopen(fname, "r+b");
+    if (f == NULL) return NULL;
+    sd_stream_setvbuf(f);
+    if (fseek(f, pos, SEEK_SET) != 0){
+        sd_stream_close(f);
+        return NULL;
+    }
     return f;
 }
 
+/// @brief Translate a VFS path into the FatFs path of the card.
+static e_syserr_t sd_ff_path(const char* fname, char* out){
+    uint32_t base = strlen(SDCARD_BASE_PATH);
+    if (strncmp(fname, SDCARD_BASE_PATH, base) != 0) return e_syserr_param;
+    if (strlen(SDCARD_FF_DRIVE) + strlen(&fname[base]) >= SDCARD_PATH_MAX_CHAR) return e_syserr_too_long;
+    strcpy(out, SDCARD_FF_DRIVE);
+    strcat(out, &fname[base]);
+    return e_syserr_none;
+}
+
+e_syserr_t sd_prealloc(const char* fname, uint64_t* bytes){
+    if (!mounted) return e_syserr_sdcard_unmnted;
+    if (fname == NULL || bytes == NULL) return e_syserr_null;
+    char path[SDCARD_PATH_MAX_CHAR];
+    e_syserr_t e = sd_ff_path(fname, path);
+    uint64_t want = *bytes;
+    *bytes = 0;
+    if (e != e_syserr_none) return e;
+    if (want > SDCARD_PREALLOC_MAX) want = SDCARD_PREALLOC_MAX;
+    FATFS *fs;
+    DWORD fre_clust;
+    if (f_getfree(SDCARD_FF_DRIVE, &fre_clust, &fs) != FR_OK) return e_syserr_driver_fail;
+    uint64_t free_bytes = (uint64_t)fre_clust * fs->csize * card->csd.sector_size;
+    if (want > free_bytes / 2) want = free_bytes / 2;   // leave room for the other files of the take
+    if (want == 0) return e_syserr_none;
+
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    FRESULT res = f_open(&ff_file, path, FA_WRITE | FA_OPEN_EXISTING);
+    if (res != FR_OK){
+        xSemaphoreGive(stream_lock);
+        return e_syserr_file_generic;
+    }
+    if (f_size(&ff_file) != 0){
+        f_close(&ff_file);
+        xSemaphoreGive(stream_lock);
+        return e_syserr_prohibited;
+    }
+    res = FR_DENIED;
+    #if FF_USE_EXPAND
+    // one contiguous run, the writes never touch the FAT again
+    res = f_expand(&ff_file, (FSIZE_t)want, 1);
+    #endif
+    if (res != FR_OK){
+        // no contiguous run (or no f_expand), allocate the chain now instead of during the take
+        res = f_lseek(&ff_file, (FSIZE_t)want);
+        want = f_size(&ff_file);   // stops short on a full card
+    }
+    FRESULT rc = f_close(&ff_file);
+    xSemaphoreGive(stream_lock);
+    if (res != FR_OK || rc != FR_OK) return e_syserr_file_generic;
+    *bytes = want;
+    return e_syserr_none;
+}
+
+e_syserr_t sd_stream_reserve(FILE* f, uint64_t* end, uint64_t need){
+    if (f == NULL || end == NULL) return e_syserr_null;
+    if (*end == 0 || need <= *end) return e_syserr_none;
+    uint64_t target = *end;
+    while (target < need) target += SDCARD_PREALLOC_CHUNK;
+    if (target > SDCARD_SEEK_MAX){
+        // out of reach for the VFS, the chain grows with the writes from here on
+        *end = 0;
+        return e_syserr_param;
+    }
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    long pos = ftell(f);
+    int ret = pos < 0 ? -1 : fseek(f, (long)target, SEEK_SET);
+    if (ret == 0) ret = fseek(f, pos, SEEK_SET);
+    xSemaphoreGive(stream_lock);
+    if (ret != 0){
+        *end = 0;
+        return e_syserr_file_generic;
+    }
+    *end = target;
+    return e_syserr_none;
+}
+
+e_syserr_t sd_stream_write_at(FILE* f, const void* data, uint32_t len, uint32_t pos){
+    if (!mounted) return e_syserr_sdcard_unmnted;
+    if (f == NULL || data == NULL) return e_syserr_null;
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    long cur = ftell(f);
+    int ret = cur < 0 ? -1 : fseek(f, pos, SEEK_SET);
+    size_t n = 0;
+    if (ret == 0){
+        n = fwrite(data, 1, len, f);
+        // the write position has to be restored even after a short write
+        ret = fseek(f, cur, SEEK_SET);
+    }
+    xSemaphoreGive(stream_lock);
+    if (ret != 0 || n != len) return e_syserr_file_generic;
+    return e_syserr_none;
+}
+
+e_syserr_t sd_file_size(const char* fname, uint64_t* size){
+    if (!mounted) return e_syserr_sdcard_unmnted;
+    if (fname == NULL || size == NULL) return e_syserr_null;
+    char path[SDCARD_PATH_MAX_CHAR];
+    e_syserr_t e = sd_ff_path(fname, path);
+    if (e != e_syserr_none) return e;
+    FILINFO fno;
+    if (f_stat(path, &fno) != FR_OK) return e_syserr_file_missing;
+    *size = fno.fsize;
+    return e_syserr_none;
+}
+
+e_syserr_t sd_truncate(const char* fname, uint64_t size){
+    if (!mounted) return e_syserr_sdcard_unmnted;
+    if (fname == NULL) return e_syserr_null;
+    char path[SDCARD_PATH_MAX_CHAR];
+    e_syserr_t e = sd_ff_path(fname, path);
+    if (e != e_syserr_none) return e;
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    FRESULT res = f_open(&ff_file, path, FA_WRITE | FA_OPEN_EXISTING);
+    if (res == FR_OK){
+        if (f_size(&ff_file) > size){
+            res = f_lseek(&ff_file, (FSIZE_t)size);
+            if (res == FR_OK) res = f_truncate(&ff_file);
+        }
+        FRESULT rc = f_close(&ff_file);
+        if (res == FR_OK) res = rc;
+    }
+    xSemaphoreGive(stream_lock);
+    return res == FR_OK ? e_syserr_none : e_syserr_file_generic;
+}
+
+/*-------------------------------- write instrumentation --------------------------------*/
+
+static void sd_stats_record(uint32_t bytes, int64_t t0){
+    int64_t now = esp_timer_get_time();
+    uint32_t us = (uint32_t)(now - t0);
+    uint8_t b = us > 1 ? 31 - __builtin_clz(us) : 0;
+    if (b >= SDCARD_STATS_BUCKETS) b = SDCARD_STATS_BUCKETS - 1;
+    portENTER_CRITICAL(&stats_mux);
+    sd_stats_advance(now);
+    sd_stats_t* st = &stats.st;
+    st->writes++;
+    st->hist[b]++;
+    if (us > st->max_us) st->max_us = us;
+    if (st->deadline_us != 0 && us > st->deadline_us) st->deadline_miss++;
+    st->bytes += bytes;
+    // a stalled write lands in the slice it returned in, the slices before stay empty
+    stats.slices[stats.slice] += bytes;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+static void sd_stats_advance(int64_t now){
+    const int64_t slice_us = SDCARD_STATS_SLICE_MS * 1000LL;
+    if (now - stats.slice_t0 >= SDCARD_STATS_IDLE_SLICES * slice_us){
+        // nobody wrote for a while, that is not a stall of the card
+        memset(stats.slices, 0, sizeof(stats.slices));
+        stats.filled = 0;
+        stats.slice_t0 = now;
+        return;
+    }
+    while (now - stats.slice_t0 >= slice_us){
+        if (++stats.filled >= SDCARD_STATS_WIN_SLICES){
+            uint64_t sum = 0;
+            for (uint8_t i = 0; i < SDCARD_STATS_WIN_SLICES; i++) sum += stats.slices[i];
+            uint32_t bps = (uint32_t)(sum * 1000 / (SDCARD_STATS_WIN_SLICES * SDCARD_STATS_SLICE_MS));
+            sd_stats_t* st = &stats.st;
+            st->bps_cur = bps;
+            if (st->windows == 0 || bps < st->bps_min) st->bps_min = bps;
+            if (bps > st->bps_max) st->bps_max = bps;
+            st->windows++;
+        }
+        stats.slice = (stats.slice + 1) % SDCARD_STATS_WIN_SLICES;
+        stats.slices[stats.slice] = 0;
+        stats.slice_t0 += slice_us;
+    }
+}
+
+/// @brief Get a latency percentile from the histogram.
+/// @return Upper bound of the bucket holding it, at most the maximum.
+static uint32_t sd_stats_pct(const sd_stats_t* st, uint32_t pct){
+    if (st->writes == 0) return 0;
+    uint32_t target = (uint32_t)(((uint64_t)st->writes * pct + 99) / 100);
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < SDCARD_STATS_BUCKETS - 1; i++){
+        sum += st->hist[i];
+        if (sum < target) continue;
+        uint32_t ub = 1UL << (i + 1);
+        return ub < st->max_us ? ub : st->max_us;
+    }
+    return st->max_us;
+}
+
+/// @brief Format one line of a stats report, shared by the CLI and the sidecar.
+/// @return Length of the line, 0 past the last one.
+static int sd_stats_line(const sd_stats_t* st, uint8_t i, char* buf, uint32_t len){
+    switch (i){
+        case 0:
+            return snprintf(buf, len, "# writes %lu p50_us %lu p99_us %lu max_us %lu",
+                            (unsigned long)st->writes, (unsigned long)st->p50_us,
+                            (unsigned long)st->p99_us, (unsigned long)st->max_us);
+        case 1:
+            return snprintf(buf, len, "# deadline_us %lu missed %lu",
+                            (unsigned long)st->deadline_us, (unsigned long)st->deadline_miss);
+        case 2:
+            return snprintf(buf, len, "# bps_cur %lu bps_min %lu bps_max %lu window_ms %u bytes %llu",
+                            (unsigned long)st->bps_cur, (unsigned long)st->bps_min, (unsigned long)st->bps_max,
+                            SDCARD_STATS_WIN_SLICES * SDCARD_STATS_SLICE_MS, (unsigned long long)st->bytes);
+        default:
+            break;
+    }
+    // then `from_us to_us count` for every bucket that was hit
+    uint8_t n = i - 3;
+    for (uint8_t b = 0; b < SDCARD_STATS_BUCKETS; b++){
+        if (st->hist[b] == 0 || n-- > 0) continue;
+        if (b == SDCARD_STATS_BUCKETS - 1){
+            return snprintf(buf, len, "%lu - %lu", 1UL << b, (unsigned long)st->hist[b]);
+        }
+        return snprintf(buf, len, "%lu %lu %lu", b ? 1UL << b : 0UL, 1UL << (b + 1), (unsigned long)st->hist[b]);
+    }
+    return 0;
+}
+
+void sd_stats_reset(uint32_t deadline_us){
+    portENTER_CRITICAL(&stats_mux);
+    memset(&stats, 0, sizeof(stats));
+    stats.st.deadline_us = deadline_us;
+    stats.slice_t0 = esp_timer_get_time();
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+sd_stats_t sd_stats_get(void){
+    portENTER_CRITICAL(&stats_mux);
+    sd_stats_t st = stats.st;
+    portEXIT_CRITICAL(&stats_mux);
+    st.p50_us = sd_stats_pct(&st, 50);
+    st.p99_us = sd_stats_pct(&st, 99);
+    return st;
+}
+
+e_syserr_t sd_stats_write(const char* fname){
+    if (!mounted) return e_syserr_sdcard_unmnted;
+    if (fname == NULL) return e_syserr_null;
+    // the sidecar's own writes are not part of the take
+    sd_stats_t st = sd_stats_get();
+    char path[SDCARD_PATH_MAX_CHAR];
+    uint32_t flen = strlen(fname);
+    if (flen + 1 > sizeof(path)) return e_syserr_too_long;
+    strcpy(path, fname);
+    char* ext = strrchr(path, '.');
+    if (ext == NULL || strchr(ext, '/') != NULL) ext = &path[flen];
+    if ((uint32_t)(ext - path) + sizeof(SDCARD_STATS_EXT) > sizeof(path)) return e_syserr_too_long;
+    strcpy(ext, SDCARD_STATS_EXT);
+
+    FILE* f = sd_stream_open(path, "w");
+    if (f == NULL) return e_syserr_file_generic;
+    char line[SDCARD_STATS_LINE_LEN];
+    uint32_t points_w;
+    e_syserr_t e = e_syserr_none;
+    int n;
+    for (uint8_t i = 0; e == e_syserr_none && (n = sd_stats_line(&st, i, line, sizeof(line) - 1)) > 0; i++){
+        if (n > (int)sizeof(line) - 2) n = sizeof(line) - 2;
+        line[n++] = '\n';
+        e = sd_stream_in(line, sizeof(char), n, f, &points_w);
+    }
+    sd_stream_close(f);
+    return e;
+}
+
+/*-------------------------------- SD server --------------------------------*/
+
+/// @brief Get the trace event of a timed request, `e_prof_trace_n` for the others.
+static inline uint8_t sd_srv_trace_evt(uint8_t cmd){
+    if (cmd == sd_cmd_write_chunk || cmd == sd_cmd_write_at) return e_prof_trace_sd_write;
+    if (cmd == sd_cmd_sync) return e_prof_trace_sd_sync;
+    return e_prof_trace_n;
+}
+
+/// @brief Execute one request on the card.
+static void sd_srv_exec(sd_req_t* r){
+    int64_t t0 = esp_timer_get_time();
+    r->xfer = 0;
+    if (r->cmd == sd_cmd_mnt){
+        r->err = sd_mnt_now();
+        return;
+    }
+    if (r->cmd == sd_cmd_unmnt){
+        r->err = sd_unmnt_now();
+        return;
+    }
+    if (!mounted){
+        r->err = e_syserr_sdcard_unmnted;
+        return;
+    }
+    FIL* fil = r->ws != NULL ? &r->ws->fil : (r->rs != NULL ? &r->rs->fil : NULL);
+    if (fil == NULL){
+        r->err = e_syserr_null;
+        return;
+    }
+    FRESULT res = FR_OK;
+    FRESULT rs = FR_OK;
+    FSIZE_t cur;
+    UINT n = 0;
+    r->err = e_syserr_none;
+    uint8_t evt = sd_srv_trace_evt(r->cmd);
+    if (evt != e_prof_trace_n){
+        PROF_TRACE_BEGIN(evt, r->len / 1024);
+    }
+    switch (r->cmd){
+        case sd_cmd_open:
+            res = f_open(fil, (const char*)r->data, r->ws != NULL ? FA_WRITE | FA_OPEN_EXISTING : FA_READ | FA_OPEN_EXISTING);
+            if (res != FR_OK) break;
+            res = f_lseek(fil, (FSIZE_t)r->pos);
+            if (res == FR_OK && f_tell(fil) != r->pos) res = FR_INVALID_PARAMETER;
+            if (res != FR_OK) f_close(fil);
+            break;
+        case sd_cmd_write_chunk:
+            // sequential batches continue at the file pointer, no seek
+            if (f_tell(fil) != r->pos) res = f_lseek(fil, (FSIZE_t)r->pos);
+            if (res == FR_OK) res = f_write(fil, r->data, r->len, &n);
+            r->xfer = n;
+            if (res == FR_OK && n != r->len) r->err = e_syserr_oom;
+            break;
+        case sd_cmd_read_chunk:
+            if (f_tell(fil) != r->pos) res = f_lseek(fil, (FSIZE_t)r->pos);
+            if (res == FR_OK) res = f_read(fil, r->data, r->len, &n);
+            r->xfer = n;
+            break;
+        case sd_cmd_write_at:
+            cur = f_tell(fil);
+            res = f_lseek(fil, (FSIZE_t)r->pos);
+            if (res == FR_OK) res = f_write(fil, r->data, r->len, &n);
+            // the write position has to be restored even after a short write
+            rs = f_lseek(fil, cur);
+            r->xfer = n;
+            if (res == FR_OK && n != r->len) res = FR_DENIED;
+            break;
+        case sd_cmd_reserve:
+            // seeking past the end allocates the chain, the data follows the old position
+            cur = f_tell(fil);
+            res = f_lseek(fil, (FSIZE_t)r->pos);
+            rs = f_lseek(fil, cur);
+            break;
+        case sd_cmd_sync:
+            res = f_sync(fil);
+            break;
+        case sd_cmd_close:
+            res = f_close(fil);
+            break;
+        default:
+            r->err = e_syserr_param;
+            return;
+    }
+    if (res != FR_OK || rs != FR_OK) r->err = e_syserr_file_generic;
+    if (evt != e_prof_trace_n){
+        PROF_TRACE_END(evt, r->xfer / 1024);
+        sd_stats_record(r->xfer, t0);
+    }
+}
+
+/// @brief Report a request as done. The caller may reuse it right after.
+static void sd_srv_complete(sd_req_t* r){
+    if (r->cmd == sd_cmd_write_chunk && r->err != e_syserr_none && r->ws->err == e_syserr_none){
+        r->ws->err = r->err;
+    }
+    srv.stats.requests++;
+    if (r->done != NULL) xSemaphoreGive(r->done);
+}
+
+static void sd_srv_task(void* p){
+    sd_req_t* batch[SDCARD_SRV_COALESCE_MAX];
+    while (1){
+        sd_req_t* r;
+        if (xQueueReceive(srv.queue, &r, portMAX_DELAY) != pdTRUE) continue;
+        uint32_t waiting = uxQueueMessagesWaiting(srv.queue) + 1;
+        if (waiting > srv.stats.queue_max) srv.stats.queue_max = waiting;
+        if (r->cmd != sd_cmd_write_chunk){
+            sd_srv_exec(r);
+            sd_srv_complete(r);
+            continue;
+        }
+        // batches that continue this one in memory and in the file go out as one burst
+        uint8_t n = 1;
+        batch[0] = r;
+        sd_req_t m = *r;
+        sd_req_t* nx;
+        while (n < SDCARD_SRV_COALESCE_MAX && xQueuePeek(srv.queue, &nx, 0) == pdTRUE &&
+               nx->cmd == sd_cmd_write_chunk && nx->ws == m.ws &&
+               nx->data == (uint8_t*)m.data + m.len && nx->pos == m.pos + m.len){
+            xQueueReceive(srv.queue, &nx, 0);
+            batch[n++] = nx;
+            m.len += nx->len;
+        }
+        int64_t t0 = esp_timer_get_time();
+        sd_srv_exec(&m);
+        srv.stats.busy_us += esp_timer_get_time() - t0;
+        srv.stats.bytes_written += m.xfer;
+        srv.stats.bursts++;
+        srv.stats.merged += n - 1;
+        uint32_t xfer = m.xfer;
+        for (uint8_t i = 0; i < n; i++){
+            batch[i]->xfer = xfer < batch[i]->len ? xfer : batch[i]->len;
+            xfer -= batch[i]->xfer;
+            batch[i]->err = m.err;
+            sd_srv_complete(batch[i]);
+        }
+    }
+}
+
+e_syserr_t sd_srv_submit(sd_req_t* r){
+    if (r == NULL) return e_syserr_null;
+    if (srv.task == NULL || xTaskGetCurrentTaskHandle() == srv.task){
+        // nobody to hand it to, or the server itself
+        sd_srv_exec(r);
+        sd_srv_complete(r);
+        return e_syserr_none;
+    }
+    if (xQueueSend(srv.queue, &r, portMAX_DELAY) != pdTRUE) return e_syserr_locked;
+    return e_syserr_none;
+}
+
+e_syserr_t sd_srv_call(sd_req_t* r){
+    if (r == NULL) return e_syserr_null;
+    StaticSemaphore_t sem;
+    r->done = xSemaphoreCreateBinaryStatic(&sem);
+    e_syserr_t e = sd_srv_submit(r);
+    if (e == e_syserr_none){
+        xSemaphoreTake(r->done, portMAX_DELAY);
+        e = r->err;
+    }
+    vSemaphoreDelete(r->done);
+    r->done = NULL;
+    return e;
+}
+
+sd_srv_stats_t sd_srv_get_stats(void){
+    return srv.stats;
+}
+
+/*-------------------------------- write stream --------------------------------*/
+
+/// @brief Limit the next batch so it ends on a sector boundary of the file.
+static inline void sd_wstream_align(sd_wstream_t* s){
+    s->lim = SDCARD_WSTREAM_STAGE_SIZE - (uint32_t)(s->pos % SDCARD_PAGE_SIZE_BYTE);
+}
+
+/// @brief Hand the staged bytes to the SD server, the next batch is filled meanwhile.
+static e_syserr_t sd_wstream_flush(sd_wstream_t* s){
+    if (s->fill == 0) return e_syserr_none;
+    sd_req_t* r = &s->req[s->slot];
+    r->cmd = sd_cmd_write_chunk;
+    r->ws = s;
+    r->rs = NULL;
+    r->data = &s->stage[s->slot * SDCARD_WSTREAM_STAGE_SIZE];
+    r->len = s->fill;
+    r->pos = s->pos;
+    r->done = s->free;
+    s->pos += s->fill;
+    s->fill = 0;
+    s->owned = 0;
+    s->slot = (s->slot + 1) % s->n_stages;
+    // a partial batch leaves the file position inside a sector, the next one realigns
+    sd_wstream_align(s);
+    return sd_srv_submit(r);
+}
+
+/// @brief Run a blocking command on the file of a direct stream.
+static e_syserr_t sd_wstream_call(sd_wstream_t* s, uint8_t cmd, const void* data, uint32_t len, uint64_t pos){
+    sd_req_t r = {};
+    r.cmd = cmd;
+    r.ws = s;
+    r.data = (void*)data;
+    r.len = len;
+    r.pos = pos;
+    return sd_srv_call(&r);
+}
+
+/// @brief Allocate the batches of a direct stream, fewer if DMA-capable RAM is short.
+static e_syserr_t sd_wstream_alloc(sd_wstream_t* s){
+    for (uint8_t n = SDCARD_WSTREAM_STAGES; n > 0 && s->stage == NULL; n--){
+        s->stage = (uint8_t*)heap_caps_malloc(n * SDCARD_WSTREAM_STAGE_SIZE, MALLOC_CAP_DMA);
+        s->n_stages = n;
+    }
+    if (s->stage == NULL) return e_syserr_oom;
+    s->free = xSemaphoreCreateCounting(s->n_stages, s->n_stages);
+    if (s->free == NULL){
+        heap_caps_free(s->stage);
+        s->stage = NULL;
+        return e_syserr_oom;
+    }
+    return e_syserr_none;
+}
+
+sd_wstream_t* sd_wstream_open(const char* fname, uint32_t pos, uint8_t backend){
+    if (!mounted || fname == NULL || backend >= e_sd_backend_n) return NULL;
+    sd_wstream_t* s = (sd_wstream_t*)heap_caps_calloc(1, sizeof(sd_wstream_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (s == NULL) return NULL;
+    s->backend = backend;
+    if (backend == e_sd_backend_stdio){
+        s->f = sd_stream_write_open_at(fname, pos);
+        if (s->f == NULL){
+            heap_caps_free(s);
+            return NULL;
+        }
+        return s;
+    }
+    char path[SDCARD_PATH_MAX_CHAR];
+    if (sd_ff_path(fname, path) != e_syserr_none ||
+        sd_wstream_call(s, sd_cmd_open, path, 0, pos) != e_syserr_none){
+        heap_caps_free(s);
+        return NULL;
+    }
+    s->err = e_syserr_none;
+    s->pos = pos;
+    sd_wstream_align(s);
+    return s;
+}
+
+e_syserr_t sd_wstream_write(sd_wstream_t* s, const void* data, uint32_t len){
+    if (s == NULL || data == NULL) return e_syserr_null;
+    if (s->backend == e_sd_backend_stdio){
+        uint32_t points_w;
+        return sd_stream_in(data, sizeof(uint8_t), len, s->f, &points_w);
+    }
+    if (s->err != e_syserr_none) return s->err;
+    if (s->stage == NULL){
+        e_syserr_t e = sd_wstream_alloc(s);
+        if (e != e_syserr_none) return e;
+    }
+    const uint8_t* src = (const uint8_t*)data;
+    while (len > 0){
+        if (s->fill == 0 && len >= SDCARD_PAGE_SIZE_BYTE &&
+            s->pos % SDCARD_PAGE_SIZE_BYTE == 0 &&
+            esp_ptr_dma_capable(src) && ((uintptr_t)src & 3) == 0){
+            // whole sectors from a buffer SPI DMA can reach, no copy but the caller owns it
+            uint32_t n = len - len % SDCARD_PAGE_SIZE_BYTE;
+            e_syserr_t e = sd_wstream_call(s, sd_cmd_write_chunk, src, n, s->pos);
+            if (e != e_syserr_none) return e;
+            s->pos += n;
+            src += n;
+            len -= n;
+            continue;
+        }
+        if (!s->owned){
+            // blocks only while every batch is in flight
+            xSemaphoreTake(s->free, portMAX_DELAY);
+            s->owned = 1;
+        }
+        uint32_t n = s->lim - s->fill;
+        if (n > len) n = len;
+        memcpy(&s->stage[s->slot * SDCARD_WSTREAM_STAGE_SIZE + s->fill], src, n);
+        s->fill += n;
+        src += n;
+        len -= n;
+        if (s->fill == s->lim){
+            e_syserr_t e = sd_wstream_flush(s);
+            if (e != e_syserr_none) return e;
+        }
+    }
+    return s->err;
+}
+
+e_syserr_t sd_wstream_write_at(sd_wstream_t* s, const void* data, uint32_t len, uint32_t pos){
+    if (s == NULL || data == NULL) return e_syserr_null;
+    if (s->backend == e_sd_backend_stdio) return sd_stream_write_at(s->f, data, len, pos);
+    if ((uint64_t)pos + len > s->pos){
+        // overlaps the staged bytes, they have to be in the file first
+        e_syserr_t e = sd_wstream_flush(s);
+        if (e != e_syserr_none) return e;
+    }
+    // queued behind the batches handed over before, it sees their data
+    return sd_wstream_call(s, sd_cmd_write_at, data, len, pos);
+}
+
+e_syserr_t sd_wstream_reserve(sd_wstream_t* s, uint64_t* end, uint64_t need){
+    if (s == NULL || end == NULL) return e_syserr_null;
+    if (s->backend == e_sd_backend_stdio) return sd_stream_reserve(s->f, end, need);
+    if (*end == 0 || need <= *end) return e_syserr_none;
+    uint64_t target = *end;
+    while (target < need) target += SDCARD_PREALLOC_CHUNK;
+    if (target > (uint64_t)(FSIZE_t)-1){
+        *end = 0;
+        return e_syserr_param;
+    }
+    // the staged bytes follow `pos`, the server seeks back before they are written
+    if (sd_wstream_call(s, sd_cmd_reserve, NULL, 0, target) != e_syserr_none){
+        *end = 0;
+        return e_syserr_file_generic;
+    }
+    *end = target;
+    return e_syserr_none;
+}
+
+e_syserr_t sd_wstream_sync(sd_wstream_t* s){
+    if (s == NULL) return e_syserr_null;
+    if (s->backend == e_sd_backend_stdio) return sd_stream_sync(s->f);
+    e_syserr_t e = sd_wstream_flush(s);
+    if (e == e_syserr_none) e = sd_wstream_call(s, sd_cmd_sync, NULL, 0, 0);
+    // queued behind every batch, their errors are known by now
+    return s->err != e_syserr_none ? s->err : e;
+}
+
+e_syserr_t sd_wstream_close(sd_wstream_t* s){
+    if (s == NULL) return e_syserr_null;
+    e_syserr_t e = e_syserr_none;
+    if (s->backend == e_sd_backend_stdio){
+        sd_stream_close(s->f);
+    }
+    else{
+        e = sd_wstream_flush(s);
+        // queued behind every batch, none is in flight once it returns
+        e_syserr_t ec = sd_wstream_call(s, sd_cmd_close, NULL, 0, 0);
+        if (e == e_syserr_none) e = s->err != e_syserr_none ? s->err : ec;
+        if (s->free != NULL) vSemaphoreDelete(s->free);
+        heap_caps_free(s->stage);
+    }
+    heap_caps_free(s);
+    return e;
+}
+
+/*-------------------------------- read stream --------------------------------*/
+
+/// @brief Queue the read of one unit at the read-ahead position.
+static e_syserr_t sd_rstream_fetch(sd_rstream_t* s, uint8_t u){
+    sd_req_t* r = &s->req[u];
+    r->cmd = sd_cmd_read_chunk;
+    r->ws = NULL;
+    r->rs = s;
+    r->data = &s->buf[u * SDCARD_RSTREAM_BUF_SIZE];
+    r->len = SDCARD_RSTREAM_BUF_SIZE;
+    r->pos = s->next;
+    r->done = s->ready;
+    s->next += SDCARD_RSTREAM_BUF_SIZE;
+    s->pending++;
+    return sd_srv_submit(r);
+}
+
+sd_rstream_t* sd_rstream_open(const char* fname, uint64_t pos){
+    if (!mounted || fname == NULL) return NULL;
+    sd_rstream_t* s = (sd_rstream_t*)heap_caps_calloc(1, sizeof(sd_rstream_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (s == NULL) return NULL;
+    s->buf = (uint8_t*)heap_caps_malloc(SDCARD_RSTREAM_BUFS * SDCARD_RSTREAM_BUF_SIZE, MALLOC_CAP_DMA);
+    s->ready = xSemaphoreCreateCounting(SDCARD_RSTREAM_BUFS, 0);
+    char path[SDCARD_PATH_MAX_CHAR];
+    sd_req_t r = {};
+    r.cmd = sd_cmd_open;
+    r.rs = s;
+    r.data = path;
+    r.pos = pos;
+    if (s->buf == NULL || s->ready == NULL ||
+        sd_ff_path(fname, path) != e_syserr_none || sd_srv_call(&r) != e_syserr_none){
+        if (s->ready != NULL) vSemaphoreDelete(s->ready);
+        heap_caps_free(s->buf);
+        heap_caps_free(s);
+        return NULL;
+    }
+    s->pos = pos;
+    s->next = pos;
+    for (uint8_t u = 0; u < SDCARD_RSTREAM_BUFS; u++) sd_rstream_fetch(s, u);
+    return s;
+}
+
+e_syserr_t sd_rstream_read(sd_rstream_t* s, void* data, uint32_t len, uint32_t* points_r){
+    if (s == NULL || data == NULL || points_r == NULL) return e_syserr_null;
+    uint8_t* dst = (uint8_t*)data;
+    *points_r = 0;
+    while (len > 0){
+        if (!s->have){
+            if (s->pending == 0) return e_syserr_file_eof;
+            xSemaphoreTake(s->ready, portMAX_DELAY);
+            s->pending--;
+            s->have = 1;
+            s->off = 0;
+        }
+        sd_req_t* r = &s->req[s->cur];
+        if (r->err != e_syserr_none) return r->err;
+        uint32_t n = r->xfer - s->off;
+        if (n > len) n = len;
+        memcpy(dst, &s->buf[s->cur * SDCARD_RSTREAM_BUF_SIZE + s->off], n);
+        s->off += n;
+        s->pos += n;
+        dst += n;
+        len -= n;
+        *points_r += n;
+        if (s->off == r->xfer){
+            // consumed, refill it behind the units already ahead unless the file ended
+            s->have = 0;
+            uint8_t more = r->xfer == SDCARD_RSTREAM_BUF_SIZE;
+            if (more) sd_rstream_fetch(s, s->cur);
+            s->cur = (s->cur + 1) % SDCARD_RSTREAM_BUFS;
+        }
+    }
+    return e_syserr_none;
+}
+
+uint64_t sd_rstream_tell(const sd_rstream_t* s){
+    return s != NULL ? s->pos : 0;
+}
+
+e_syserr_t sd_rstream_close(sd_rstream_t* s){
+    if (s == NULL) return e_syserr_null;
+    while (s->pending > 0){
+        xSemaphoreTake(s->ready, portMAX_DELAY);
+        s->pending--;
+    }
+    sd_req_t r = {};
+    r.cmd = sd_cmd_close;
+    r.rs = s;
+    e_syserr_t e = sd_srv_call(&r);
+    vSemaphoreDelete(s->ready);
+    heap_caps_free(s->buf);
+    heap_caps_free(s);
+    return e;
+}
+
+e_syserr_t sd_tput(uint8_t backend, uint32_t mb, uint32_t* kbps){
+    if (!mounted) return e_syserr_sdcard_unmnted;
+    if (kbps == NULL) return e_syserr_null;
+    if (backend >= e_sd_backend_n || mb == 0 || mb > SDCARD_TPUT_MB_MAX) return e_syserr_param;
+    *kbps = 0;
+    // same source as a take: PSRAM ring slots, internal RAM without PSRAM
+    uint8_t* buf = (uint8_t*)heap_caps_malloc(SDCARD_TPUT_CHUNK, MALLOC_CAP_SPIRAM);
+    if (buf == NULL) buf = (uint8_t*)heap_caps_malloc(SDCARD_TPUT_CHUNK, MALLOC_CAP_DMA);
+    if (buf == NULL) return e_syserr_oom;
+    for (uint32_t i = 0; i < SDCARD_TPUT_CHUNK; i++) buf[i] = (uint8_t)i;
+    uint64_t bytes = (uint64_t)mb * 1024 * 1024;
+    uint64_t reserved = bytes;
+    e_syserr_t e = sd_create_file(SDCARD_TPUT_FNAME);
+    if (e == e_syserr_none) sd_prealloc(SDCARD_TPUT_FNAME, &reserved);
+    sd_wstream_t* s = e == e_syserr_none ? sd_wstream_open(SDCARD_TPUT_FNAME, 0, backend) : NULL;
+    if (s != NULL){
+        int64_t t0 = esp_timer_get_time();
+        for (uint64_t done = 0; done < bytes && e == e_syserr_none; done += SDCARD_TPUT_CHUNK){
+            e = sd_wstream_write(s, buf, SDCARD_TPUT_CHUNK);
+        }
+        e_syserr_t ec = sd_wstream_close(s);
+        if (e == e_syserr_none) e = ec;
+        int64_t dt = esp_timer_get_time() - t0;
+        if (e == e_syserr_none && dt > 0) *kbps = (uint32_t)(bytes * 1000000 / 1024 / dt);
+    }
+    else if (e == e_syserr_none){
+        e = e_syserr_file_generic;
+    }
+    sd_delete_file(SDCARD_TPUT_FNAME);
+    heap_caps_free(buf);
+    return e;
+}
+
+e_syserr_t sd_bench(uint32_t chunk, uint8_t prealloc, uint32_t mb, sd_bench_row_t* row){
+    if (!mounted) return e_syserr_sdcard_unmnted;
+    if (row == NULL) return e_syserr_null;
+    if (chunk < SDCARD_BENCH_CHUNK_MIN || chunk > SDCARD_BENCH_CHUNK_MAX || chunk % SDCARD_PAGE_SIZE_BYTE != 0) return e_syserr_param;
+    if (mb == 0 || mb > SDCARD_BENCH_MB_MAX) return e_syserr_param;
+    memset(row, 0, sizeof(sd_bench_row_t));
+    row->chunk = chunk;
+    row->prealloc = prealloc;
+    // DMA-capable, every write is one server request of `chunk` bytes without a copy
+    uint8_t* buf = (uint8_t*)heap_caps_malloc(chunk, MALLOC_CAP_DMA);
+    if (buf == NULL) return e_syserr_oom;
+    for (uint32_t i = 0; i < chunk; i++) buf[i] = (uint8_t)i;
+    uint64_t bytes = (uint64_t)mb * 1024 * 1024;
+    uint64_t reserved = bytes;
+    e_syserr_t e = sd_create_file(SDCARD_BENCH_FNAME);
+    if (e == e_syserr_none && prealloc) e = sd_prealloc(SDCARD_BENCH_FNAME, &reserved);
+    sd_wstream_t* s = e == e_syserr_none ? sd_wstream_open(SDCARD_BENCH_FNAME, 0, e_sd_backend_direct) : NULL;
+    if (s != NULL){
+        int64_t t0 = esp_timer_get_time();
+        for (uint64_t done = 0; done < bytes && e == e_syserr_none; done += chunk){
+            int64_t t = esp_timer_get_time();
+            e = sd_wstream_write(s, buf, chunk);
+            uint32_t us = (uint32_t)(esp_timer_get_time() - t);
+            if (us > row->write_max_us) row->write_max_us = us;
+        }
+        e_syserr_t ec = sd_wstream_close(s);
+        if (e == e_syserr_none) e = ec;
+        int64_t dt = esp_timer_get_time() - t0;
+        if (e == e_syserr_none && dt > 0) row->write_kbps = (uint32_t)(bytes * 1000000 / 1024 / dt);
+    }
+    else if (e == e_syserr_none){
+        e = e_syserr_file_generic;
+    }
+    FILE* f = e == e_syserr_none ? sd_stream_read_open(SDCARD_BENCH_FNAME) : NULL;
+    if (f != NULL){
+        // no stdio buffer, every call is one FatFs read of `chunk` bytes
+        setvbuf(f, NULL, _IONBF, 0);
+        int64_t t0 = esp_timer_get_time();
+        for (uint64_t done = 0; done < bytes && e == e_syserr_none; done += chunk){
+            uint32_t points_r = 0;
+            int64_t t = esp_timer_get_time();
+            e = sd_stream_out(buf, sizeof(uint8_t), chunk, f, &points_r);
+            uint32_t us = (uint32_t)(esp_timer_get_time() - t);
+            if (us > row->read_max_us) row->read_max_us = us;
+        }
+        int64_t dt = esp_timer_get_time() - t0;
+        sd_stream_close(f);
+        if (e == e_syserr_none && dt > 0) row->read_kbps = (uint32_t)(bytes * 1000000 / 1024 / dt);
+    }
+    else if (e == e_syserr_none){
+        e = e_syserr_file_generic;
+    }
+    sd_delete_file(SDCARD_BENCH_FNAME);
+    heap_caps_free(buf);
+    return e;
+}
+
+uint32_t sd_get_card_serial(void){
+    if (!mounted || card == NULL) return 0;
+    return (uint32_t)card->cid.serial;
+}
+
+e_syserr_t sd_stream_sync(FILE* f){
+    if (f == NULL) return e_syserr_null;
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    int ret = fflush(f);
+    if (ret == 0) ret = fsync(fileno(f));
+    xSemaphoreGive(stream_lock);
+    return ret == 0 ? e_syserr_none : e_syserr_file_generic;
+}
+
 void sd_stream_close(FILE* f){
     xSemaphoreTake(stream_lock, portMAX_DELAY);
     fclose(f);
+    // the buffer is flushed by now
+    for (uint8_t i = 0; i < SDCARD_MAX_FILES_DEFAULT; i++){
+        if (vbufs[i].f != f) continue;
+        heap_caps_free(vbufs[i].buf);
+        vbufs[i].f = NULL;
+        vbufs[i].buf = NULL;
+    }
     xSemaphoreGive(stream_lock);
 }
 
@@ -285,20 +1272,40 @@ uint8_t sd_file_exists(const char *fname){
     return 1;
 }
 
+/// @brief Check if any recording with the stem of `fname` exists.
+/// @param fname Path with extension.
+/// @return 0 if no extension of `SDCARD_REC_EXTS` is taken, 1 otherwise.
+static uint8_t sd_rec_stem_exists(const char* fname){
+    static const char* exts[] = SDCARD_REC_EXTS;
+    char buf[SDCARD_PATH_MAX_CHAR];
+    const char* dot = strrchr(fname, '.');
+    uint32_t stem = dot ? (uint32_t)(dot - fname) : strlen(fname);
+    if(sd_file_exists(fname)) return 1;
+    for(uint8_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++){
+        if(stem + strlen(exts[i]) + 1 > sizeof(buf)) continue;
+        memcpy(buf, fname, stem);
+        strcpy(&buf[stem], exts[i]);
+        if(sd_file_exists(buf)) return 1;
+    }
+    return 0;
+}
+
 e_syserr_t sd_get_unique_fname(char* proposed){
     if (!mounted) return e_syserr_sdcard_unmnted;
-    uint8_t len = strlen(SDCARD_BASE_PATH "/" SDCARD_DEFAULT_FNAME_WAV);
-    if(strlen(proposed) != len) return e_syserr_param;
+    const char* dot = strrchr(proposed, '.');
+    if(dot == NULL || dot - proposed < 4) return e_syserr_param;
+    char* num = (char*)dot - 4;
     uint16_t idx = 0;
     e_syserr_t e = e_syserr_none;
-    // the number in the fname is stored in index -5 to -8 -> fr2_rec_xxxx.wav
-    // (see macro SDCARD_DEFAULT_FNAME_WAV)                        -> ^^^^ <-
-    while(sd_file_exists(proposed)){                                            // keep looping until the given name does not exist
+    // the number in the fname is stored right in front of the extension -> fr1_rec_xxxx.wav
+    // (see macro SDCARD_DEFAULT_FNAME_WAV)                                        ^^^^
+    // a take of another format with the same number blocks it as well (sidecar files share the stem)
+    while(sd_rec_stem_exists(proposed)){                                        // keep looping until the given name does not exist
         char digits[5] = "xxxx";                                                // set up digit array
-        memcpy(digits, &proposed[len - 8], 4);                                  // copy found digits into digits array
+        memcpy(digits, num, 4);                                                 // copy found digits into digits array
         if((e = str_to_4digit_uint(digits, &idx)) != e_syserr_none) return e;   // convert digit array to number and store in idx
         if((e = uint_to_4digit_str(++idx, digits)) != e_syserr_none) return e;  // convert the incremented idx to digits
-        memcpy(&proposed[len - 8], digits, 4);                                  // put new digits in fname
+        memcpy(num, digits, 4);                                                 // put new digits in fname
     }
     return e;
 }
@@ -354,6 +1361,67 @@ void sd_job(void* p){
         uart_unif_write(ret);
         
     }
+    else if(strcmp(arg, "tput") == 0){
+        char* arg = strtok(NULL, " ");
+        uint32_t mb = arg != NULL ? strtoul(arg, NULL, 10) : SDCARD_TPUT_MB_DEFAULT;
+        if(fsm_get_runtime_args().cur_state == e_fsm_state_rec){
+            SCOPE_LOG_PJ(pj, "tput error: card is busy recording.");
+            return;
+        }
+        if((e = sd_mnt()) != e_syserr_none){
+            SCOPE_LOG_PJ(pj, "Unable to mount SD card!");
+            return;
+        }
+        static const char* names[e_sd_backend_n] = {"stdio", "direct"};
+        SCOPE_LOG_PJ(pj, "stdio buffer: %d B, direct batch: %d x %d B, SPI transfer: %d B",
+                     sd_stream_buf_size(), SDCARD_WSTREAM_STAGES, SDCARD_WSTREAM_STAGE_SIZE, SDCARD_SPI_MAX_TRANSFER_SZ);
+        for(uint8_t b = 0; b < e_sd_backend_n; b++){
+            uint32_t kbps = 0;
+            if((e = sd_tput(b, mb, &kbps)) != e_syserr_none){
+                SCOPE_LOG_PJ(pj, "%s: error while writing. (%d)", names[b], e);
+                continue;
+            }
+            SCOPE_LOG_PJ(pj, "%s: %d MiB at %d KiB/s", names[b], mb, kbps);
+        }
+    }
+    else if(strcmp(arg, "bench") == 0){
+        char* arg = strtok(NULL, " ");
+        uint32_t mb = arg != NULL ? strtoul(arg, NULL, 10) : SDCARD_BENCH_MB_DEFAULT;
+        if(fsm_get_runtime_args().cur_state == e_fsm_state_rec){
+            SCOPE_LOG_PJ(pj, "bench error: card is busy recording.");
+            return;
+        }
+        if((e = sd_mnt()) != e_syserr_none){
+            SCOPE_LOG_PJ(pj, "Unable to mount SD card!");
+            return;
+        }
+        for(uint8_t prealloc = 0; prealloc < 2; prealloc++){
+            for(uint32_t chunk = SDCARD_BENCH_CHUNK_MIN; chunk <= SDCARD_BENCH_CHUNK_MAX; chunk *= 2){
+                sd_bench_row_t row;
+                if((e = sd_bench(chunk, prealloc, mb, &row)) != e_syserr_none){
+                    SCOPE_LOG_PJ(pj, "%6d B %s: error while benchmarking. (%d)", chunk, prealloc ? "prealloc" : "grow", e);
+                    continue;
+                }
+                SCOPE_LOG_PJ(pj, "%6d B %s: write %d KiB/s (max %d us), read %d KiB/s (max %d us)",
+                             chunk, prealloc ? "prealloc" : "grow", row.write_kbps, row.write_max_us,
+                             row.read_kbps, row.read_max_us);
+            }
+        }
+    }
+    else if(strcmp(arg, "srv") == 0){
+        sd_srv_stats_t st = sd_srv_get_stats();
+        SCOPE_LOG_PJ(pj, "requests: %d, bursts: %d, merged: %d, queue max: %d/%d",
+                     st.requests, st.bursts, st.merged, st.queue_max, SDCARD_SRV_QUEUE_LEN);
+        uint32_t kbps = st.busy_us > 0 ? (uint32_t)(st.bytes_written * 1000000 / 1024 / st.busy_us) : 0;
+        SCOPE_LOG_PJ(pj, "written: %llu KiB, sustained %d KiB/s", st.bytes_written / 1024, kbps);
+    }
+    else if(strcmp(arg, "stats") == 0){
+        sd_stats_t st = sd_stats_get();
+        char line[SDCARD_STATS_LINE_LEN];
+        for(uint8_t i = 0; sd_stats_line(&st, i, line, sizeof(line)) > 0; i++){
+            SCOPE_LOG_PJ(pj, "%s", line);
+        }
+    }
     else if(strcmp(arg, "rm") == 0){
         char* arg = strtok(NULL, " ");
         if(arg == NULL){
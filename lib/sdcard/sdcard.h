@@ -5,6 +5,22 @@ Combined abstraction for ESP32-SDMMC driver code and file-IO.
 Provides functionalites to mount, unmount, create, delete,
 write to, read from, append to *files* on the SD card.
 
+Bulk transfers and the mount state are owned by the SD server, a task
+pinned next to the recorder writer that executes `sd_req_t` requests from
+one queue in order. Direct write streams hand full batches to it and keep
+filling the next one, reads are done ahead into a second buffer. Callers
+of `sd_wstream_*` and `sd_rstream_*` only wait for a free batch or a filled
+buffer, never for the SPI bus.
+
+Everything else runs on the calling task and does wait for the card:
+metadata operations (`sd_create_file()`, `sd_delete_file()`,
+`sd_prealloc()`, `sd_truncate()`, `sd_file_size()`, `sd_ls()`, `sd_cat()`)
+and the stdio streams (`sd_stream_*`, `sd_write()`, `sd_read()` and their
+variants) used for headers, sidecar files and the CLI. They are serialized
+with the server by the FatFs volume lock, a call may block behind a
+batch in flight and delays the server while it runs. Keep them off the
+audio task.
+
 Additionally, a jescore compatible SD card job can be invoked
 by registering the function `sd_job` as a job.
 */
@@ -17,12 +33,17 @@ by registering the function `sd_job` as a job.
 #include "syserr.h"
 #include "audio.h"
 #include "sdmmc_cmd.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #define SDCARD_BASE_PATH            "/sdcard"
 #define SDCARD_PAGE_SIZE_BYTE       512
 #define SDCARD_SERVER_JOB_NAME      "sdcard"
 #define SDCARD_MAX_FILES_DEFAULT    5
 #define SDCARD_MAX_FREQ_BUS_DEFAULT SDMMC_FREQ_52M // SDMMC_FREQ_DEFAULT
+#ifndef SDCARD_SPI_MAX_TRANSFER_SZ
+#define SDCARD_SPI_MAX_TRANSFER_SZ  SDCARD_WSTREAM_STAGE_SIZE  // largest SPI DMA transaction, sizes the descriptor chain
+#endif
 
 #define PIN_SDSPI_CS     (gpio_num_t)13
 #define PIN_SDSPI_MOSI   (gpio_num_t)15
@@ -34,23 +55,140 @@ by registering the function `sd_job` as a job.
 #define SDCARD_PATH_MAX_CHAR    64
 
 #define SDCARD_DEFAULT_FNAME_WAV    "fr1_rec_0000.wav"
-
-/// @deprecated
-/// @enum SD card control commands.
+#define SDCARD_DEFAULT_FNAME_FLAC   "fr1_rec_0000.flac"
+#define SDCARD_REC_EXTS             {".wav", ".flac"}
+#define SDCARD_FAT32_FILE_SIZE_MAX  0xFFFFFFFFULL
+#define SDCARD_FF_DRIVE             "0:"    // FatFs drive behind SDCARD_BASE_PATH
+
+#define SDCARD_PREALLOC_MAX         (256ULL * 1024 * 1024)  // reserved at once when a file is opened
+#define SDCARD_PREALLOC_CHUNK       (64ULL * 1024 * 1024)   // rolling extension once the reservation is used up
+#define SDCARD_SEEK_MAX             0x7FFFFFFFULL           // `long` file offsets of the VFS
+
+#ifndef SDCARD_STDIO_BUF_SIZE
+#define SDCARD_STDIO_BUF_SIZE       0                       // buffer of stdio write streams in bytes, 0 for one cluster
+#endif
+#define SDCARD_STDIO_BUF_MAX        (32 * 1024)             // caps the cluster sized buffer
+
+#ifndef SDCARD_WSTREAM_STAGE_SIZE
+#define SDCARD_WSTREAM_STAGE_SIZE   (16 * 1024)     // staging batch of a direct write stream, the default allocation unit
+#endif
+#define SDCARD_WSTREAM_STAGES       3               // batches of a direct write stream, one is filled while the others are written
+#define SDCARD_RSTREAM_BUF_SIZE     (4 * 1024)      // read-ahead unit of a read stream
+#define SDCARD_RSTREAM_BUFS         2
+
+#define SDCARD_SRV_TASK_NAME        "sdsrv"
+#define SDCARD_SRV_TASK_MEM         4096
+#define SDCARD_SRV_TASK_PRIO        3               // above the recorder writer, it waits on the server
+#define SDCARD_SRV_CORE             0               // next to the recorder writer, away from the audio task
+#define SDCARD_SRV_QUEUE_LEN        16
+#define SDCARD_SRV_COALESCE_MAX     SDCARD_WSTREAM_STAGES   // queued batches merged into one write
+#ifndef SDCARD_WSTREAM_BACKEND_DEFAULT
+#define SDCARD_WSTREAM_BACKEND_DEFAULT  e_sd_backend_direct
+#endif
+
+#define SDCARD_STATS_BUCKETS        24              // log2 latency buckets in us, the last one is open ended
+#define SDCARD_STATS_SLICE_MS       250             // step of the sliding rate window
+#define SDCARD_STATS_WIN_SLICES     4               // slices per rate window, 1 s
+#define SDCARD_STATS_IDLE_SLICES    32              // a longer pause restarts the window instead of counting as a stall
+#define SDCARD_STATS_EXT            ".sd.txt"       // sidecar next to the audio file
+#define SDCARD_STATS_LINE_LEN       96
+
+#define SDCARD_TPUT_FNAME           SDCARD_BASE_PATH "/fr1_tput.bin"
+#define SDCARD_TPUT_MB_DEFAULT      8
+#define SDCARD_TPUT_MB_MAX          256
+#define SDCARD_TPUT_CHUNK           (AUDIO_FRAME_LEN * sizeof(stereo_sample_t))   // one recorder ring slot
+
+#define SDCARD_BENCH_FNAME          SDCARD_BASE_PATH "/fr1_bench.bin"
+#define SDCARD_BENCH_MB_DEFAULT     2               // per cell of the matrix, written and read back
+#define SDCARD_BENCH_MB_MAX         64
+#define SDCARD_BENCH_CHUNK_MIN      SDCARD_PAGE_SIZE_BYTE
+#define SDCARD_BENCH_CHUNK_MAX      (64 * 1024)     // matrix runs in powers of two in between
+
+/// @brief SD write instrumentation. Covers the write bursts and header rewrites
+/// of the SD server, its syncs and `sd_stream_in()`, timed from call to return.
+typedef struct sd_stats_t{
+    uint32_t writes;
+    uint32_t hist[SDCARD_STATS_BUCKETS];    // bucket i counts latencies in [2^i, 2^(i+1)) us
+    uint32_t p50_us;                        // upper bound of the bucket holding the median
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t deadline_us;                   // one audio frame, see `sd_stats_reset()`
+    uint32_t deadline_miss;                 // writes that took longer
+    uint64_t bytes;
+    uint32_t bps_cur;                       // bytes/s over the last full window
+    uint32_t bps_min;                       // lowest and highest window since the reset
+    uint32_t bps_max;
+    uint32_t windows;                       // full windows since the reset
+}sd_stats_t;
+
+/// @brief One cell of the card benchmark, see `sd_bench()`.
+typedef struct sd_bench_row_t{
+    uint32_t chunk;                         // bytes per write and read call
+    uint8_t prealloc;                       // 1 if the chain was allocated ahead of the writes
+    uint32_t write_kbps;                    // KiB/s including the final sync
+    uint32_t write_max_us;                  // slowest single write
+    uint32_t read_kbps;
+    uint32_t read_max_us;
+}sd_bench_row_t;
+
+/// @brief Backends of `sd_wstream_t`.
+typedef enum{
+    e_sd_backend_stdio,         // newlib FILE, unbuffered, `stream_lock` on every call
+    e_sd_backend_direct,        // FatFs FIL, sector aligned multi-sector writes from a DMA-capable stage
+    e_sd_backend_n
+}e_sd_backend_t;
+
+/// @brief Write stream of a recording file, see `sd_wstream_open()`.
+typedef struct sd_wstream_t sd_wstream_t;
+
+/// @brief Read stream with read-ahead, see `sd_rstream_open()`.
+typedef struct sd_rstream_t sd_rstream_t;
+
+/// @enum SD server commands, see `sd_req_t`.
 typedef enum {
     sd_cmd_act_none,
     sd_cmd_mnt,
     sd_cmd_unmnt,
-    sd_cmd_write_chunk,
-    sd_cmd_read_chunk,
+    sd_cmd_write_chunk,         // `len` bytes of `data` at `pos` of `ws`, sequential chunks need no seek
+    sd_cmd_read_chunk,          // `len` bytes at `pos` of `rs` into `data`
+    sd_cmd_write_at,            // `len` bytes of `data` to `pos` of `ws`, its position is kept
+    sd_cmd_reserve,             // allocate the chain of `ws` up to `pos`, its position is kept
+    sd_cmd_open,                // open `ws` or `rs` at `pos`
+    sd_cmd_sync,                // commit `ws`
+    sd_cmd_close,               // close `ws` or `rs`
     NUM_SD_ACTIONS
 } sd_cmd_t;
 
-/// @brief Initialize the SDMMC config struct.
+/// @brief Request to the SD server.
+/// @note Owned by the caller and untouched until completion. Requests
+/// complete in the order they were submitted.
+typedef struct sd_req_t{
+    uint8_t cmd;                // sd_cmd_t
+    sd_wstream_t* ws;
+    sd_rstream_t* rs;
+    void* data;
+    uint32_t len;
+    uint64_t pos;
+    uint32_t xfer;              // bytes transferred, set on completion
+    e_syserr_t err;             // result, set on completion
+    SemaphoreHandle_t done;     // given on completion, NULL for none
+}sd_req_t;
+
+/// @brief SD server counters.
+typedef struct sd_srv_stats_t{
+    uint32_t requests;          // requests executed
+    uint32_t bursts;            // writes handed to FatFs
+    uint32_t merged;            // batches written as part of a larger burst
+    uint32_t queue_max;         // highest amount of waiting requests
+    uint64_t bytes_written;     // by the bursts
+    uint64_t busy_us;           // spent in the bursts, `bytes_written / busy_us` is the sustained rate of the card
+}sd_srv_stats_t;
+
+/// @brief Initialize the SDMMC config struct and launch the SD server.
 /// @param max_files Max amount of files in FS.
 /// @param max_freq_khz Max bus transfer speed. Pass 0 to use the default value.
 /// @return FR1 error code. Either returns `e_syserr_none` or `e_syserr_param`.
-/// @note Does not perform calls to ESP-IDF functions, only sets a struct.
+/// @note Does not mount the card.
 e_syserr_t sd_init(int32_t max_files, uint32_t max_freq_khz);
 
 /// @brief Initialize the SDMMC config struct.
@@ -60,14 +198,32 @@ e_syserr_t sd_init_default(void);
 
 /// @brief Mount the SD card.
 /// @return FR1 error code. 
-/// @note Immideatly returns with `e_syserr_none` if already mounted. Calls `esp_vfs_fat_sdmmc_mount`.
+/// @note Immideatly returns with `e_syserr_none` if already mounted. Calls `esp_vfs_fat_sdmmc_mount`
+/// on the SD server.
 e_syserr_t sd_mnt(void);
 
 /// @brief Unmount the SD card.
 /// @return FR1 error code.
-/// @note Immideatly returns with `e_syserr_none` if already unmounted. Calls `esp_vfs_fat_sdmmc_unmount`.
+/// @note Immideatly returns with `e_syserr_none` if already unmounted. Calls `esp_vfs_fat_sdmmc_unmount`
+/// on the SD server, after the requests queued before.
 e_syserr_t sd_unmnt(void);
 
+/// @brief Queue a request to the SD server. Returns once it is queued.
+/// @param r Request, `err`, `xfer` and `done` are valid on completion.
+/// @return FR1 error code of queueing.
+/// @note Blocks only while the queue is full. Without the server (or on it)
+/// the request is executed right away.
+e_syserr_t sd_srv_submit(sd_req_t* r);
+
+/// @brief Execute a request on the SD server and wait for it.
+/// @param r Request, `done` is set internally.
+/// @return FR1 error code of the request.
+e_syserr_t sd_srv_call(sd_req_t* r);
+
+/// @brief Get a snapshot of the SD server counters.
+/// @return SD server stats (by value).
+sd_srv_stats_t sd_srv_get_stats(void);
+
 /// @brief Checks the mounting state of the SD card.
 /// @return Mounting state expressed as 0 (umounted) and 1 (mounted).
 uint8_t sd_is_mounted(void);
@@ -78,6 +234,10 @@ uint8_t sd_is_mounted(void);
 /// @return FR1 error code.
 e_syserr_t sd_get_free_kbytes(uint32_t* free_kbytes, uint32_t* all_kbytes);
 
+/// @brief Get the largest file the mounted FS can hold.
+/// @return Size in bytes. 4 GiB - 1 on FAT, unlimited on exFAT (needs `FF_FS_EXFAT`).
+uint64_t sd_get_file_size_max(void);
+
 /// @brief Create a file on the FS.
 /// @param path Absolute path to a file.
 /// @return FR1 error code.
@@ -147,22 +307,24 @@ e_syserr_t sd_read(void* data, uint16_t type_size, uint32_t len, const char* fna
 e_syserr_t sd_read_txt(char* data, uint32_t len, const char* fname, uint32_t pos, uint32_t*  points_r);
 
 /// @brief Write to SD with an open file pointer supplied from outside.
-/// @param data Pointer to empty audio data array.
+/// @param data Pointer to audio data to be written.
+/// @param type_size Size of one data point in byte (e.g. WAV block align).
 /// @param len Length of data (not in byte).
 /// @param f Already opened file pointer.
 /// @param points_w Amount of data points that were actually written to the file.
 /// @return FR1 error code.
 /// @note The file pointer **needs** to be opened in 'ab' mode, otherwise data will be destroyed.
 /// Additionally, should an error occur, the function **does not** close the file. Close it from outside!
-e_syserr_t sd_stream_in(stereo_sample_t* data, uint32_t len, FILE* f, uint32_t* points_w);
+e_syserr_t sd_stream_in(const void* data, uint16_t type_size, uint32_t len, FILE* f, uint32_t* points_w);
 
-/// @brief Write to SD with an open file pointer supplied from outside.
-/// @param data Pointer to audio to be written.
+/// @brief Read from SD with an open file pointer supplied from outside.
+/// @param data Pointer to empty audio data array.
+/// @param type_size Size of one data point in byte (e.g. WAV block align).
 /// @param len Length of data (not in byte).
 /// @param f Already opened file pointer.
 /// @param points_r Amount of data points that were actually read from the file.
 /// @return FR1 error code.
-e_syserr_t sd_stream_out(stereo_sample_t* data, uint32_t len, FILE* f, uint32_t* points_r);
+e_syserr_t sd_stream_out(void* data, uint16_t type_size, uint32_t len, FILE* f, uint32_t* points_r);
 
 /// @brief Open file stream indefinetely for out-of-scope operations.
 /// @param fname Name of the file. Has to exist.
@@ -182,13 +344,196 @@ FILE* sd_stream_read_open(const char* fname);
 /// @param fname Name of the file. Has to exist.
 /// @return FILE pointer to opened file.
 /// @note Needs to be closed in seperate call with `sd_stream_close()`.
-/// Acts as wrapper for `sd_stream_open` in "ab" mode.
+/// Acts as wrapper for `sd_stream_open` in "ab" mode. The stream is fully buffered
+/// in DMA-capable RAM (see `sd_stream_buf_size()`), FatFs gets whole buffers and
+/// the SPI driver needs no bounce copy.
 FILE* sd_stream_write_open(const char* fname);
 
+/// @brief Open an existing file stream for writing at a given position.
+/// @param fname Name of the file. Has to exist.
+/// @param pos Byte position of the first write.
+/// @return FILE pointer to opened file, NULL on error.
+/// @note Needs to be closed in seperate call with `sd_stream_close()`.
+/// Opens in "r+b" mode, so space reserved with `sd_prealloc()` is overwritten
+/// instead of appended to. Buffered like `sd_stream_write_open()`.
+FILE* sd_stream_write_open_at(const char* fname, uint32_t pos);
+
+/// @brief Reserve clusters for an empty, closed file.
+/// @param fname Name of the file. Has to exist and be empty.
+/// @param bytes Requested size, capped to `SDCARD_PREALLOC_MAX` and the free space.
+/// Holds the reserved size afterwards, the file has this size until truncated.
+/// @return FR1 error code.
+/// @note With `FF_USE_EXPAND` the clusters are one contiguous run (`f_expand()`).
+/// Otherwise, or if the card has no such run, the cluster chain is built up front.
+/// Either way no FAT update is left for the writes into the reservation.
+e_syserr_t sd_prealloc(const char* fname, uint64_t* bytes);
+
+/// @brief Extend the reservation of an opened write stream ahead of a write.
+/// @param f FILE pointer to opened file.
+/// @param end Reserved end of the file in bytes, 0 if nothing is reserved. Updated.
+/// @param need File position after the next write.
+/// @return FR1 error code. A failed extension sets `*end` to 0 and stops reserving.
+/// @note Extends in steps of `SDCARD_PREALLOC_CHUNK` by seeking past the end,
+/// FatFs allocates the chain right away. Bursts the FAT updates of a whole
+/// chunk into one call instead of one per cluster during the writes.
+e_syserr_t sd_stream_reserve(FILE* f, uint64_t* end, uint64_t need);
+
+/// @brief Write to an opened write stream at a given position, then continue where it was.
+/// @param f FILE pointer to opened file (see `sd_stream_write_open_at()`).
+/// @param data Bytes to write.
+/// @param len Amount of bytes.
+/// @param pos Byte position in the file.
+/// @return FR1 error code.
+/// @note Rewrites headers through the handle the data goes through, no second
+/// open of the same file. Not committed until `sd_stream_sync()`.
+e_syserr_t sd_stream_write_at(FILE* f, const void* data, uint32_t len, uint32_t pos);
+
+/// @brief Get the size of a file.
+/// @param fname Name of the file. Has to exist.
+/// @param size Size in bytes as stored in the directory entry.
+/// @return FR1 error code.
+e_syserr_t sd_file_size(const char* fname, uint64_t* size);
+
+/// @brief Cut a closed file to a size, releasing reserved clusters beyond it.
+/// @param fname Name of the file. Has to exist.
+/// @param size New size in bytes.
+/// @return FR1 error code.
+e_syserr_t sd_truncate(const char* fname, uint64_t size);
+
+/// @brief Open a write stream on an existing file.
+/// @param fname Name of the file. Has to exist.
+/// @param pos Byte position of the first write, space behind it is overwritten.
+/// @param backend `e_sd_backend_t` value, usually `SDCARD_WSTREAM_BACKEND_DEFAULT`.
+/// @return Stream, NULL on error. Close it with `sd_wstream_close()`.
+/// @note The direct backend bypasses stdio: writes are staged in a DMA-capable
+/// buffer and handed to the SD server in batches of `SDCARD_WSTREAM_STAGE_SIZE`
+/// that start on a sector boundary, so FatFs writes whole sectors straight to the
+/// card. The caller fills the next of `SDCARD_WSTREAM_STAGES` batches meanwhile.
+/// Sector aligned, DMA-capable sources skip the stage. A stream belongs to
+/// one task, no lock is taken per write.
+sd_wstream_t* sd_wstream_open(const char* fname, uint32_t pos, uint8_t backend);
+
+/// @brief Append bytes to a write stream.
+/// @param s Open stream.
+/// @param data Bytes to write.
+/// @param len Amount of bytes.
+/// @return FR1 error code. `e_syserr_oom` if the card is full. Errors of batches
+/// written in the background show up on the next call.
+/// @note Staged bytes reach the file on a full batch, `sd_wstream_sync()` or close.
+/// Only blocks while every batch is in flight.
+e_syserr_t sd_wstream_write(sd_wstream_t* s, const void* data, uint32_t len);
+
+/// @brief Overwrite bytes at a position, then continue where the stream was.
+/// @param s Open stream.
+/// @param data Bytes to write.
+/// @param len Amount of bytes.
+/// @param pos Byte position in the file, in front of the staged bytes.
+/// @return FR1 error code.
+/// @note Rewrites headers through the handle the data goes through. Not committed until `sd_wstream_sync()`.
+e_syserr_t sd_wstream_write_at(sd_wstream_t* s, const void* data, uint32_t len, uint32_t pos);
+
+/// @brief Extend the reservation of a write stream ahead of a write, see `sd_stream_reserve()`.
+/// @param s Open stream.
+/// @param end Reserved end of the file in bytes, 0 if nothing is reserved. Updated.
+/// @param need File position after the next write.
+/// @return FR1 error code. A failed extension sets `*end` to 0 and stops reserving.
+e_syserr_t sd_wstream_reserve(sd_wstream_t* s, uint64_t* end, uint64_t need);
+
+/// @brief Write the staged bytes and commit the file to the card.
+/// @param s Open stream.
+/// @return FR1 error code.
+e_syserr_t sd_wstream_sync(sd_wstream_t* s);
+
+/// @brief Write the staged bytes, close the file and free the stream.
+/// @param s Open stream.
+/// @return FR1 error code.
+e_syserr_t sd_wstream_close(sd_wstream_t* s);
+
+/// @brief Open a read stream on an existing file.
+/// @param fname Name of the file. Has to exist.
+/// @param pos Byte position of the first read.
+/// @return Stream, NULL on error. Close it with `sd_rstream_close()`.
+/// @note Reads go through the SD server in units of `SDCARD_RSTREAM_BUF_SIZE`,
+/// the next `SDCARD_RSTREAM_BUFS` - 1 units are read ahead while the caller consumes one.
+sd_rstream_t* sd_rstream_open(const char* fname, uint64_t pos);
+
+/// @brief Read bytes from a read stream.
+/// @param s Open stream.
+/// @param data Destination.
+/// @param len Amount of bytes.
+/// @param points_r Amount of bytes that were actually read, less at the end of the file.
+/// @return FR1 error code. `e_syserr_file_eof` if the file ended before `len`.
+e_syserr_t sd_rstream_read(sd_rstream_t* s, void* data, uint32_t len, uint32_t* points_r);
+
+/// @brief Get the read position of a read stream.
+/// @param s Open stream.
+/// @return Byte position of the next read.
+uint64_t sd_rstream_tell(const sd_rstream_t* s);
+
+/// @brief Close a read stream and free it.
+/// @param s Open stream.
+/// @return FR1 error code.
+/// @note Waits for the reads ahead to complete.
+e_syserr_t sd_rstream_close(sd_rstream_t* s);
+
+/// @brief Measure the sustained write rate of a backend.
+/// @param backend `e_sd_backend_t` value.
+/// @param mb MiB to write, up to `SDCARD_TPUT_MB_MAX`.
+/// @param kbps Measured rate in KiB/s.
+/// @return FR1 error code.
+/// @note Writes `SDCARD_TPUT_CHUNK` blocks from the memory the recorder ring lives in
+/// into a preallocated `SDCARD_TPUT_FNAME`, like a take, including the final sync.
+/// The file is removed afterwards.
+e_syserr_t sd_tput(uint8_t backend, uint32_t mb, uint32_t* kbps);
+
+/// @brief Benchmark one chunk size of the card.
+/// @param chunk Bytes per call, a multiple of `SDCARD_PAGE_SIZE_BYTE` up to `SDCARD_BENCH_CHUNK_MAX`.
+/// @param prealloc 1 to allocate the whole chain before writing, 0 to grow it with the writes.
+/// @param mb MiB to write and read back, up to `SDCARD_BENCH_MB_MAX`.
+/// @param row Measured rates and worst latencies.
+/// @return FR1 error code. Returns `e_syserr_oom` if no DMA-capable buffer of `chunk` bytes is left.
+/// @note Writes go through the direct backend from a DMA-capable buffer, every call
+/// is one request of `chunk` bytes to the SD server. Reads use an unbuffered stdio
+/// stream. Both are timed per call. `SDCARD_BENCH_FNAME` is removed afterwards.
+e_syserr_t sd_bench(uint32_t chunk, uint8_t prealloc, uint32_t mb, sd_bench_row_t* row);
+
+/// @brief Get the serial number of the mounted card.
+/// @return Serial number from the CID register, 0 if no card is mounted.
+/// @note Ties measurements like `sd_bench()` to one card.
+uint32_t sd_get_card_serial(void);
+
+/// @brief Clear the write instrumentation and set the deadline of a write.
+/// @param deadline_us Period of one audio frame (`AUDIO_FRAME_LEN / sr`), 0 counts no misses.
+/// @note Called by the recorder on every take.
+void sd_stats_reset(uint32_t deadline_us);
+
+/// @brief Get a snapshot of the write instrumentation.
+/// @return SD write stats (by value), percentiles included.
+sd_stats_t sd_stats_get(void);
+
+/// @brief Write the instrumentation of the last take next to its audio file.
+/// @param fname File name of the audio file, its extension is replaced by `SDCARD_STATS_EXT`.
+/// @return FR1 error code.
+/// @note Holds the summary and every non-empty latency bucket, to qualify cards.
+e_syserr_t sd_stats_write(const char* fname);
+
+/// @brief Flush an opened write stream and commit it to the card.
+/// @param f FILE pointer to opened file.
+/// @return FR1 error code.
+/// @note FatFs updates the directory entry (file size, FAT chain) on sync,
+/// data written before survives a power loss.
+e_syserr_t sd_stream_sync(FILE* f);
+
 /// @brief Close an opened file stream.
 /// @param f FILE pointer to opened file.
+/// @note Frees the buffer of write streams.
 void sd_stream_close(FILE* f);
 
+/// @brief Get the buffer size of stdio write streams.
+/// @return `SDCARD_STDIO_BUF_SIZE`, or the cluster size of the mounted card
+/// (up to `SDCARD_STDIO_BUF_MAX`, read once at mount) if that is 0. 0 if the card is not mounted.
+uint32_t sd_stream_buf_size(void);
+
 /// @brief List all files of a folder.
 /// @param dirname Path to directory which contains entries to be listed.
 /// @param pret Pointer to empty char array.
@@ -212,7 +557,8 @@ e_syserr_t sd_cat(const char *fname, char* pret, uint16_t len);
 uint8_t sd_file_exists(const char *fname);
 
 /// @brief Get a unique filename that does not yet exist in the FS.
-/// @param proposed Proposed name of form "fr1_rec_xxxx.wav". Will be written to.
+/// @param proposed Proposed name of form "fr1_rec_xxxx.ext". Will be written to.
+/// A number is taken if a recording with any of `SDCARD_REC_EXTS` exists for it.
 /// @return FR1 error code.
 e_syserr_t sd_get_unique_fname(char* proposed);
 
@@ -0,0 +1,155 @@
+#include "spectrum.h"
+#include "esp_heap_caps.h"
+#include "hal/cpu_hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+#define SPEC_SAMPLE_SCALE (1.0f / 2147483648.0f)
+
+typedef struct spec_ctx_t{
+    dsp_fr1_fft_t fft;
+    dsp_fr1_bands_t oct;
+    dsp_fr1_bands_t third;
+    float* stage;               // filled by the audio task
+    float* work;                // owned by the worker while `busy`
+    float* pow;
+    uint32_t fill;
+    uint32_t skip;              // frames left to skip
+    uint32_t decim;
+    volatile uint8_t active;
+    volatile uint8_t busy;
+    TaskHandle_t worker;
+    SemaphoreHandle_t lock;
+    spec_result_t res;
+}spec_ctx_t;
+
+static spec_ctx_t spec;
+
+/// @brief Worker task. Analyzes handed over blocks.
+/// @param p Unused.
+/// @note Runs pinned to `SPEC_WORKER_CORE`, outside of jescore.
+static void spec_worker_task(void* p);
+
+/// @brief Allocate from PSRAM if possible, internal RAM otherwise.
+static void* spec_alloc(uint32_t size){
+    void* m = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_32BIT);
+    if(m == NULL) m = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT);
+    return m;
+}
+
+e_syserr_t spec_init(uint32_t decim){
+    if(spec.worker != NULL) return e_syserr_none;
+    memset(&spec, 0, sizeof(spec_ctx_t));
+    spec.decim = decim;
+    spec.res.fraction = 1;
+    void* fft_mem = spec_alloc(dsp_fr1_fft_mem_size(SPEC_FFT_N));
+    spec.stage = (float*)spec_alloc(SPEC_FFT_N * sizeof(float));
+    spec.work = (float*)spec_alloc(SPEC_FFT_N * sizeof(float));
+    spec.pow = (float*)spec_alloc((SPEC_FFT_N / 2 + 1) * sizeof(float));
+    if(fft_mem == NULL || spec.stage == NULL || spec.work == NULL || spec.pow == NULL) return e_syserr_oom;
+    e_syserr_t e = dsp_fr1_fft_init(&spec.fft, SPEC_FFT_N, fft_mem);
+    if(e != e_syserr_none) return e;
+    spec.lock = xSemaphoreCreateMutex();
+    if(spec.lock == NULL) return e_syserr_null;
+    BaseType_t ret = xTaskCreatePinnedToCore(spec_worker_task,
+                                             SPEC_WORKER_TASK_NAME,
+                                             SPEC_WORKER_TASK_MEM,
+                                             NULL,
+                                             SPEC_WORKER_TASK_PRIO,
+                                             &spec.worker,
+                                             SPEC_WORKER_CORE);
+    if(ret != pdPASS) return e_syserr_oom;
+    return e_syserr_none;
+}
+
+e_syserr_t spec_init_default(void){
+    return spec_init(SPEC_DECIM_DEFAULT);
+}
+
+e_syserr_t spec_start(uint32_t sr){
+    if(spec.worker == NULL) return e_syserr_uninitialized;
+    if(sr == 0) return e_syserr_param;
+    spec.active = 0;
+    // let a running block finish before the band tables change
+    while(__atomic_load_n(&spec.busy, __ATOMIC_ACQUIRE)) vTaskDelay(1);
+    dsp_fr1_bands_init(&spec.oct, 1, SPEC_FFT_N, sr);
+    dsp_fr1_bands_init(&spec.third, 3, SPEC_FFT_N, sr);
+    xSemaphoreTake(spec.lock, portMAX_DELAY);
+    for(uint8_t i = 0; i < DSP_FR1_OCT_BANDS; i++) spec.res.oct[i] = DSP_FR1_BAND_FLOOR_DB;
+    for(uint8_t i = 0; i < DSP_FR1_THIRD_BANDS; i++) spec.res.third[i] = DSP_FR1_BAND_FLOOR_DB;
+    spec.res.sr = sr;
+    spec.res.blocks = 0;
+    __atomic_store_n(&spec.res.skipped, 0, __ATOMIC_RELAXED);
+    xSemaphoreGive(spec.lock);
+    spec.fill = 0;
+    spec.skip = 0;
+    spec.active = 1;
+    return e_syserr_none;
+}
+
+void spec_stop(void){
+    spec.active = 0;
+}
+
+void spec_feed(const stereo_sample_t* data, uint32_t len){
+    if(!spec.active) return;
+    if(spec.skip > 0){
+        spec.skip--;
+        return;
+    }
+    uint32_t n = SPEC_FFT_N - spec.fill;
+    if(len < n) n = len;
+    float* dst = &spec.stage[spec.fill];
+    for(uint32_t i = 0; i < n; i++) dst[i] = (float)data[i].l * SPEC_SAMPLE_SCALE;
+    spec.fill += n;
+    if(spec.fill < SPEC_FFT_N) return;
+    spec.fill = 0;
+    spec.skip = spec.decim;
+    if(__atomic_load_n(&spec.busy, __ATOMIC_ACQUIRE)){
+        // counted on the audio task without the lock, the worker writes the other fields under it
+        __atomic_fetch_add(&spec.res.skipped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    float* t = spec.work;
+    spec.work = spec.stage;
+    spec.stage = t;
+    __atomic_store_n(&spec.busy, 1, __ATOMIC_RELEASE);
+    xTaskNotifyGive(spec.worker);
+}
+
+void spec_set_fraction(uint8_t fraction){
+    spec.res.fraction = fraction == 3 ? 3 : 1;
+}
+
+spec_result_t spec_get(void){
+    spec_result_t r;
+    xSemaphoreTake(spec.lock, portMAX_DELAY);
+    r = spec.res;
+    xSemaphoreGive(spec.lock);
+    return r;
+}
+
+static void spec_worker_task(void* p){
+    float oct[DSP_FR1_OCT_BANDS];
+    float third[DSP_FR1_THIRD_BANDS];
+    while(1){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if(!__atomic_load_n(&spec.busy, __ATOMIC_ACQUIRE)) continue;
+        uint32_t t0 = cpu_hal_get_cycle_count();
+        dsp_fr1_fft_power(&spec.fft, spec.work, spec.pow);
+        uint32_t t1 = cpu_hal_get_cycle_count();
+        dsp_fr1_bands_sum(&spec.oct, spec.pow, oct);
+        dsp_fr1_bands_sum(&spec.third, spec.pow, third);
+        uint32_t t2 = cpu_hal_get_cycle_count();
+        __atomic_store_n(&spec.busy, 0, __ATOMIC_RELEASE);
+        xSemaphoreTake(spec.lock, portMAX_DELAY);
+        memcpy(spec.res.oct, oct, sizeof(oct));
+        memcpy(spec.res.third, third, sizeof(third));
+        spec.res.blocks++;
+        spec.res.cyc_fft = t1 - t0;
+        spec.res.cyc_bands = t2 - t1;
+        xSemaphoreGive(spec.lock);
+    }
+}
@@ -0,0 +1,71 @@
+/// @file spectrum.h
+/// @brief
+/*
+Spectrum analyzer back end. The audio task hands every n-th block of
+`SPEC_FFT_N` samples to a worker task pinned to the core that does not
+capture. The worker windows and transforms it and sums 1/1 and 1/3 octave
+band levels, which UI and CLI read with `spec_get()`. If the worker is
+still busy the block is skipped, the audio task never waits.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _SPECTRUM_H_
+#define _SPECTRUM_H_
+
+#include <stdint.h>
+#include "syserr.h"
+#include "audio.h"
+#include "dsp_fr1_fft.h"
+
+#define SPEC_WORKER_TASK_NAME   "specw"
+#define SPEC_WORKER_TASK_MEM    (3072)
+#define SPEC_WORKER_TASK_PRIO   1
+#define SPEC_WORKER_CORE        0       // PRO core, capture runs on the APP core
+#define SPEC_FFT_N              (AUDIO_FRAME_LEN * 2)   // 23 Hz bins at 48 kHz
+#define SPEC_DECIM_DEFAULT      4       // frames skipped after every block
+
+/// @brief Latest band levels in dBFS.
+typedef struct spec_result_t{
+    float oct[DSP_FR1_OCT_BANDS];
+    float third[DSP_FR1_THIRD_BANDS];
+    uint32_t sr;
+    uint32_t blocks;            // blocks analyzed since `spec_start()`
+    uint32_t skipped;           // blocks dropped because the worker was busy
+    uint32_t cyc_fft;           // cost of the last window + FFT
+    uint32_t cyc_bands;         // cost of the last band summing
+    uint8_t fraction;           // band resolution the UI shows, 1 or 3
+}spec_result_t;
+
+/// @brief Allocate the buffers and launch the worker task.
+/// @param decim Frames skipped after every analyzed block.
+/// @return FR1 error code.
+e_syserr_t spec_init(uint32_t decim);
+
+/// @brief Initialize the spectrum analyzer with default parameters.
+/// @return FR1 error code.
+/// @note Is part of the common signature interface for the init routine.
+e_syserr_t spec_init_default(void);
+
+/// @brief Set up the band tables for a sample rate and reset the result.
+/// @param sr Active sample rate.
+/// @return FR1 error code.
+e_syserr_t spec_start(uint32_t sr);
+
+/// @brief Stop accepting frames.
+void spec_stop(void);
+
+/// @brief Collect a frame for the next block. Never blocks.
+/// @param data Audio frame, only `l` is analyzed.
+/// @param len Length of frame in stereo samples.
+/// @note Only call this from the audio task.
+void spec_feed(const stereo_sample_t* data, uint32_t len);
+
+/// @brief Select the band resolution shown on the display.
+/// @param fraction 1 for octaves, 3 for third octaves.
+void spec_set_fraction(uint8_t fraction);
+
+/// @brief Get the latest result.
+/// @return Result (by value).
+spec_result_t spec_get(void);
+
+#endif // _SPECTRUM_H_
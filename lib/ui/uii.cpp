@@ -3,6 +3,7 @@
 #include "uii.h"
 #include "fsm.h"
 #include "fsm_jccl.h"
+#include "prof_trace.h"
 
 TickType_t uii_small_button_ts = 0;
 TickType_t uii_big_button_ts = 0;
@@ -53,6 +54,7 @@ static inline void IRAM_ATTR uii_exti_handler(void* p){
     gpio_num_t pin = (gpio_num_t)ctxt.context.pin;
     gpio_int_type_t edge = (gpio_int_type_t)ctxt.context.edge;
     TickType_t now = xTaskGetTickCountFromISR();
+    PROF_TRACE_INSTANT(e_prof_trace_button, pin);
     switch(pin){
         case UII_BIG_BUTTON_PIN:
             if(now - uii_small_button_ts > UII_EXTI_BIG_BUTTON_DEBOUNCE_TICKS){
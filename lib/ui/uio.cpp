@@ -8,6 +8,8 @@
 #include "Wire.h"
 #include "adc_base.h"
 #include "dsp_fr1.h"
+#include "spectrum.h"
+#include "prof_trace.h"
 
 Adafruit_SSD1306 oled(SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT, &Wire, OLED_RESET);
 
@@ -180,22 +182,46 @@ void uio_oled_file_screen(void){
     uio_oled_draw_widgets_all();
 }
 
-void uio_oled_update_db(int16_t val){
+void uio_oled_spec_screen(void){
+    oled.clearDisplay();
+    oled.setTextSize(1);
+    oled.setTextColor(WHITE);
+    oled.setCursor(0, 0);
+    oled.printf("Spectrum");
+}
+
+void uio_oled_update_spec(void){
+    spec_result_t r = spec_get();
+    uint8_t third = r.fraction == 3;
+    uint8_t n = third ? DSP_FR1_THIRD_BANDS : DSP_FR1_OCT_BANDS;
+    const float* l = third ? r.third : r.oct;
+    uint8_t w = UIO_OLED_SPEC_W / n;
+    oled.fillRect(0, UIO_OLED_SPEC_Y, SSD1306_LCDWIDTH, UIO_OLED_SPEC_H, BLACK);
+    for(uint8_t i = 0; i < n; i++){
+        float db = l[i] < UIO_OLED_SPEC_DB_MIN ? UIO_OLED_SPEC_DB_MIN : l[i];
+        int16_t h = (int16_t)((db - UIO_OLED_SPEC_DB_MIN) * UIO_OLED_SPEC_H / -UIO_OLED_SPEC_DB_MIN);
+        if(h > UIO_OLED_SPEC_H) h = UIO_OLED_SPEC_H;
+        if(h <= 0) continue;
+        oled.fillRect(i * w, UIO_OLED_SPEC_Y + UIO_OLED_SPEC_H - h, w > 1 ? w - 1 : 1, h, WHITE);
+    }
+}
+
+void uio_oled_update_db(int16_t val, const char* weight){
     static uint8_t soft_clk_div = 0;
     if(soft_clk_div == OLED_VISUAL_TXT_UPD){
-        uio_oled_update_db_text(val);
+        uio_oled_update_db_text(val, weight);
         soft_clk_div = 0;
     }
     uio_oled_update_db_vu(val);
     soft_clk_div++;
 }
 
-void uio_oled_update_db_text(int16_t val){
+void uio_oled_update_db_text(int16_t val, const char* weight){
     oled.fillRect(0, 0, 54, 8, BLACK);
     oled.setTextSize(1);
     oled.setTextColor(WHITE);
     oled.setCursor(0,0);
-    oled.printf("%d dB(Z)", val);
+    oled.printf("%d dB(%s)", val, weight);
 }
 
 void uio_oled_update_battery(uint16_t val){
@@ -253,6 +279,7 @@ void uio_job(void* p){
         prio = (uio_update_priority_t)(uint32_t)jes_wait_for_notification();
         fsm_runtime_args_t rta = fsm_get_runtime_args();
         fsm_runtime_values_t rtv = fsm_get_runtime_values();
+        PROF_TRACE_BEGIN(e_prof_trace_ui_redraw, prio);
 
         // popup
         if(prio == 999){
@@ -262,6 +289,7 @@ void uio_job(void* p){
             oled.drawBitmap(20, 12, sd, SD_WIDTH, SD_HEIGHT, WHITE);
             oled.drawLine(20, 12, 44, 36, WHITE);
             oled.display();
+            PROF_TRACE_END(e_prof_trace_ui_redraw, prio);
             rta_old.cur_state = e_fsm_state_trans;
             jes_delay_job_ms(1500);
             continue;
@@ -274,6 +302,7 @@ void uio_job(void* p){
             oled.printf("Still\n\rrecording!");
             oled.drawBitmap(24, 20, mic, MIC_WIDTH, MIC_HEIGHT, WHITE);
             oled.display();
+            PROF_TRACE_END(e_prof_trace_ui_redraw, prio);
             rta_old.cur_state = e_fsm_state_trans;
             jes_delay_job_ms(1500);
             continue;
@@ -310,6 +339,11 @@ void uio_job(void* p){
                 uio_oled_file_screen();
                 uio_led_off();
                 break;
+
+            case e_fsm_state_spec:
+                uio_oled_spec_screen();
+                uio_led_off();
+                break;
             default:
                 break;
             }            
@@ -317,9 +351,10 @@ void uio_job(void* p){
 
         // idle routine
         if(rta.cur_state == e_fsm_state_idle){
-            uio_oled_update_db_vu((int16_t)DSP_FR1_DBFS_TO_SPL(rtv.dbfs_avg.l));
+            int16_t spl = (int16_t)DSP_FR1_DBFS_TO_SPL(rtv.slm.l);
+            uio_oled_update_db_vu(spl);
             if(prio == uio_update_mid){
-                uio_oled_update_db_text((int16_t)DSP_FR1_DBFS_TO_SPL(rtv.dbfs_avg.l));
+                uio_oled_update_db_text(spl, dsp_fr1_slm_weight_name(rtv.slm.weight));
             }
             if(prio == uio_update_all){
                 
@@ -400,6 +435,11 @@ void uio_job(void* p){
         }
 
 
+        // spec routine
+        if(rta.cur_state == e_fsm_state_spec){
+            uio_oled_update_spec();
+        }
+
         if(prio == uio_update_all){
             uio_oled_update_battery(rtv.lipo_mv);
             if(rtv.lipo_mv < 3700){
@@ -407,6 +447,7 @@ void uio_job(void* p){
             }
         }
         oled.display();
+        PROF_TRACE_END(e_prof_trace_ui_redraw, prio);
         rta_old = rta;
     }
 }
@@ -23,6 +23,11 @@
 #define UIO_OLED_WGT_BATT_W 6
 #define UIO_OLED_WGT_BATT_H 4
 
+#define UIO_OLED_SPEC_Y     10
+#define UIO_OLED_SPEC_H     38
+#define UIO_OLED_SPEC_W     60
+#define UIO_OLED_SPEC_DB_MIN (-90.0f)  // dBFS at the bottom of the bars
+
 #define UIO_LED_PIN 5
 
 #define UI_WGT_MAX_NAME_LEN 5
@@ -63,9 +68,13 @@ void uio_oled_title_screen(void);
 
 void uio_oled_idle_screen(void);
 
-void uio_oled_update_db(int16_t val);
+void uio_oled_spec_screen(void);
+
+void uio_oled_update_spec(void);
+
+void uio_oled_update_db(int16_t val, const char* weight);
 
-void uio_oled_update_db_text(int16_t val);
+void uio_oled_update_db_text(int16_t val, const char* weight);
 
 void uio_oled_update_db_vu(int16_t val);
 
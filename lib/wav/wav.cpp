@@ -30,16 +30,105 @@ wav_hdr_t wav_create_header(uint16_t numChannels, uint32_t sampleRate, uint16_t
     return header;
 }
 
-e_syserr_t wav_open_for_write(wav_file_t* wav, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample) {
-    if (wav == NULL || filename == NULL) {
-        return e_syserr_param;
+/// @brief Little endian chunk writer on top of the header buffer.
+typedef struct wav_hdr_buf_t{
+    uint8_t* p;
+    uint32_t pos;
+}wav_hdr_buf_t;
+
+static void wav_hdr_put(wav_hdr_buf_t* b, const void* d, uint32_t len){
+    memcpy(&b->p[b->pos], d, len);
+    b->pos += len;
+}
+
+static void wav_hdr_u16(wav_hdr_buf_t* b, uint16_t v){
+    uint8_t d[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+    wav_hdr_put(b, d, 2);
+}
+
+static void wav_hdr_u32(wav_hdr_buf_t* b, uint32_t v){
+    uint8_t d[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+    wav_hdr_put(b, d, 4);
+}
+
+static void wav_hdr_u64(wav_hdr_buf_t* b, uint64_t v){
+    wav_hdr_u32(b, (uint32_t)v);
+    wav_hdr_u32(b, (uint32_t)(v >> 32));
+}
+
+static void wav_hdr_chunk(wav_hdr_buf_t* b, const char* id, uint32_t size){
+    wav_hdr_put(b, id, 4);
+    wav_hdr_u32(b, size);
+}
+
+/// @brief Build the on-disk header from the in-memory description.
+/// @param wav Wav file context, sizes are taken from `samples_transfered` and `fact_samples`.
+/// @param out Buffer of `WAV_HEADER_SIZE_TOTAL` bytes.
+/// @note The ds64 space is always reserved as JUNK chunk in front of fmt.
+/// Once the sizes don't fit 32 bit anymore, it is promoted and the file becomes RF64.
+static void wav_build_header(const wav_file_t* wav, uint8_t* out){
+    const wav_hdr_t* h = &wav->header;
+    uint64_t data_size = wav->samples_transfered * h->blockAlign;
+    uint64_t riff_size = WAV_HEADER_SIZE_TOTAL - 8 + data_size;
+    uint8_t rf64 = riff_size > WAV_SIZE_32_MAX;
+    uint64_t n_samples = h->audioFormat == WAV_ADPCM_FORMAT ? wav->fact_samples : wav->samples_transfered;
+    wav_hdr_buf_t b = {out, 0};
+    memset(out, 0, WAV_HEADER_SIZE_TOTAL);
+    if(rf64){
+        wav_hdr_chunk(&b, "RF64", WAV_SIZE_32_MAX);
+        wav_hdr_put(&b, "WAVE", 4);
+        wav_hdr_chunk(&b, "ds64", WAV_DS64_SIZE);
+        wav_hdr_u64(&b, riff_size);
+        wav_hdr_u64(&b, data_size);
+        wav_hdr_u64(&b, n_samples);
+        wav_hdr_u32(&b, 0);                                 // no table entries
+    }
+    else{
+        wav_hdr_chunk(&b, "RIFF", (uint32_t)riff_size);
+        wav_hdr_put(&b, "WAVE", 4);
+        wav_hdr_chunk(&b, "JUNK", WAV_DS64_SIZE);
+        b.pos += WAV_DS64_SIZE;
     }
 
-    // Create the header
-    wav->header = wav_create_header(numChannels, sampleRate, bitsPerSample);
+    wav_hdr_chunk(&b, "fmt ", h->subchunk1Size);
+    wav_hdr_u16(&b, h->audioFormat);
+    wav_hdr_u16(&b, h->numChannels);
+    wav_hdr_u32(&b, h->sampleRate);
+    wav_hdr_u32(&b, h->byteRate);
+    wav_hdr_u16(&b, h->blockAlign);
+    wav_hdr_u16(&b, h->bitsPerSample);
+    if(h->audioFormat == WAV_FORMAT_EXTENSIBLE){
+        static const uint8_t subformat_pcm[16] = {
+            0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+            0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+        };
+        wav_hdr_u16(&b, 22);                                // cbSize
+        wav_hdr_u16(&b, wav->valid_bits);
+        wav_hdr_u32(&b, h->numChannels == 1 ? 0x4 : 0x3);  // FC or FL|FR
+        wav_hdr_put(&b, subformat_pcm, sizeof(subformat_pcm));
+    }
+    else if(h->audioFormat == WAV_ADPCM_FORMAT){
+        wav_hdr_u16(&b, 2);                                 // cbSize
+        wav_hdr_u16(&b, WAV_ADPCM_SAMPLES_PER_BLOCK);
+        wav_hdr_chunk(&b, "fact", 4);
+        wav_hdr_u32(&b, rf64 ? WAV_SIZE_32_MAX : (uint32_t)n_samples);
+    }
+
+    // pad up to the sector boundary, the data chunk header ends exactly there
+    wav_hdr_chunk(&b, "JUNK", WAV_HEADER_SIZE_TOTAL - 8 - (b.pos + 8));
+    b.pos = WAV_HEADER_SIZE_TOTAL - 8;
+    wav_hdr_chunk(&b, "data", rf64 ? WAV_SIZE_32_MAX : (uint32_t)data_size);
+}
+
+/// @brief Create the file, write the header and open the stream for the data.
+static e_syserr_t wav_open_common(wav_file_t* wav, const char* filename){
     wav->samples_transfered = 0;
-    strncpy(wav->filename, filename, sizeof(wav->filename) - 1);
-    wav->filename[sizeof(wav->filename) - 1] = '\0';
+    wav->fact_samples = 0;
+    wav->data_bytes = 0;
+    if (wav->filename != filename) {
+        strncpy(wav->filename, filename, sizeof(wav->filename) - 1);
+        wav->filename[sizeof(wav->filename) - 1] = '\0';
+    }
 
     // Create and open the file
     e_syserr_t e = sd_create_file(filename);
@@ -47,21 +136,74 @@ e_syserr_t wav_open_for_write(wav_file_t* wav, const char* filename, uint16_t nu
         return e;
     }
 
+    // Reserve the clusters while the file is empty, a failure only costs latency
+    wav->reserved = WAV_HEADER_SIZE_TOTAL + wav->reserve;
+    if (wav->reserve == 0 || sd_prealloc(filename, &wav->reserved) != e_syserr_none) {
+        wav->reserved = 0;
+    }
+
     // Write the initial header
+    uint8_t hdr[WAV_HEADER_SIZE_TOTAL];
+    wav_build_header(wav, hdr);
     uint32_t points_written;
-    e = sd_write(&wav->header, sizeof(wav_hdr_t), 1, filename, "wb", 0, &points_written);
+    e = sd_write(hdr, sizeof(hdr), 1, filename, "r+b", 0, &points_written);
     if (e != e_syserr_none || points_written != 1) {
         return e_syserr_file_generic;
     }
 
-    // Open the file for appending data
-    wav->file = sd_stream_write_open(filename);
-    if (wav->file == NULL) {
+    // Open the file for the data, overwriting the reserved space
+    wav->out = sd_wstream_open(filename, WAV_HEADER_SIZE_TOTAL, SDCARD_WSTREAM_BACKEND_DEFAULT);
+    if (wav->out == NULL) {
         return e_syserr_file_generic;
     }
     return e_syserr_none;
 }
 
+e_syserr_t wav_open_for_write(wav_file_t* wav, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample) {
+    if (wav == NULL || filename == NULL) {
+        return e_syserr_param;
+    }
+    wav->header = wav_create_header(numChannels, sampleRate, bitsPerSample);
+    wav->valid_bits = bitsPerSample;
+    return wav_open_common(wav, filename);
+}
+
+e_syserr_t wav_open_for_write_ext(wav_file_t* wav, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample) {
+    if (wav == NULL || filename == NULL || (bitsPerSample != 24 && bitsPerSample != 32)) {
+        return e_syserr_param;
+    }
+    wav->header = wav_create_header(numChannels, sampleRate, bitsPerSample);
+    wav->header.audioFormat = WAV_FORMAT_EXTENSIBLE;
+    wav->header.subchunk1Size = 40;
+    wav->valid_bits = WAV_EXT_VALID_BITS;
+    return wav_open_common(wav, filename);
+}
+
+e_syserr_t wav_open_for_write_adpcm(wav_file_t* wav, const char* filename, uint16_t numChannels, uint32_t sampleRate){
+    if (wav == NULL || filename == NULL || numChannels < 1 || numChannels > 2) {
+        return e_syserr_param;
+    }
+    wav->header = wav_create_header(numChannels, sampleRate, WAV_ADPCM_BPS);
+    wav->header.subchunk1Size = 20;
+    wav->header.audioFormat = WAV_ADPCM_FORMAT;
+    wav->header.blockAlign = WAV_ADPCM_BLOCK_ALIGN_N(numChannels);
+    wav->header.byteRate = (uint32_t)((uint64_t)sampleRate * wav->header.blockAlign / WAV_ADPCM_SAMPLES_PER_BLOCK);
+    wav->valid_bits = WAV_ADPCM_BPS;
+    return wav_open_common(wav, filename);
+}
+
+static inline uint32_t wav_le32(const uint8_t* p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t wav_le64(const uint8_t* p){
+    return wav_le32(p) | ((uint64_t)wav_le32(&p[4]) << 32);
+}
+
+static inline uint16_t wav_le16(const uint8_t* p){
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
 e_syserr_t wav_open_for_read(wav_file_t* wav, const char* filename){
     if (filename == NULL || strlen(filename) > __WAV_FN_LEN) {
         return e_syserr_param;
@@ -69,37 +211,102 @@ e_syserr_t wav_open_for_read(wav_file_t* wav, const char* filename){
 
     // set parameters to struct
     wav->samples_transfered = 0;
+    wav->fact_samples = 0;
+    wav->data_bytes = 0;
     strncpy(wav->filename, filename, sizeof(wav->filename) - 1);
     
-    // read into struct from saved file
+    // read the header region, the chunks in it tell where the data starts
+    uint8_t hdr[WAV_HEADER_SIZE_TOTAL];
     uint32_t points_read;
-    e_syserr_t e = sd_read(&wav->header, sizeof(wav_hdr_t), 1, filename, "rb", 0, &points_read);
-    if (e != e_syserr_none || points_read != 1) {
+    e_syserr_t e = sd_read(hdr, sizeof(uint8_t), sizeof(hdr), filename, "rb", 0, &points_read);
+    if (e != e_syserr_none || points_read < 12 || memcmp(&hdr[8], "WAVE", 4) != 0) {
+        return e_syserr_file_generic;
+    }
+    uint8_t rf64 = memcmp(hdr, "RF64", 4) == 0 || memcmp(hdr, "BW64", 4) == 0;
+    if (!rf64 && memcmp(hdr, "RIFF", 4) != 0) {
+        return e_syserr_file_generic;
+    }
+    uint64_t ds64_data = 0;
+    uint64_t ds64_samples = 0;
+    memset(&wav->header, 0, sizeof(wav_hdr_t));
+    memcpy(wav->header.chunkID, hdr, 4);
+    wav->header.chunkSize = wav_le32(&hdr[4]);
+    memcpy(wav->header.format, &hdr[8], 4);
+    uint64_t pos = 12;
+    uint32_t data_pos = 0;
+    while (pos + 8 <= points_read && data_pos == 0) {
+        const uint8_t* c = &hdr[pos];
+        uint32_t size = wav_le32(&c[4]);
+        if (memcmp(c, "fmt ", 4) == 0 && pos + 8 + 16 <= points_read) {
+            memcpy(wav->header.subchunk1ID, c, 4);
+            wav->header.subchunk1Size = size;
+            wav->header.audioFormat = wav_le16(&c[8]);
+            wav->header.numChannels = wav_le16(&c[10]);
+            wav->header.sampleRate = wav_le32(&c[12]);
+            wav->header.byteRate = wav_le32(&c[16]);
+            wav->header.blockAlign = wav_le16(&c[20]);
+            wav->header.bitsPerSample = wav_le16(&c[22]);
+            wav->valid_bits = wav->header.bitsPerSample;
+            if (wav->header.audioFormat == WAV_FORMAT_EXTENSIBLE && size >= 40 && pos + 8 + 40 <= points_read) {
+                wav->valid_bits = wav_le16(&c[26]);
+            }
+        }
+        else if (memcmp(c, "ds64", 4) == 0 && pos + 8 + 24 <= points_read) {
+            ds64_data = wav_le64(&c[16]);
+            ds64_samples = wav_le64(&c[24]);
+        }
+        else if (memcmp(c, "fact", 4) == 0 && pos + 12 <= points_read) {
+            wav->fact_samples = wav_le32(&c[8]);
+        }
+        else if (memcmp(c, "data", 4) == 0) {
+            memcpy(wav->header.subchunk2ID, c, 4);
+            wav->header.subchunk2Size = size;
+            wav->data_bytes = size;
+            data_pos = (uint32_t)pos + 8;
+            break;
+        }
+        // a chunk reaching past the header region ends the walk, a corrupted size never wraps back
+        if (size > points_read - pos - 8) break;
+        pos += 8 + (uint64_t)size + (size & 1);
+    }
+    if (data_pos == 0 || wav->header.blockAlign == 0) {
         return e_syserr_file_generic;
     }
+    if (!rf64 && data_pos == WAV_HEADER_SIZE) {
+        // older firmware padded a bare 44 byte header to WAV_HEADER_SIZE_TOTAL without a JUNK chunk
+        uint64_t size;
+        if (sd_file_size(filename, &size) == e_syserr_none && size >= WAV_HEADER_SIZE_TOTAL &&
+            size - WAV_HEADER_SIZE_TOTAL == wav->data_bytes) {
+            data_pos = WAV_HEADER_SIZE_TOTAL;
+        }
+    }
+    if (rf64 && wav->header.subchunk2Size == WAV_SIZE_32_MAX) {
+        // the 32 bit fields are placeholders, the real sizes are in ds64
+        wav->data_bytes = ds64_data;
+        if (wav->fact_samples == WAV_SIZE_32_MAX) wav->fact_samples = ds64_samples;
+    }
     vTaskDelay(5 / portTICK_PERIOD_MS); /// TODO: Without this delay, the UT crashes (?)
     // Open the file for reading data
-    wav->file = sd_stream_read_open(filename);
+    wav->file = sd_rstream_open(filename, data_pos); // jump over header
     if (wav->file == NULL) {
         return e_syserr_file_generic;
     }
-    fseek(wav->file, WAV_HEADER_SIZE_TOTAL, SEEK_SET); // jump over header
     return e_syserr_none;
 }
 
 e_syserr_t wav_write_samples(wav_file_t* wav, const void* samples, uint32_t sample_count) {
-    if (wav == NULL || samples == NULL || wav->file == NULL) {
+    if (wav == NULL || samples == NULL || wav->out == NULL) {
         return e_syserr_param;
     }
-    uint32_t points_written;
-    e_syserr_t e = sd_stream_in((stereo_sample_t*)samples, sample_count, wav->file, &points_written);
+    if (wav->reserved) {
+        uint64_t end = WAV_HEADER_SIZE_TOTAL + (wav->samples_transfered + sample_count) * wav->header.blockAlign;
+        sd_wstream_reserve(wav->out, &wav->reserved, end);
+    }
+    e_syserr_t e = sd_wstream_write(wav->out, samples, sample_count * wav->header.blockAlign);
     if (e != e_syserr_none) {
         return e;
     }
-    if(points_written != sample_count) {
-        return e_syserr_file_generic;
-    }
-    wav->samples_transfered += points_written;
+    wav->samples_transfered += sample_count;
     return e_syserr_none;
 }
 
@@ -108,14 +315,11 @@ e_syserr_t wav_read_samples(wav_file_t* wav, const void* samples, uint32_t sampl
         return e_syserr_param;
     }
     uint32_t points_read = 0;
-    e_syserr_t e = sd_stream_out((stereo_sample_t*)samples, sample_count, wav->file, &points_read);
+    e_syserr_t e = sd_rstream_read(wav->file, (void*)samples, sample_count * wav->header.blockAlign, &points_read);
     if (e != e_syserr_none) {
         return e;
     }
-    if(points_read != sample_count) {
-        return e_syserr_file_generic;
-    }
-    wav->samples_transfered += points_read;
+    wav->samples_transfered += sample_count;
     return e_syserr_none;
 }
 
@@ -124,16 +328,13 @@ e_syserr_t wav_update_header(wav_file_t* wav) {
         return e_syserr_param;
     }
 
-    // Calculate data size in bytes
-    uint32_t data_size = wav->samples_transfered * wav->header.numChannels * (wav->header.bitsPerSample / 8);
-
-    // Update header fields
-    wav->header.chunkSize = 36 + data_size;
-    wav->header.subchunk2Size = data_size;
+    // Build the header with the current data size
+    uint8_t hdr[WAV_HEADER_SIZE_TOTAL];
+    wav_build_header(wav, hdr);
 
     // Write the updated header
     uint32_t points_written;
-    e_syserr_t e = sd_write(&wav->header, sizeof(wav->header), 1, wav->filename, "r+b", 0, &points_written);
+    e_syserr_t e = sd_write(hdr, sizeof(hdr), 1, wav->filename, "r+b", 0, &points_written);
     if (e != e_syserr_none || points_written != 1) {
         return e != e_syserr_none ? e : e_syserr_file_generic;
     }
@@ -141,17 +342,47 @@ e_syserr_t wav_update_header(wav_file_t* wav) {
     return e_syserr_none;
 }
 
+e_syserr_t wav_checkpoint(wav_file_t* wav) {
+    if (wav == NULL) {
+        return e_syserr_param;
+    }
+    if (wav->out == NULL){
+        return e_syserr_null;
+    }
+    // Commit the data first, the header must never count bytes that are not on the card
+    e_syserr_t e = sd_wstream_sync(wav->out);
+    if (e != e_syserr_none) {
+        return e;
+    }
+
+    // Rewrite the header through the open handle, the write position stays at the data end
+    uint8_t hdr[WAV_HEADER_SIZE_TOTAL];
+    wav_build_header(wav, hdr);
+    e = sd_wstream_write_at(wav->out, hdr, sizeof(hdr), 0);
+    if (e != e_syserr_none) {
+        return e;
+    }
+    return sd_wstream_sync(wav->out);
+}
+
 e_syserr_t wav_close_for_write(wav_file_t* wav) {
     if (wav == NULL) {
         return e_syserr_param;
     }
-    if (wav->file == NULL){
+    if (wav->out == NULL){
         return e_syserr_null;
     }
-    sd_stream_close(wav->file);
-    e_syserr_t e = wav_update_header(wav);
-    wav->file = NULL;
-    return e;
+    e_syserr_t e = sd_wstream_close(wav->out);
+    wav->out = NULL;
+    if (wav->reserved) {
+        e_syserr_t et = sd_truncate(wav->filename, WAV_HEADER_SIZE_TOTAL + wav->samples_transfered * wav->header.blockAlign);
+        if (e == e_syserr_none) {
+            e = et;
+        }
+        wav->reserved = 0;
+    }
+    e_syserr_t eh = wav_update_header(wav);
+    return e != e_syserr_none ? e : eh;
 }
 
 e_syserr_t wav_close_for_read(wav_file_t* wav) {
@@ -161,7 +392,77 @@ e_syserr_t wav_close_for_read(wav_file_t* wav) {
     if (wav->file == NULL){
         return e_syserr_null;
     }
-    sd_stream_close(wav->file);
+    e_syserr_t e = sd_rstream_close(wav->file);
     wav->file = NULL;
-    return e_syserr_none;
-}
\ No newline at end of file
+    return e;
+}
+
+/// @brief Set the sizes of a file of older firmware that was not closed.
+/// Its audio follows the padding up to `WAV_HEADER_SIZE_TOTAL`, the header
+/// sizes were only written at close.
+/// @param filename Name of wav file in FS.
+/// @param size File size in bytes.
+/// @param blockAlign Bytes per sample frame.
+/// @param fixed Set to 1 if the sizes were written.
+/// @param data_bytes Set to the audio bytes of the file.
+/// @return FR1 error code.
+static e_syserr_t wav_recover_legacy(const char* filename, uint64_t size, uint16_t blockAlign, uint8_t* fixed, uint64_t* data_bytes) {
+    uint64_t data = (size - WAV_HEADER_SIZE_TOTAL) / blockAlign * blockAlign;
+    if (data > WAV_SIZE_32_MAX - 36) {
+        data = (WAV_SIZE_32_MAX - 36) / blockAlign * blockAlign;
+    }
+    *data_bytes = data;
+    uint32_t chunk_size = 36 + (uint32_t)data;
+    uint32_t data_size = (uint32_t)data;
+    uint32_t points_w;
+    e_syserr_t e = sd_write(&chunk_size, sizeof(uint32_t), 1, filename, "r+b", 4, &points_w);
+    if (e == e_syserr_none) {
+        e = sd_write(&data_size, sizeof(uint32_t), 1, filename, "r+b", WAV_HEADER_SIZE - 4, &points_w);
+    }
+    if (e == e_syserr_none) {
+        *fixed = 1;
+    }
+    return e;
+}
+
+e_syserr_t wav_recover(const char* filename, uint8_t* fixed, uint64_t* data_bytes) {
+    if (filename == NULL || fixed == NULL || data_bytes == NULL) {
+        return e_syserr_null;
+    }
+    *fixed = 0;
+    *data_bytes = 0;
+    wav_file_t wav;
+    e_syserr_t e = wav_open_for_read(&wav, filename);
+    if (e != e_syserr_none) {
+        return e;
+    }
+    uint64_t data_pos = sd_rstream_tell(wav.file);
+    uint64_t end = data_pos + wav.data_bytes;
+    wav_close_for_read(&wav);
+    uint64_t size;
+    e = sd_file_size(filename, &size);
+    if (e != e_syserr_none) {
+        return e;
+    }
+    if (data_pos == WAV_HEADER_SIZE) {
+        if (size <= end || size < WAV_HEADER_SIZE_TOTAL) {
+            *data_bytes = wav.data_bytes;
+            return e_syserr_none;   // a plain 44 byte header file, complete
+        }
+        return wav_recover_legacy(filename, size, wav.header.blockAlign, fixed, data_bytes);
+    }
+    if (data_pos != WAV_HEADER_SIZE_TOTAL) {
+        return e_syserr_param;      // not written by `wav_open_for_write()`, chunks may follow the data
+    }
+
+    *data_bytes = wav.data_bytes;
+    // A file longer than its header ends at its last checkpoint (or holds reserved space)
+    if (size <= end) {
+        return e_syserr_none;
+    }
+    e = sd_truncate(filename, end);
+    if (e == e_syserr_none) {
+        *fixed = 1;
+    }
+    return e;
+}
@@ -4,23 +4,30 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "sdcard.h"
+#include "wav_adpcm.h"
 
 #define WAV_HEADER_SIZE 44
-#define WAV_HEADER_PAD 468
-#define WAV_HEADER_SIZE_TOTAL (WAV_HEADER_SIZE + WAV_HEADER_PAD)
-#ifndef WAV_FN_LEN 
+#define WAV_HEADER_SIZE_TOTAL 512              // audio data starts sector aligned, a JUNK chunk pads up to it
+#define WAV_FORMAT_PCM          0x0001
+#define WAV_FORMAT_EXTENSIBLE   0xFFFE
+#define WAV_EXT_VALID_BITS      24             // MEMS resolution, announced for 24 and 32 bit containers
+#define WAV_DS64_SIZE           28             // RF64 ds64 body without table, reserved as JUNK until needed
+#define WAV_SIZE_32_MAX         0xFFFFFFFFUL   // 32 bit size fields of RF64 files hold this
+#ifndef WAV_FN_LEN
     #define __WAV_FN_LEN 256
 #else
     #define __WAV_FN_LEN WAV_FN_LEN
 #endif
 
 /// @brief In-memory wav-header struct.
+/// @note Describes the format only, the on-disk header is built from it
+/// (see `wav_update_header()`) and depends on `audioFormat`.
 typedef struct {
     char     chunkID[4];                   // "RIFF"
     uint32_t chunkSize;                    // File size - 8
     char     format[4];                    // "WAVE"
     char     subchunk1ID[4];               // "fmt "
-    uint32_t subchunk1Size;                // 16 for PCM
+    uint32_t subchunk1Size;                // 16 for PCM, 40 for EXTENSIBLE, 20 for IMA-ADPCM
     uint16_t audioFormat;                  // 1 for PCM
     uint16_t numChannels;                  // 1 for mono, 2 for stereo
     uint32_t sampleRate;                   // 44100, 16000, etc.
@@ -29,15 +36,20 @@ typedef struct {
     uint16_t bitsPerSample;                // 8, 16, 24, etc.
     char     subchunk2ID[4];               // "data"
     uint32_t subchunk2Size;                // data size
-    uint8_t  padding[WAV_HEADER_PAD];      // padding to 512 bytes
 } wav_hdr_t;
 
 /// @brief In-memory wav file context struct.
 typedef struct {
     char filename[__WAV_FN_LEN];
-    FILE* file;
+    sd_rstream_t* file;                    // read stream, NULL while not reading
+    sd_wstream_t* out;                     // write stream, NULL while not writing
     wav_hdr_t header;
-    uint32_t samples_transfered;
+    uint64_t samples_transfered;           // in units of `header.blockAlign`
+    uint64_t fact_samples;                 // samples per channel of compressed files
+    uint64_t data_bytes;                   // size of the data chunk, read only, from ds64 for RF64
+    uint16_t valid_bits;                   // EXTENSIBLE only
+    uint64_t reserve;                      // data bytes to reserve on open (see `sd_prealloc()`), 0 for none
+    uint64_t reserved;                     // reserved end of the file, truncated to the data on close
 } wav_file_t;
 
 /// @brief Create a WAV header.
@@ -54,33 +66,67 @@ wav_hdr_t wav_create_header(uint16_t numChannels, uint32_t sampleRate, uint16_t
 /// @param sampleRate Sample rate for audio.
 /// @param bitsPerSample Sample resolution.
 /// @return FR1 error code.
-/// @note Passes parameters to `wav_create_header()`.
+/// @note Passes parameters to `wav_create_header()`. Set `wav->reserve` before
+/// to write into preallocated clusters, the reservation grows in `SDCARD_PREALLOC_CHUNK`
+/// steps once it is used up.
 e_syserr_t wav_open_for_write(wav_file_t* wav, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample);
 
+/// @brief Open a new WAVE_FORMAT_EXTENSIBLE file and write the header.
+/// @param wav Empty wav file context.
+/// @param filename Name of wav file in FS.
+/// @param numChannels Number of audio channels.
+/// @param sampleRate Sample rate for audio.
+/// @param bitsPerSample Container size, 24 or 32. `WAV_EXT_VALID_BITS` of them are valid.
+/// @return FR1 error code.
+e_syserr_t wav_open_for_write_ext(wav_file_t* wav, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample);
+
+/// @brief Open a new IMA-ADPCM WAV file and write the header.
+/// @param wav Empty wav file context.
+/// @param filename Name of wav file in FS.
+/// @param numChannels Number of audio channels.
+/// @param sampleRate Sample rate for audio.
+/// @return FR1 error code.
+/// @note `wav->header` describes the format in memory (`audioFormat` 0x0011,
+/// `blockAlign` of one ADPCM block), samples are written as whole blocks.
+/// Set `wav->fact_samples` before closing.
+e_syserr_t wav_open_for_write_adpcm(wav_file_t* wav, const char* filename, uint16_t numChannels, uint32_t sampleRate);
+
 /// @brief Open a new WAV file and read the header.
 /// @param wav Existing wav file context.
 /// @param filename Name of wav file in FS.
 /// @return FR1 error code.
-/// @note Stores header in `wav->header` and sets read pointer to start of data with `fseek()`.
+/// @note Walks the chunks of the header, stores the format in `wav->header`
+/// and opens a read stream at the start of data (see `sd_rstream_open()`). RF64 and BW64 files
+/// are read as well, their 64 bit sizes end up in `data_bytes` and `fact_samples`.
+/// Files of older firmware (bare 44 byte header, data size = file size - `WAV_HEADER_SIZE_TOTAL`)
+/// are read from `WAV_HEADER_SIZE_TOTAL`.
 e_syserr_t wav_open_for_read(wav_file_t* wav, const char* filename);
 
 /// @brief Write audio samples to the WAV file.
 /// @param wav Existing wav file context.
-/// @param samples Data to write.
-/// @param sample_count Amount of data to write.
+/// @param samples Packed PCM data to write (see `wav_pack_frames()`).
+/// @param sample_count Amount of sample frames (`blockAlign` bytes each) to write.
 /// @return FR1 error code.
 e_syserr_t wav_write_samples(wav_file_t* wav, const void* samples, uint32_t sample_count);
 
 /// @brief Read audio samples from the WAV file.
 /// @param wav Existing wav file context.
-/// @param samples Data to read.
-/// @param sample_count Amount of data to read.
+/// @param samples Buffer for packed PCM data.
+/// @param sample_count Amount of sample frames (`blockAlign` bytes each) to read.
 /// @return FR1 error code.
 e_syserr_t wav_read_samples(wav_file_t* wav, const void* samples, uint32_t sample_count);
 
+/// @brief Commit the written samples and update the header, the file stays open.
+/// @param wav Existing wav file context.
+/// @return FR1 error code.
+/// @note A power loss after this leaves a valid file up to the checkpoint. The header
+/// goes through the open stream (see `sd_wstream_write_at()`), the file is not reopened.
+e_syserr_t wav_checkpoint(wav_file_t* wav);
+
 /// @brief Close the freshly written WAV file and update the header.
 /// @param wav Existing wav file context.
 /// @return FR1 error code.
+/// @note Unused reserved space is released.
 e_syserr_t wav_close_for_write(wav_file_t* wav);
 
 /// @brief Close the freshly read WAV file and update the header.
@@ -88,9 +134,23 @@ e_syserr_t wav_close_for_write(wav_file_t* wav);
 /// @return FR1 error code.
 e_syserr_t wav_close_for_read(wav_file_t* wav);
 
+/// @brief Finalize a WAV file that was not closed, at its last checkpoint.
+/// @param filename Name of wav file in FS.
+/// @param fixed Set to 1 if the file was cut or its sizes were set, 0 if it was complete.
+/// @param data_bytes Set to the audio bytes the file holds afterwards.
+/// @return FR1 error code. `e_syserr_param` for files of other writers.
+/// @note The header of a checkpointed file is valid, only reserved space or
+/// samples written after the checkpoint follow the data chunk. They are cut off.
+/// Files of older firmware only got their sizes at close, they are set from the file size.
+e_syserr_t wav_recover(const char* filename, uint8_t* fixed, uint64_t* data_bytes);
+
 /// @brief Update the WAV header with the final data size
 /// @param wav Existing wav file context.
 /// @return FR1 error code.
+/// @note Rewrites all `WAV_HEADER_SIZE_TOTAL` bytes: RIFF, the ds64 placeholder,
+/// fmt, fact (compressed formats only), a JUNK chunk padding up to the sector
+/// boundary and the data chunk header. Beyond 4 GiB the placeholder becomes the
+/// ds64 chunk and the file RF64 (EBU Tech 3306), so takes are not limited by 32 bit sizes.
 e_syserr_t wav_update_header(wav_file_t* wav);
 
 #endif // WAV_H
\ No newline at end of file
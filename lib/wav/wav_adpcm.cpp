@@ -0,0 +1,99 @@
+#include "wav_adpcm.h"
+#include <string.h>
+
+static const int16_t wav_adpcm_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t wav_adpcm_index_adj[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+/// @brief Encode one sample and advance the predictor.
+/// @return 4 bit code.
+static inline uint8_t wav_adpcm_code(int16_t* pred, uint8_t* index, int32_t s){
+    int32_t step = wav_adpcm_steps[*index];
+    int32_t diff = s - *pred;
+    uint8_t code = 0;
+    if(diff < 0){
+        code = 8;
+        diff = -diff;
+    }
+    int32_t vpdiff = step >> 3;
+    if(diff >= step){ code |= 4; diff -= step; vpdiff += step; }
+    step >>= 1;
+    if(diff >= step){ code |= 2; diff -= step; vpdiff += step; }
+    step >>= 1;
+    if(diff >= step){ code |= 1; vpdiff += step; }
+    int32_t p = (code & 8) ? *pred - vpdiff : *pred + vpdiff;
+    if(p > 32767) p = 32767;
+    if(p < -32768) p = -32768;
+    *pred = (int16_t)p;
+    int32_t i = *index + wav_adpcm_index_adj[code & 7];
+    *index = (uint8_t)(i < 0 ? 0 : i > 88 ? 88 : i);
+    return code;
+}
+
+/// @brief Put a sample into the block being built at `blk`.
+static inline void wav_adpcm_put(wav_adpcm_t* enc, uint8_t* blk, uint8_t c, int32_t s){
+    if(enc->fill == 0){
+        // block header: the exact sample restarts the predictor
+        enc->pred[c] = (int16_t)s;
+        blk[c * 4]     = (uint8_t)s;
+        blk[c * 4 + 1] = (uint8_t)(s >> 8);
+        blk[c * 4 + 2] = enc->index[c];
+        blk[c * 4 + 3] = 0;
+        return;
+    }
+    uint32_t k = enc->fill - 1;
+    uint8_t* b = &blk[4 * enc->n_ch + (k / 8) * 4 * enc->n_ch + c * 4 + (k % 8) / 2];
+    uint8_t code = wav_adpcm_code(&enc->pred[c], &enc->index[c], s);
+    if(k & 1) *b |= (uint8_t)(code << 4);
+    else *b = code;
+}
+
+e_syserr_t wav_adpcm_init(wav_adpcm_t* enc, uint16_t numChannels){
+    if(enc == NULL) return e_syserr_null;
+    if(numChannels < 1 || numChannels > 2) return e_syserr_param;
+    memset(enc, 0, sizeof(wav_adpcm_t));
+    enc->n_ch = numChannels;
+    enc->block_align = WAV_ADPCM_BLOCK_ALIGN_N(numChannels);
+    return e_syserr_none;
+}
+
+uint32_t wav_adpcm_encode(wav_adpcm_t* enc, const stereo_sample_t* in, void* out, uint32_t len){
+    if(len > AUDIO_FRAME_LEN) len = AUDIO_FRAME_LEN;
+    uint32_t done = 0;
+    uint8_t* blk = enc->buf;
+    for(uint32_t i = 0; i < len; i++){
+        wav_adpcm_put(enc, blk, 0, in[i].l >> 16);
+        if(enc->n_ch == 2) wav_adpcm_put(enc, blk, 1, in[i].r >> 16);
+        if(++enc->fill == WAV_ADPCM_SAMPLES_PER_BLOCK){
+            enc->fill = 0;
+            done++;
+            blk += enc->block_align;
+        }
+    }
+    enc->samples += len;
+    uint32_t bytes = done * enc->block_align;
+    if(done == 0) return 0;
+    memcpy(out, enc->buf, bytes);
+    // the partial block moves to the front for the next frame
+    memcpy(enc->buf, blk, enc->block_align);
+    return bytes;
+}
+
+const uint8_t* wav_adpcm_flush(wav_adpcm_t* enc, uint32_t* bytes){
+    *bytes = 0;
+    if(enc->fill == 0) return enc->buf;
+    int16_t last[2] = {enc->pred[0], enc->pred[1]};
+    while(enc->fill != 0){
+        for(uint8_t c = 0; c < enc->n_ch; c++) wav_adpcm_put(enc, enc->buf, c, last[c]);
+        if(++enc->fill == WAV_ADPCM_SAMPLES_PER_BLOCK) enc->fill = 0;
+    }
+    *bytes = enc->block_align;
+    return enc->buf;
+}
@@ -0,0 +1,59 @@
+/// @file wav_adpcm.h
+/// @brief
+/*
+IMA-ADPCM (WAVE_FORMAT_IMA_ADPCM, 4 bit) block encoder. Blocks are
+`WAV_ADPCM_BLOCK_ALIGN` bytes per channel so every block ends on an SD
+sector. Each block starts with the exact sample and the step index per
+channel, followed by 4 byte groups (8 samples) alternating between the
+channels, low nibble first.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _WAV_ADPCM_H_
+#define _WAV_ADPCM_H_
+
+#include <stdint.h>
+#include "audio.h"
+#include "syserr.h"
+
+#define WAV_ADPCM_FORMAT            0x0011
+#define WAV_ADPCM_BPS               4
+#define WAV_ADPCM_BLOCK_ALIGN       512     // bytes per block and channel
+#define WAV_ADPCM_BLOCK_ALIGN_N(ch) ((ch) * WAV_ADPCM_BLOCK_ALIGN)
+#define WAV_ADPCM_SAMPLES_PER_BLOCK ((WAV_ADPCM_BLOCK_ALIGN - 4) * 2 + 1)
+#define WAV_ADPCM_FRAME_BLOCKS_MAX  2       // blocks completed by one AUDIO_FRAME_LEN frame
+
+/// @brief Encoder state, carries the partial block from frame to frame.
+typedef struct wav_adpcm_t{
+    uint16_t n_ch;
+    uint16_t block_align;
+    uint16_t fill;              // samples in the current block
+    int16_t pred[2];
+    uint8_t index[2];
+    uint64_t samples;           // samples per channel encoded, without padding
+    uint8_t buf[(WAV_ADPCM_FRAME_BLOCKS_MAX + 1) * WAV_ADPCM_BLOCK_ALIGN_N(2)];
+}wav_adpcm_t;
+
+/// @brief Reset the encoder for a new stream.
+/// @param enc Encoder state.
+/// @param numChannels 1 encodes `l` only, 2 encodes `l` and `r`.
+/// @return FR1 error code.
+e_syserr_t wav_adpcm_init(wav_adpcm_t* enc, uint16_t numChannels);
+
+/// @brief Encode I2S frames, only completed blocks are put out.
+/// @param enc Encoder state.
+/// @param in I2S frames. The MEMS data is MSB-aligned in each 32 bit slot.
+/// @param out Output buffer, at least `WAV_ADPCM_FRAME_BLOCKS_MAX` blocks.
+/// @param len Amount of frames, up to `AUDIO_FRAME_LEN`.
+/// @return Amount of bytes written to `out`, a multiple of the block align.
+/// @note `out` may alias `in`, blocks are staged in `enc` until all input is read.
+uint32_t wav_adpcm_encode(wav_adpcm_t* enc, const stereo_sample_t* in, void* out, uint32_t len);
+
+/// @brief Complete the partial block by holding the last decoded value.
+/// @param enc Encoder state.
+/// @param bytes Size of the returned block, 0 if no samples were pending.
+/// @return The last block, held by `enc`.
+/// @note The padding is not counted in `enc->samples`, which goes to the fact chunk.
+const uint8_t* wav_adpcm_flush(wav_adpcm_t* enc, uint32_t* bytes);
+
+#endif // _WAV_ADPCM_H_
@@ -0,0 +1,130 @@
+#include "wav_pack.h"
+#include <string.h>
+
+/*
+The block kernels handle 4 frames per iteration with aligned 32 bit
+stores (24 bit mono: 4 samples -> 3 words), a byte-wise tail takes care
+of the rest. Reads always run ahead of writes, so packing in place is safe.
+*/
+
+static inline uint32_t wav_pack_mono16(const stereo_sample_t* in, uint8_t* out, uint32_t len){
+    uint32_t i = 0;
+    if(((uintptr_t)out & 3) == 0){
+        uint32_t* w = (uint32_t*)out;
+        for(; i + 4 <= len; i += 4){
+            uint32_t s0 = (uint32_t)in[i].l >> 16;
+            uint32_t s1 = (uint32_t)in[i + 1].l >> 16;
+            uint32_t s2 = (uint32_t)in[i + 2].l >> 16;
+            uint32_t s3 = (uint32_t)in[i + 3].l >> 16;
+            *w++ = s0 | (s1 << 16);
+            *w++ = s2 | (s3 << 16);
+        }
+    }
+    for(; i < len; i++){
+        uint32_t s = (uint32_t)in[i].l;
+        out[i*2]     = (uint8_t)(s >> 16);
+        out[i*2 + 1] = (uint8_t)(s >> 24);
+    }
+    return len * 2;
+}
+
+static inline uint32_t wav_pack_mono24(const stereo_sample_t* in, uint8_t* out, uint32_t len){
+    uint32_t i = 0;
+    if(((uintptr_t)out & 3) == 0){
+        uint32_t* w = (uint32_t*)out;
+        for(; i + 4 <= len; i += 4){
+            uint32_t s0 = (uint32_t)in[i].l >> 8;
+            uint32_t s1 = (uint32_t)in[i + 1].l >> 8;
+            uint32_t s2 = (uint32_t)in[i + 2].l >> 8;
+            uint32_t s3 = (uint32_t)in[i + 3].l >> 8;
+            *w++ = s0 | (s1 << 24);
+            *w++ = (s1 >> 8) | (s2 << 16);
+            *w++ = (s2 >> 16) | (s3 << 8);
+        }
+    }
+    for(; i < len; i++){
+        uint32_t s = (uint32_t)in[i].l;
+        out[i*3]     = (uint8_t)(s >> 8);
+        out[i*3 + 1] = (uint8_t)(s >> 16);
+        out[i*3 + 2] = (uint8_t)(s >> 24);
+    }
+    return len * 3;
+}
+
+static inline uint32_t wav_pack_mono32(const stereo_sample_t* in, uint8_t* out, uint32_t len){
+    for(uint32_t i = 0; i < len; i++){
+        int32_t s = in[i].l;
+        memcpy(&out[i*4], &s, 4);
+    }
+    return len * 4;
+}
+
+static inline uint32_t wav_pack_stereo16(const stereo_sample_t* in, uint8_t* out, uint32_t len){
+    uint32_t i = 0;
+    if(((uintptr_t)out & 3) == 0){
+        uint32_t* w = (uint32_t*)out;
+        for(; i < len; i++){
+            *w++ = ((uint32_t)in[i].l >> 16) | ((uint32_t)in[i].r & 0xFFFF0000u);
+        }
+        return len * 4;
+    }
+    for(; i < len; i++){
+        uint32_t l = (uint32_t)in[i].l;
+        uint32_t r = (uint32_t)in[i].r;
+        out[i*4]     = (uint8_t)(l >> 16);
+        out[i*4 + 1] = (uint8_t)(l >> 24);
+        out[i*4 + 2] = (uint8_t)(r >> 16);
+        out[i*4 + 3] = (uint8_t)(r >> 24);
+    }
+    return len * 4;
+}
+
+static inline uint32_t wav_pack_stereo24(const stereo_sample_t* in, uint8_t* out, uint32_t len){
+    uint32_t i = 0;
+    if(((uintptr_t)out & 3) == 0){
+        uint32_t* w = (uint32_t*)out;
+        for(; i + 2 <= len; i += 2){
+            uint32_t s0 = (uint32_t)in[i].l >> 8;
+            uint32_t s1 = (uint32_t)in[i].r >> 8;
+            uint32_t s2 = (uint32_t)in[i + 1].l >> 8;
+            uint32_t s3 = (uint32_t)in[i + 1].r >> 8;
+            *w++ = s0 | (s1 << 24);
+            *w++ = (s1 >> 8) | (s2 << 16);
+            *w++ = (s2 >> 16) | (s3 << 8);
+        }
+    }
+    for(; i < len; i++){
+        uint32_t l = (uint32_t)in[i].l;
+        uint32_t r = (uint32_t)in[i].r;
+        out[i*6]     = (uint8_t)(l >> 8);
+        out[i*6 + 1] = (uint8_t)(l >> 16);
+        out[i*6 + 2] = (uint8_t)(l >> 24);
+        out[i*6 + 3] = (uint8_t)(r >> 8);
+        out[i*6 + 4] = (uint8_t)(r >> 16);
+        out[i*6 + 5] = (uint8_t)(r >> 24);
+    }
+    return len * 6;
+}
+
+uint32_t wav_pack_frames(const stereo_sample_t* in, void* out, uint32_t len, uint16_t numChannels, uint16_t bitsPerSample){
+    uint8_t* o = (uint8_t*)out;
+    if(numChannels == 1){
+        switch(bitsPerSample){
+            case 16: return wav_pack_mono16(in, o, len);
+            case 24: return wav_pack_mono24(in, o, len);
+            case 32: return wav_pack_mono32(in, o, len);
+            default: return 0;
+        }
+    }
+    if(numChannels == 2){
+        switch(bitsPerSample){
+            case 16: return wav_pack_stereo16(in, o, len);
+            case 24: return wav_pack_stereo24(in, o, len);
+            case 32:
+                if((const void*)in != out) memmove(o, in, len * sizeof(stereo_sample_t));
+                return len * sizeof(stereo_sample_t);
+            default: return 0;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+/// @file wav_pack.h
+/// @brief
+/*
+Packs the 32 bit I2S slots of the MEMS microphone into interleaved little
+endian PCM of 16, 24 or 32 bit, mono or stereo. The PCM writer packs in
+place in the ring, the pre-roll packs into its own buffer.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _WAV_PACK_H_
+#define _WAV_PACK_H_
+
+#include <stdint.h>
+#include "audio.h"
+#include "syserr.h"
+
+#define WAV_PACK_BPS_VALID(bps) ((bps) == 16 || (bps) == 24 || (bps) == 32)
+#define WAV_PACK_CH_VALID(ch)   ((ch) == 1 || (ch) == 2)
+
+/// @brief Get the size of one packed sample frame (all channels).
+/// @param numChannels Number of audio channels.
+/// @param bitsPerSample Sample resolution.
+/// @return Bytes per packed frame (WAV block align).
+static inline uint32_t wav_pack_frame_size(uint16_t numChannels, uint16_t bitsPerSample){
+    return numChannels * (bitsPerSample / 8);
+}
+
+/// @brief Pack I2S frames into interleaved little endian PCM.
+/// @param in I2S frames. The MEMS data is MSB-aligned in each 32 bit slot.
+/// @param out Output buffer, at least `len * wav_pack_frame_size()` bytes.
+/// @param len Amount of frames to pack.
+/// @param numChannels 1 packs `l` only, 2 packs `l` and `r`.
+/// @param bitsPerSample 16, 24 or 32.
+/// @return Amount of bytes written to `out`, 0 for an invalid format.
+/// @note `out` may alias `in`, the packed data never overtakes the read position.
+uint32_t wav_pack_frames(const stereo_sample_t* in, void* out, uint32_t len, uint16_t numChannels, uint16_t bitsPerSample);
+
+#endif // _WAV_PACK_H_
@@ -0,0 +1,273 @@
+#include "wav_writer.h"
+#include "wav_pack.h"
+#include "sdcard.h"
+#include <string.h>
+
+/*-------------------------------- PCM / EXTENSIBLE --------------------------------*/
+
+static e_syserr_t wav_writer_pcm_open(wav_writer_t* w, uint8_t f, const char* filename){
+    w->wav[f].reserve = w->reserve;
+    return wav_open_for_write(&w->wav[f], filename, w->n_ch, w->sr, w->bps);
+}
+
+static e_syserr_t wav_writer_ext_open(wav_writer_t* w, uint8_t f, const char* filename){
+    w->wav[f].reserve = w->reserve;
+    return wav_open_for_write_ext(&w->wav[f], filename, w->n_ch, w->sr, w->bps);
+}
+
+static uint32_t wav_writer_pcm_encode(wav_writer_t* w, const stereo_sample_t* in, void* out, uint32_t len){
+    return wav_pack_frames(in, out, len, w->n_ch, w->bps);
+}
+
+static e_syserr_t wav_writer_wav_write(wav_writer_t* w, const void* data, uint32_t bytes){
+    wav_file_t* wav = &w->wav[w->cur];
+    return wav_write_samples(wav, data, bytes / wav->header.blockAlign);
+}
+
+static e_syserr_t wav_writer_wav_checkpoint(wav_writer_t* w){
+    return wav_checkpoint(&w->wav[w->cur]);
+}
+
+static e_syserr_t wav_writer_wav_finish(wav_writer_t* w, uint8_t f){
+    return wav_close_for_write(&w->wav[f]);
+}
+
+static uint64_t wav_writer_wav_size(wav_writer_t* w){
+    wav_file_t* wav = &w->wav[w->cur];
+    return wav->samples_transfered * wav->header.blockAlign;
+}
+
+/*-------------------------------- IMA-ADPCM --------------------------------*/
+
+static e_syserr_t wav_writer_adpcm_open(wav_writer_t* w, uint8_t f, const char* filename){
+    w->wav[f].reserve = w->reserve;
+    return wav_open_for_write_adpcm(&w->wav[f], filename, w->n_ch, w->sr);
+}
+
+static uint32_t wav_writer_adpcm_encode(wav_writer_t* w, const stereo_sample_t* in, void* out, uint32_t len){
+    return wav_adpcm_encode(&w->adpcm, in, out, len);
+}
+
+static e_syserr_t wav_writer_adpcm_checkpoint(wav_writer_t* w){
+    // only whole blocks are on the card, the partial one is still being encoded
+    wav_file_t* wav = &w->wav[w->cur];
+    wav->fact_samples = wav->samples_transfered * WAV_ADPCM_SAMPLES_PER_BLOCK;
+    return wav_checkpoint(wav);
+}
+
+static e_syserr_t wav_writer_adpcm_finish(wav_writer_t* w, uint8_t f){
+    // a split segment holds whole blocks, the last one gets the remainder
+    wav_file_t* wav = &w->wav[f];
+    wav->fact_samples = wav->samples_transfered * WAV_ADPCM_SAMPLES_PER_BLOCK;
+    if(f == w->cur && wav->fact_samples > w->adpcm.samples - w->seg_base){
+        wav->fact_samples = w->adpcm.samples - w->seg_base;
+    }
+    return wav_close_for_write(wav);
+}
+
+/*-------------------------------- FLAC --------------------------------*/
+
+static e_syserr_t wav_writer_flac_open(wav_writer_t* w, uint8_t f, const char* filename){
+    w->flac[f].reserve = w->reserve;
+    return flac_open_for_write(&w->flac[f], filename, w->n_ch, w->sr, w->bps);
+}
+
+static uint32_t wav_writer_flac_encode(wav_writer_t* w, const stereo_sample_t* in, void* out, uint32_t len){
+    // frames stay unpacked, the encoder runs on the writer side
+    uint32_t bytes = len * sizeof(stereo_sample_t);
+    if(out != in) memcpy(out, in, bytes);
+    return bytes;
+}
+
+static e_syserr_t wav_writer_flac_write(wav_writer_t* w, const void* data, uint32_t bytes){
+    return flac_write_samples(&w->flac[w->cur], (const stereo_sample_t*)data, bytes / sizeof(stereo_sample_t));
+}
+
+static e_syserr_t wav_writer_flac_checkpoint(wav_writer_t* w){
+    return flac_checkpoint(&w->flac[w->cur]);
+}
+
+static e_syserr_t wav_writer_flac_finish(wav_writer_t* w, uint8_t f){
+    return flac_close_for_write(&w->flac[f]);
+}
+
+static uint64_t wav_writer_flac_size(wav_writer_t* w){
+    return w->flac[w->cur].bytes_written;
+}
+
+static const wav_writer_ops_t wav_writer_ops[e_wav_fmt_n] = {
+    /*e_wav_fmt_pcm*/{
+        wav_writer_pcm_open,
+        wav_writer_pcm_encode,
+        wav_writer_wav_write,
+        wav_writer_wav_checkpoint,
+        wav_writer_wav_finish,
+        wav_writer_wav_size,
+        "WAV",
+        SDCARD_BASE_PATH "/" SDCARD_DEFAULT_FNAME_WAV,
+        1
+    },
+    /*e_wav_fmt_flac*/{
+        wav_writer_flac_open,
+        wav_writer_flac_encode,
+        wav_writer_flac_write,
+        wav_writer_flac_checkpoint,
+        wav_writer_flac_finish,
+        wav_writer_flac_size,
+        "FLAC",
+        SDCARD_BASE_PATH "/" SDCARD_DEFAULT_FNAME_FLAC,
+        0
+    },
+    /*e_wav_fmt_adpcm*/{
+        wav_writer_adpcm_open,
+        wav_writer_adpcm_encode,
+        wav_writer_wav_write,
+        wav_writer_adpcm_checkpoint,
+        wav_writer_adpcm_finish,
+        wav_writer_wav_size,
+        "IMA-ADPCM",
+        SDCARD_BASE_PATH "/" SDCARD_DEFAULT_FNAME_WAV,
+        0
+    },
+    /*e_wav_fmt_ext*/{
+        wav_writer_ext_open,
+        wav_writer_pcm_encode,
+        wav_writer_wav_write,
+        wav_writer_wav_checkpoint,
+        wav_writer_wav_finish,
+        wav_writer_wav_size,
+        "WAV-EXT",
+        SDCARD_BASE_PATH "/" SDCARD_DEFAULT_FNAME_WAV,
+        1
+    },
+};
+
+const wav_writer_ops_t* wav_writer_get_ops(uint8_t fmt){
+    return &wav_writer_ops[WAV_FMT_VALID(fmt) ? fmt : e_wav_fmt_pcm];
+}
+
+uint8_t wav_writer_bps_valid(uint8_t fmt, uint16_t bitsPerSample){
+    switch(fmt){
+        case e_wav_fmt_pcm: return WAV_PACK_BPS_VALID(bitsPerSample);
+        case e_wav_fmt_flac: return FLAC_BPS_VALID(bitsPerSample);
+        case e_wav_fmt_adpcm: return 1; // always 4 bit
+        case e_wav_fmt_ext: return bitsPerSample == 24 || bitsPerSample == 32;
+        default: return 0;
+    }
+}
+
+uint16_t wav_writer_file_bps(uint8_t fmt, uint16_t bitsPerSample){
+    return fmt == e_wav_fmt_adpcm ? WAV_ADPCM_BPS : bitsPerSample;
+}
+
+uint64_t wav_writer_max_samples(uint8_t fmt, uint16_t numChannels, uint16_t bitsPerSample, uint64_t bytes){
+    if(fmt == e_wav_fmt_adpcm){
+        return bytes / WAV_ADPCM_BLOCK_ALIGN_N(numChannels) * WAV_ADPCM_SAMPLES_PER_BLOCK;
+    }
+    uint32_t frame = wav_pack_frame_size(numChannels, bitsPerSample);
+    if(frame == 0) return 0;
+    if(fmt == e_wav_fmt_flac){
+        // a frame falls back to verbatim subframes at worst, packed PCM plus its headers and CRC
+        uint32_t block = FLAC_BLOCK_SIZE * frame + FLAC_FRAME_SLACK;
+        uint64_t rest = bytes % block;
+        return bytes / block * FLAC_BLOCK_SIZE + (rest > FLAC_FRAME_SLACK ? (rest - FLAC_FRAME_SLACK) / frame : 0);
+    }
+    return bytes / frame;
+}
+
+uint64_t wav_writer_max_bytes(uint8_t fmt, uint16_t numChannels, uint16_t bitsPerSample, uint64_t samples){
+    if(fmt == e_wav_fmt_adpcm){
+        uint64_t blocks = (samples + WAV_ADPCM_SAMPLES_PER_BLOCK - 1) / WAV_ADPCM_SAMPLES_PER_BLOCK;
+        return blocks * WAV_ADPCM_BLOCK_ALIGN_N(numChannels);
+    }
+    uint64_t bytes = samples * wav_pack_frame_size(numChannels, bitsPerSample);
+    if(fmt == e_wav_fmt_flac) bytes += (samples + FLAC_BLOCK_SIZE - 1) / FLAC_BLOCK_SIZE * FLAC_FRAME_SLACK;
+    return bytes;
+}
+
+e_syserr_t wav_writer_open(wav_writer_t* w, uint8_t fmt, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample, uint64_t samples){
+    if(w == NULL || filename == NULL) return e_syserr_null;
+    if(!WAV_FMT_VALID(fmt) || !WAV_PACK_CH_VALID(numChannels)) return e_syserr_param;
+    if(!wav_writer_bps_valid(fmt, bitsPerSample)) return e_syserr_param;
+    if(strlen(filename) >= sizeof(w->wav[0].filename)) return e_syserr_too_long;
+    w->ops = &wav_writer_ops[fmt];
+    w->fmt = fmt;
+    w->n_ch = numChannels;
+    w->sr = sampleRate;
+    w->bps = bitsPerSample;
+    w->cur = 0;
+    w->next_open = 0;
+    w->segments = 0;
+    w->seg_base = 0;
+    w->reserve = wav_writer_max_bytes(fmt, numChannels, bitsPerSample, samples);
+    w->unit_samples = 1;
+    if(fmt == e_wav_fmt_flac) w->unit_bytes = sizeof(stereo_sample_t);
+    else w->unit_bytes = wav_pack_frame_size(numChannels, bitsPerSample);
+    if(fmt == e_wav_fmt_adpcm){
+        e_syserr_t e = wav_adpcm_init(&w->adpcm, numChannels);
+        if(e != e_syserr_none) return e;
+        w->unit_bytes = WAV_ADPCM_BLOCK_ALIGN_N(numChannels);
+        w->unit_samples = WAV_ADPCM_SAMPLES_PER_BLOCK;
+    }
+    // every format keeps its name here, callers don't need to know the backend
+    strcpy(w->wav[0].filename, filename);
+    w->wav[0].file = NULL;
+    w->wav[0].out = NULL;
+    return w->ops->open(w, 0, filename);
+}
+
+e_syserr_t wav_writer_prepare_next(wav_writer_t* w){
+    if(w == NULL || w->ops == NULL) return e_syserr_null;
+    if(w->next_open) return e_syserr_none;
+    uint8_t f = w->cur ^ 1;
+    wav_file_t* wav = &w->wav[f];
+    strcpy(wav->filename, w->wav[w->cur].filename);
+    e_syserr_t e = sd_get_unique_fname(wav->filename);
+    if(e != e_syserr_none) return e;
+    wav->file = NULL;
+    wav->out = NULL;
+    e = w->ops->open(w, f, wav->filename);
+    if(e != e_syserr_none) return e;
+    w->next_open = 1;
+    return e_syserr_none;
+}
+
+e_syserr_t wav_writer_next(wav_writer_t* w){
+    e_syserr_t e = wav_writer_prepare_next(w);
+    if(e != e_syserr_none) return e;
+    uint8_t f = w->cur;
+    uint64_t samples = w->wav[f].samples_transfered * w->unit_samples;
+    // switch first, the finished file only needs its headers rewritten
+    w->cur ^= 1;
+    w->next_open = 0;
+    e = w->ops->finish(w, f);
+    w->seg_base += samples;
+    w->segments++;
+    return e;
+}
+
+e_syserr_t wav_writer_checkpoint(wav_writer_t* w){
+    if(w == NULL || w->ops == NULL) return e_syserr_null;
+    return w->ops->checkpoint(w);
+}
+
+e_syserr_t wav_writer_close(wav_writer_t* w){
+    if(w == NULL || w->ops == NULL) return e_syserr_null;
+    e_syserr_t e = e_syserr_none;
+    if(w->fmt == e_wav_fmt_adpcm){
+        // the partial block goes to the last segment
+        uint32_t bytes;
+        const uint8_t* blk = wav_adpcm_flush(&w->adpcm, &bytes);
+        if(bytes > 0) e = wav_write_samples(&w->wav[w->cur], blk, 1);
+    }
+    e_syserr_t ef = w->ops->finish(w, w->cur);
+    if(e == e_syserr_none) e = ef;
+    if(w->next_open){
+        uint8_t f = w->cur ^ 1;
+        w->ops->finish(w, f);
+        sd_delete_file(w->wav[f].filename);
+        w->next_open = 0;
+    }
+    w->ops = NULL;
+    return e;
+}
@@ -0,0 +1,189 @@
+/// @file wav_writer.h
+/// @brief
+/*
+Take writer interface. Every file format the recorder can produce is a
+table of operations behind one `wav_writer_t`, selected once at open:
+
+- `encode` runs on the producer side (audio task), turns I2S frames into
+  the bytes that go through the ring. It may work in place.
+- `write_block` runs on the writer task and hands these bytes to the file.
+- `checkpoint` commits the file so far, `close` finalizes it.
+
+Callers never branch on the format per frame, adding a format means adding
+an `e_wav_fmt_t` value and its table in wav_writer.cpp.
+
+A take can be split into segments. The writer holds two file contexts,
+the next segment is created and opened ahead with `wav_writer_prepare_next()`
+so `wav_writer_next()` only finalizes the current one. Producer side state
+(ADPCM predictor) continues across segments, every segment holds whole
+units (`unit_bytes` in the ring, `unit_samples` in the file): one sample
+frame for PCM and FLAC, one block for ADPCM. Segments concatenate to the
+unsplit take.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _WAV_WRITER_H_
+#define _WAV_WRITER_H_
+
+#include <stdint.h>
+#include "syserr.h"
+#include "audio.h"
+#include "wav.h"
+#include "wav_adpcm.h"
+#include "flac.h"
+
+/// @brief File formats of a take. Values are persisted, only append.
+typedef enum{
+    e_wav_fmt_pcm,              // plain PCM WAV, 16/24/32 bit
+    e_wav_fmt_flac,
+    e_wav_fmt_adpcm,            // IMA-ADPCM in WAV, 4:1 against 16 bit
+    e_wav_fmt_ext,              // WAVE_FORMAT_EXTENSIBLE, 24/32 bit container
+    e_wav_fmt_n
+}e_wav_fmt_t;
+
+#define WAV_FMT_VALID(f)        ((f) < e_wav_fmt_n)
+
+typedef struct wav_writer_t wav_writer_t;
+
+/// @brief Operations of one file format. File side operations work on
+/// the file context `f` (0 or 1), `wav_writer_t::cur` is the one being written.
+typedef struct wav_writer_ops_t{
+    e_syserr_t (*open)(wav_writer_t* w, uint8_t f, const char* filename);
+    uint32_t (*encode)(wav_writer_t* w, const stereo_sample_t* in, void* out, uint32_t len);
+    e_syserr_t (*write_block)(wav_writer_t* w, const void* data, uint32_t bytes);
+    e_syserr_t (*checkpoint)(wav_writer_t* w);
+    e_syserr_t (*finish)(wav_writer_t* w, uint8_t f);  // finalize and close a segment
+    uint64_t (*size)(wav_writer_t* w);                  // bytes of the current segment
+    const char* name;
+    const char* fname;          // default file name, made unique by the caller
+    uint8_t packed_pcm;         // `encode` is `wav_pack_frames()`, packed PCM can be written as is
+}wav_writer_ops_t;
+
+/// @brief Open take. `wav` holds the file names for every format.
+struct wav_writer_t{
+    const wav_writer_ops_t* ops;
+    uint8_t fmt;
+    uint16_t n_ch;
+    uint16_t bps;               // as requested, see `wav_writer_file_bps()`
+    uint32_t sr;
+    uint32_t unit_bytes;        // smallest split of encoded data
+    uint32_t unit_samples;      // samples per channel in one unit
+    uint8_t cur;                // file context being written
+    uint8_t next_open;          // the other context holds the pre-opened segment
+    uint32_t segments;          // segments finished so far
+    uint64_t seg_base;          // samples per channel in finished segments (WAV based formats)
+    uint64_t reserve;           // data bytes preallocated for every file opened, 0 for none
+    wav_file_t wav[2];
+    flac_file_t flac[2];
+    wav_adpcm_t adpcm;
+};
+
+/// @brief Open a take in the given format.
+/// @param w Empty writer.
+/// @param fmt `e_wav_fmt_t` value.
+/// @param filename Name of the file in FS.
+/// @param numChannels Number of audio channels.
+/// @param sampleRate Sample rate of the file.
+/// @param bitsPerSample Sample resolution, see `wav_writer_bps_valid()`.
+/// @param samples Expected length of the take in samples per channel, 0 if unknown.
+/// Sizes `reserve`, the card allocates at most `SDCARD_PREALLOC_MAX` of it up front.
+/// @return FR1 error code.
+/// @note Lower `w->reserve` before `wav_writer_prepare_next()` if segments are shorter.
+e_syserr_t wav_writer_open(wav_writer_t* w, uint8_t fmt, const char* filename, uint16_t numChannels, uint32_t sampleRate, uint16_t bitsPerSample, uint64_t samples);
+
+/// @brief Encode I2S frames for `wav_writer_write_block()`.
+/// @param w Open writer.
+/// @param in I2S frames, MSB-aligned.
+/// @param out Output buffer of at least `len * sizeof(stereo_sample_t)` bytes, may alias `in`.
+/// @param len Amount of frames, up to `AUDIO_FRAME_LEN`.
+/// @return Amount of bytes written to `out`.
+/// @note Producer side, keeps encoder state in `w`.
+static inline uint32_t wav_writer_encode(wav_writer_t* w, const stereo_sample_t* in, void* out, uint32_t len){
+    return w->ops->encode(w, in, out, len);
+}
+
+/// @brief Write bytes produced by `wav_writer_encode()` to the file.
+/// @param w Open writer.
+/// @param data Encoded bytes.
+/// @param bytes Amount of bytes, as returned by `wav_writer_encode()`.
+/// @return FR1 error code.
+static inline e_syserr_t wav_writer_write_block(wav_writer_t* w, const void* data, uint32_t bytes){
+    return w->ops->write_block(w, data, bytes);
+}
+
+/// @brief Create and open the file of the next segment.
+/// @param w Open writer.
+/// @return FR1 error code.
+/// @note Writer side. The name is the next free one after the current file
+/// (see `sd_get_unique_fname()`). Does nothing if it is already open.
+e_syserr_t wav_writer_prepare_next(wav_writer_t* w);
+
+/// @brief Finalize the current segment and continue in the next one.
+/// @param w Open writer.
+/// @return FR1 error code.
+/// @note Writer side, call it on a unit boundary. Opens the next file first
+/// if `wav_writer_prepare_next()` was not called.
+e_syserr_t wav_writer_next(wav_writer_t* w);
+
+/// @brief Get the size of the current segment.
+/// @param w Open writer.
+/// @return Bytes of audio data written to the current file.
+static inline uint64_t wav_writer_size(wav_writer_t* w){
+    return w->ops->size(w);
+}
+
+/// @brief Get the file name of the current segment.
+/// @param w Open writer.
+/// @return File name.
+static inline const char* wav_writer_fname(const wav_writer_t* w){
+    return w->wav[w->cur].filename;
+}
+
+/// @brief Commit the file so far, it stays open.
+/// @param w Open writer.
+/// @return FR1 error code.
+/// @note Writer side, never call this concurrently to `wav_writer_write_block()`.
+e_syserr_t wav_writer_checkpoint(wav_writer_t* w);
+
+/// @brief Flush pending encoder state, finalize the headers and close the file.
+/// @param w Open writer.
+/// @return FR1 error code.
+/// @note Producer and writer side have to be idle. A pre-opened segment
+/// that never got data is removed.
+e_syserr_t wav_writer_close(wav_writer_t* w);
+
+/// @brief Check a resolution against a format.
+/// @param fmt `e_wav_fmt_t` value.
+/// @param bitsPerSample Requested resolution.
+/// @return 1 if the format can take it, 0 if not.
+uint8_t wav_writer_bps_valid(uint8_t fmt, uint16_t bitsPerSample);
+
+/// @brief Get the resolution a format stores for a requested one.
+/// @param fmt `e_wav_fmt_t` value.
+/// @param bitsPerSample Requested resolution.
+/// @return Bits per sample in the file.
+uint16_t wav_writer_file_bps(uint8_t fmt, uint16_t bitsPerSample);
+
+/// @brief Get the amount of samples that fit into a number of bytes.
+/// @param fmt `e_wav_fmt_t` value.
+/// @param numChannels Number of audio channels.
+/// @param bitsPerSample Requested resolution.
+/// @param bytes Space for audio data.
+/// @return Samples per channel. Compressed formats are bound by their worst case,
+/// for FLAC that is verbatim frames. The file header is not part of `bytes`.
+uint64_t wav_writer_max_samples(uint8_t fmt, uint16_t numChannels, uint16_t bitsPerSample, uint64_t bytes);
+
+/// @brief Get the largest amount of bytes a number of samples takes.
+/// @param fmt `e_wav_fmt_t` value.
+/// @param numChannels Number of audio channels.
+/// @param bitsPerSample Requested resolution.
+/// @param samples Samples per channel.
+/// @return Bytes of audio data, the inverse of `wav_writer_max_samples()`.
+uint64_t wav_writer_max_bytes(uint8_t fmt, uint16_t numChannels, uint16_t bitsPerSample, uint64_t samples);
+
+/// @brief Get the operations of a format.
+/// @param fmt `e_wav_fmt_t` value.
+/// @return Operations table, the PCM one for invalid values.
+const wav_writer_ops_t* wav_writer_get_ops(uint8_t fmt);
+
+#endif // _WAV_WRITER_H_
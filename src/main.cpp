@@ -7,39 +7,55 @@
 #include "wav.h"
 #include "utils.h"
 #include "sdcard.h"
+#include "recorder.h"
+#include "spectrum.h"
+#include "config.h"
 #include "adc_base.h"
 #include "uii.h"
 #include "uio.h"
 #include "uio_timer.h"
+#include "prof.h"
 
 typedef e_syserr_t (*init_func)(void);
 
 typedef enum e_fr1_module_t{
+    e_fr1_module_cfg,
     e_fr1_module_audio,
+    e_fr1_module_rec,
+    e_fr1_module_spec,
     e_fr1_module_fsm,
     e_fr1_module_sdcard,
     e_fr1_module_adc,
     e_fr1_module_uii,
     e_fr1_module_uio,
+    e_fr1_module_prof,
     e_FR1_NUM_MODULES
 }e_fr1_module_t;
 
 static init_func init_funcs[e_FR1_NUM_MODULES] = {
+    cfg_init,
     audio_init_default,
+    rec_init_default,
+    spec_init_default,
     fsm_init_default,
     sd_init_default,
     adc_base_init_default,
     uii_exti_init,
-    uio_init
+    uio_init,
+    prof_init
 };
 
 const char init_func_ids [e_FR1_NUM_MODULES][12] = {
+    CFG_MODULE_NAME,
     AUDIO_SERVER_JOB_NAME,
+    REC_WRITER_TASK_NAME,
+    SPEC_WORKER_TASK_NAME,
     FSM_CTRL_JOB_NAME,
     SDCARD_SERVER_JOB_NAME,
     ADC_BASE_JOB_NAME,
     "uii",
-    "uio"
+    "uio",
+    PROF_JOB_NAME
 };
 
 void fr1_system_init(void){
@@ -54,6 +70,15 @@ void fr1_system_init(void){
             return; 
         }
     }
+    // takes cut by a power loss end at their last checkpoint
+    if(sd_mnt() == e_syserr_none){
+        uint32_t n_fixed = 0;
+        uint32_t n_removed = 0;
+        e = rec_recover(&n_fixed, &n_removed);
+        if(e != e_syserr_none) SCOPE_LOG_INIT(FR1_DEBUG_MSG_WARN "Take recovery fail (%d).", e);
+        if(n_fixed) SCOPE_LOG_INIT(FR1_DEBUG_MSG_INFO "Finalized %d unterminated take(s).", n_fixed);
+        if(n_removed) SCOPE_LOG_INIT(FR1_DEBUG_MSG_INFO "Removed %d empty file(s).", n_removed);
+    }
     uio_oled_title_screen();
     uio_led_toggle();
     SCOPE_LOG_INIT(FR1_DEBUG_MSG_INFO "Starting audio engine...");
@@ -0,0 +1,59 @@
+/// @file fr1_test.h
+/// @brief
+/*
+Runner shared by the unit tests and kernel benchmarks (`pio test -e FR1-test`).
+A test file lists its `RUN_TEST()` calls in `fr1_test_run()` and ends with
+`FR1_TEST_MAIN()`, which holds the Arduino entry points.
+
+The tests run on the target. The benchmarks time the kernels with CCOUNT
+against the cycle budgets of the tasks that run them, a host build would
+time another CPU. The kernels also come in libraries that pull in ESP-IDF
+(`audio.h` includes the I2S driver), which the native platform lacks.
+*/
+/// @author jake-is-ESD-protected. jesdev.io
+
+#ifndef _FR1_TEST_H_
+#define _FR1_TEST_H_
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "hal/cpu_hal.h"
+
+#define FR1_TEST_BOOT_MS        2000    // the board resets when the runner opens the port
+#define FR1_TEST_MSG_LEN        128
+
+/// @brief Get the cycles a block may take to keep up with the capture.
+/// @param len Block length in samples.
+/// @param sr Sample rate.
+/// @return CPU cycles at the current clock.
+static inline uint64_t fr1_test_budget_cyc(uint32_t len, uint32_t sr){
+    return (uint64_t)len * getCpuFrequencyMhz() * 1000000 / sr;
+}
+
+/// @brief Print a formatted line to the test log.
+/// @param fmt printf format.
+static inline void fr1_test_msg(const char* fmt, ...){
+    char msg[FR1_TEST_MSG_LEN];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    TEST_MESSAGE(msg);
+}
+
+/// @brief Run the tests of a test file, defined by every test file.
+void fr1_test_run(void);
+
+/// @brief Entry points of a test program, put once at the end of each test file.
+#define FR1_TEST_MAIN()                 \
+    void setup(void){                   \
+        delay(FR1_TEST_BOOT_MS);        \
+        UNITY_BEGIN();                  \
+        fr1_test_run();                 \
+        UNITY_END();                    \
+    }                                   \
+    void loop(void){}
+
+#endif // _FR1_TEST_H_
@@ -0,0 +1,150 @@
+/*
+IMA-ADPCM encoder against a reference decoder. A sine plus noise runs
+through `wav_adpcm_encode()` frame by frame like the recorder feeds it,
+the stream is checked for the block layout (`WAV_ADPCM_SAMPLES_PER_BLOCK`
+samples in `WAV_ADPCM_BLOCK_ALIGN` bytes per channel, exact sample in the
+header) and decoded with the tables of the IMA spec, written out here
+independently of the encoder, to get the SNR against the 16 bit input.
+*/
+
+#include "../fr1_test.h"
+#include "wav_adpcm.h"
+
+#define TEST_FRAMES     8
+#define TEST_SR         AUDIO_SR_48000
+#define TEST_N          (TEST_FRAMES * AUDIO_FRAME_LEN)
+#define TEST_BLOCKS     ((TEST_N + WAV_ADPCM_SAMPLES_PER_BLOCK - 1) / WAV_ADPCM_SAMPLES_PER_BLOCK)
+#define TEST_AMP        0.5f    // -6 dBFS
+#define TEST_NOISE      0.01f   // -40 dBFS
+#define TEST_SNR_MIN_DB 28.0f    // measured 32 dB (1 kHz) and 39 dB (440 Hz)
+
+static const int16_t ref_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t ref_index_adj[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+static wav_adpcm_t enc;
+static stereo_sample_t frame[AUDIO_FRAME_LEN];
+static uint8_t stream[TEST_BLOCKS * WAV_ADPCM_BLOCK_ALIGN_N(2)];
+static int16_t dec[2][TEST_BLOCKS * WAV_ADPCM_SAMPLES_PER_BLOCK];
+
+/// @brief Sample `i` of the test signal, MSB-aligned 24 bit like the I2S capture.
+static stereo_sample_t test_sample(uint32_t i){
+    float t = (float)i / TEST_SR;
+    uint32_t h = (i + 1) * 2654435761u;
+    h ^= h >> 15;
+    float noise = TEST_NOISE * ((float)(h >> 8) / 8388608.0f - 1.0f);
+    float l = TEST_AMP * sinf(2.0f * (float)M_PI * 1000.0f * t) + noise;
+    float r = TEST_AMP * sinf(2.0f * (float)M_PI * 440.0f * t) - noise;
+    stereo_sample_t s = {(int32_t)(l * 8388607.0f) << 8, (int32_t)(r * 8388607.0f) << 8};
+    return s;
+}
+
+/// @brief Encode the test signal like the recorder, in place frame by frame, then flush.
+/// @param bytes Bytes in `stream`.
+static void test_encode(uint16_t n_ch, uint32_t* bytes){
+    TEST_ASSERT_EQUAL(e_syserr_none, wav_adpcm_init(&enc, n_ch));
+    *bytes = 0;
+    for(uint32_t f = 0; f < TEST_FRAMES; f++){
+        for(uint32_t i = 0; i < AUDIO_FRAME_LEN; i++) frame[i] = test_sample(f * AUDIO_FRAME_LEN + i);
+        uint32_t n = wav_adpcm_encode(&enc, frame, frame, AUDIO_FRAME_LEN);
+        TEST_ASSERT_EQUAL_UINT32(0, n % WAV_ADPCM_BLOCK_ALIGN_N(n_ch));
+        TEST_ASSERT_TRUE(n <= WAV_ADPCM_FRAME_BLOCKS_MAX * WAV_ADPCM_BLOCK_ALIGN_N(n_ch));
+        memcpy(&stream[*bytes], frame, n);
+        *bytes += n;
+    }
+    uint32_t n = 0;
+    const uint8_t* last = wav_adpcm_flush(&enc, &n);
+    TEST_ASSERT_EQUAL_UINT32(WAV_ADPCM_BLOCK_ALIGN_N(n_ch), n);
+    memcpy(&stream[*bytes], last, n);
+    *bytes += n;
+    TEST_ASSERT_EQUAL_UINT32(TEST_N, enc.samples);
+}
+
+static int16_t ref_decode(int16_t* pred, uint8_t* index, uint8_t code){
+    int32_t step = ref_steps[*index];
+    int32_t diff = step >> 3;
+    if(code & 4) diff += step;
+    if(code & 2) diff += step >> 1;
+    if(code & 1) diff += step >> 2;
+    int32_t p = (code & 8) ? *pred - diff : *pred + diff;
+    *pred = (int16_t)(p > 32767 ? 32767 : p < -32768 ? -32768 : p);
+    int32_t i = *index + ref_index_adj[code];
+    *index = (uint8_t)(i < 0 ? 0 : i > 88 ? 88 : i);
+    return *pred;
+}
+
+static void ref_decode_block(const uint8_t* blk, uint16_t n_ch, uint32_t b){
+    for(uint16_t c = 0; c < n_ch; c++){
+        int16_t pred = (int16_t)(blk[c * 4] | (blk[c * 4 + 1] << 8));
+        uint8_t index = blk[c * 4 + 2];
+        int16_t* out = &dec[c][b * WAV_ADPCM_SAMPLES_PER_BLOCK];
+        *out++ = pred;
+        const uint8_t* p = &blk[4 * n_ch + c * 4];
+        for(uint32_t k = 0; k < WAV_ADPCM_SAMPLES_PER_BLOCK - 1; k += 8, p += 4 * n_ch){
+            for(uint8_t j = 0; j < 4; j++){
+                *out++ = ref_decode(&pred, &index, p[j] & 0x0F);
+                *out++ = ref_decode(&pred, &index, p[j] >> 4);
+            }
+        }
+    }
+}
+
+static void test_adpcm_stream(uint16_t n_ch){
+    uint32_t bytes = 0;
+    test_encode(n_ch, &bytes);
+    uint32_t align = WAV_ADPCM_BLOCK_ALIGN_N(n_ch);
+    TEST_ASSERT_EQUAL_UINT32(TEST_BLOCKS * align, bytes);
+    for(uint32_t b = 0; b < TEST_BLOCKS; b++){
+        const uint8_t* blk = &stream[b * align];
+        stereo_sample_t s = test_sample(b * WAV_ADPCM_SAMPLES_PER_BLOCK);
+        for(uint16_t c = 0; c < n_ch; c++){
+            int16_t head = (int16_t)(blk[c * 4] | (blk[c * 4 + 1] << 8));
+            TEST_ASSERT_EQUAL_INT16((c == 0 ? s.l : s.r) >> 16, head);
+            TEST_ASSERT_TRUE(blk[c * 4 + 2] <= 88);
+            TEST_ASSERT_EQUAL_UINT8(0, blk[c * 4 + 3]);
+        }
+        ref_decode_block(blk, n_ch, b);
+    }
+    for(uint16_t c = 0; c < n_ch; c++){
+        double sig = 0;
+        double err = 0;
+        for(uint32_t i = 0; i < TEST_N; i++){
+            stereo_sample_t s = test_sample(i);
+            int32_t x = (c == 0 ? s.l : s.r) >> 16;
+            int32_t e = dec[c][i] - x;
+            sig += (double)x * x;
+            err += (double)e * e;
+        }
+        float snr = (float)(10.0 * log10(sig / (err > 0 ? err : 1)));
+        fr1_test_msg("%d ch, channel %d: SNR %.1f dB", n_ch, c, snr);
+        TEST_ASSERT_GREATER_THAN_FLOAT(TEST_SNR_MIN_DB, snr);
+    }
+}
+
+void setUp(void){}
+
+void tearDown(void){}
+
+void test_adpcm_layout(void){
+    TEST_ASSERT_EQUAL(1017, WAV_ADPCM_SAMPLES_PER_BLOCK);
+    TEST_ASSERT_EQUAL(512, WAV_ADPCM_BLOCK_ALIGN_N(1));
+    TEST_ASSERT_EQUAL(1024, WAV_ADPCM_BLOCK_ALIGN_N(2));
+}
+
+void test_adpcm_mono(void){ test_adpcm_stream(1); }
+void test_adpcm_stereo(void){ test_adpcm_stream(2); }
+
+void fr1_test_run(void){
+    RUN_TEST(test_adpcm_layout);
+    RUN_TEST(test_adpcm_mono);
+    RUN_TEST(test_adpcm_stereo);
+}
+
+FR1_TEST_MAIN()
@@ -0,0 +1,144 @@
+/*
+Throughput and response of `dsp_fr1_decim_process()` for every factor the
+recorder offers. Cycles per input sample are timed with CCOUNT, mono and
+stereo. The decimator runs on the audio task next to metering and the rest
+of the frame routine, so it may take at most a quarter of the frame budget
+on average. Tones through the filter check the response promised in
+`dsp_fr1_decim.h`. Target only, see `fr1_test.h`.
+*/
+
+#include "../fr1_test.h"
+#include "dsp_fr1_decim.h"
+
+#define BENCH_FRAMES    32
+#define BENCH_SR        AUDIO_SR_48000
+#define BENCH_SHARE     4       // frame budget / allowed decimator cost
+#define BENCH_AMP       0.5f
+#define BENCH_FREQ      1000.0f
+#define RESP_FRAMES     16      // frames per tone
+#define RESP_SETTLE     4       // frames before the power is summed, the filter history fills
+#define RESP_PASS_EDGE  0.4f    // passband edge relative to the output rate
+#define RESP_PASS_DB    0.4f    // allowed ripple up to the edge
+#define RESP_STOP_EDGE  0.55f   // stopband edge relative to the output rate
+#define RESP_STOP_STEP  0.05f
+#define RESP_STOP_DB    (-75.0f)
+
+static dsp_fr1_decim_t dec;     // ~9.5 KiB, keep it off the test task stack
+static stereo_sample_t frame[AUDIO_FRAME_LEN];
+
+/// @brief Fill the frame with the next part of a tone.
+/// @param hz Tone frequency.
+/// @param phase Phase in cycles, carried from frame to frame.
+/// @return Power of the frame, full scale = 1.
+static double bench_fill(float hz, float* phase){
+    double p = 0;
+    for(uint32_t i = 0; i < AUDIO_FRAME_LEN; i++){
+        float x = BENCH_AMP * sinf(2.0f * (float)M_PI * *phase);
+        *phase += hz / BENCH_SR;
+        if(*phase >= 1.0f) *phase -= 1.0f;
+        frame[i].l = (int32_t)(x * 8388607.0f) << 8;
+        frame[i].r = -frame[i].l;
+        p += (double)x * x;
+    }
+    return p;
+}
+
+static void bench_decim(uint8_t m, uint8_t n_ch){
+    TEST_ASSERT_EQUAL(e_syserr_none, dsp_fr1_decim_init(&dec, m, n_ch));
+    uint64_t cyc = 0;
+    uint32_t cyc_max = 0;
+    uint32_t n_out = 0;
+    float phase = 0;
+    for(uint32_t f = 0; f < BENCH_FRAMES; f++){
+        bench_fill(BENCH_FREQ, &phase);
+        uint32_t t0 = cpu_hal_get_cycle_count();
+        uint32_t n = dsp_fr1_decim_process(&dec, frame, AUDIO_FRAME_LEN);
+        uint32_t t = cpu_hal_get_cycle_count() - t0;
+        cyc += t;
+        if(t > cyc_max) cyc_max = t;
+        n_out += n;
+        // the phase carries over, a frame gives floor or ceil of len/m outputs
+        TEST_ASSERT_TRUE(n == (uint32_t)(AUDIO_FRAME_LEN / m) || n == (uint32_t)((AUDIO_FRAME_LEN + m - 1) / m));
+    }
+    uint32_t n_in = BENCH_FRAMES * AUDIO_FRAME_LEN;
+    // one output for every m-th input of the stream, the first included
+    TEST_ASSERT_EQUAL_UINT32((n_in + m - 1) / m, n_out);
+    uint32_t mhz = getCpuFrequencyMhz();
+    uint64_t budget = fr1_test_budget_cyc(AUDIO_FRAME_LEN, BENCH_SR);
+    fr1_test_msg("m %d, %d ch: %.1f cycles/sample, worst frame %d us of %d us",
+                 m, n_ch, (float)cyc / n_in, cyc_max / mhz, (uint32_t)(budget / mhz));
+    TEST_ASSERT_TRUE_MESSAGE(cyc / BENCH_FRAMES < budget / BENCH_SHARE, "decimator takes too much of the frame");
+}
+
+/// @brief Get the gain of a tone through the decimator.
+/// @param m Decimation factor.
+/// @param hz Tone frequency at the capture rate, aliases above the output Nyquist included.
+/// @return Output power over input power in dB, both per sample.
+static float bench_gain_db(uint8_t m, float hz){
+    dsp_fr1_decim_init(&dec, m, 1);
+    double p_in = 0;
+    double p_out = 0;
+    float phase = 0;
+    for(uint32_t f = 0; f < RESP_FRAMES; f++){
+        double p = bench_fill(hz, &phase);
+        uint32_t n = dsp_fr1_decim_process(&dec, frame, AUDIO_FRAME_LEN);
+        if(f < RESP_SETTLE) continue;
+        p_in += p / AUDIO_FRAME_LEN;
+        double q = 0;
+        for(uint32_t i = 0; i < n; i++){
+            double y = (double)(frame[i].l >> 8) / 8388607.0;
+            q += y * y;
+        }
+        p_out += n ? q / n : 0;
+    }
+    return (float)(10.0 * log10(p_out / p_in));
+}
+
+static void bench_response(uint8_t m){
+    float fs_out = (float)BENCH_SR / m;
+    float pass[] = {BENCH_FREQ, RESP_PASS_EDGE * fs_out};
+    for(uint8_t i = 0; i < sizeof(pass) / sizeof(pass[0]); i++){
+        float g = bench_gain_db(m, pass[i]);
+        fr1_test_msg("m %d: %.0f Hz %.2f dB", m, pass[i], g);
+        TEST_ASSERT_FLOAT_WITHIN(RESP_PASS_DB, 0.0f, g);
+    }
+    float worst = -200.0f;
+    float worst_hz = 0;
+    for(float r = RESP_STOP_EDGE; r * fs_out < BENCH_SR / 2; r += RESP_STOP_STEP){
+        float g = bench_gain_db(m, r * fs_out);
+        if(g > worst){
+            worst = g;
+            worst_hz = r * fs_out;
+        }
+    }
+    fr1_test_msg("m %d: stopband from %.0f Hz, worst %.1f dB at %.0f Hz", m, RESP_STOP_EDGE * fs_out, worst, worst_hz);
+    TEST_ASSERT_LESS_THAN_FLOAT(RESP_STOP_DB, worst);
+}
+
+void setUp(void){}
+
+void tearDown(void){}
+
+void test_decim_2_mono(void){ bench_decim(2, 1); }
+void test_decim_3_mono(void){ bench_decim(3, 1); }
+void test_decim_4_mono(void){ bench_decim(4, 1); }
+void test_decim_2_stereo(void){ bench_decim(2, 2); }
+void test_decim_3_stereo(void){ bench_decim(3, 2); }
+void test_decim_4_stereo(void){ bench_decim(4, 2); }
+void test_decim_2_response(void){ bench_response(2); }
+void test_decim_3_response(void){ bench_response(3); }
+void test_decim_4_response(void){ bench_response(4); }
+
+void fr1_test_run(void){
+    RUN_TEST(test_decim_2_mono);
+    RUN_TEST(test_decim_3_mono);
+    RUN_TEST(test_decim_4_mono);
+    RUN_TEST(test_decim_2_stereo);
+    RUN_TEST(test_decim_3_stereo);
+    RUN_TEST(test_decim_4_stereo);
+    RUN_TEST(test_decim_2_response);
+    RUN_TEST(test_decim_3_response);
+    RUN_TEST(test_decim_4_response);
+}
+
+FR1_TEST_MAIN()
@@ -0,0 +1,72 @@
+/*
+Cycles per sample of the float meter (`dsp_fr1_samples_to_msqr_32b()`)
+against the fixed-point kernel behind `dsp_fr1_meter_32b()`, timed with
+CCOUNT on frames shaped like the I2S capture. Both keep their own DC state,
+so they also have to agree on the mean square once settled.
+*/
+
+#include "../fr1_test.h"
+#include "dsp_fr1.h"
+
+#define BENCH_FRAMES    64      // ~1.4 s of audio at 48 kHz, settles both DC filters
+#define BENCH_AMP       0.5f    // -6 dBFS sine, mean square 0.125
+#define BENCH_DC        0.01f
+#define BENCH_FREQ      1000.0f
+
+static stereo_sample_t frame[AUDIO_FRAME_LEN];
+static volatile float sink;
+
+static void bench_fill(void){
+    for(uint32_t i = 0; i < AUDIO_FRAME_LEN; i++){
+        float x = BENCH_DC + BENCH_AMP * sinf(2.0f * (float)M_PI * BENCH_FREQ * i / AUDIO_SR_48000);
+        frame[i].l = (int32_t)(x * 8388607.0f) << 8;
+        frame[i].r = frame[i].l;
+    }
+}
+
+static float bench_cyc_per_sample(uint64_t cyc){
+    return (float)cyc / ((float)BENCH_FRAMES * AUDIO_FRAME_LEN);
+}
+
+void setUp(void){
+    bench_fill();
+}
+
+void tearDown(void){}
+
+void test_meter_cycles(void){
+    uint64_t cyc_float = 0;
+    uint64_t cyc_fixed = 0;
+    stereo_value_t msqr_float = {0, 0};
+    dsp_fr1_meter_t m = {};
+    for(uint32_t f = 0; f < BENCH_FRAMES; f++){
+        uint32_t t0 = cpu_hal_get_cycle_count();
+        msqr_float = dsp_fr1_samples_to_msqr_32b(frame, AUDIO_FRAME_LEN);
+        uint32_t t1 = cpu_hal_get_cycle_count();
+        m = dsp_fr1_meter_32b(frame, AUDIO_FRAME_LEN);
+        uint32_t t2 = cpu_hal_get_cycle_count();
+        cyc_float += t1 - t0;
+        cyc_fixed += t2 - t1;
+        sink = msqr_float.l + m.msqr.l;
+    }
+    fr1_test_msg("float: %.1f cycles/sample, fixed: %.1f cycles/sample @ %d MHz",
+                 bench_cyc_per_sample(cyc_float), bench_cyc_per_sample(cyc_fixed), getCpuFrequencyMhz());
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 0.125f, msqr_float.l);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 0.125f, m.msqr.l);
+    TEST_ASSERT_TRUE_MESSAGE(cyc_fixed < cyc_float, "fixed-point kernel is not faster");
+}
+
+void test_meter_clips(void){
+    frame[10].l = 0x7FFFFF00;
+    frame[20].l = (int32_t)0x80000000;
+    dsp_fr1_meter_t m = dsp_fr1_meter_32b(frame, AUDIO_FRAME_LEN);
+    TEST_ASSERT_EQUAL_UINT32(2, m.clips_l);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, m.peak.l);
+}
+
+void fr1_test_run(void){
+    RUN_TEST(test_meter_cycles);
+    RUN_TEST(test_meter_clips);
+}
+
+FR1_TEST_MAIN()
@@ -0,0 +1,108 @@
+/*
+Cost of one spectrum block on the target: window + FFT
+(`dsp_fr1_fft_power()`) and band summing (`dsp_fr1_bands_sum()`, 1/1 and
+1/3 octaves) of `SPEC_FFT_N` samples, timed with CCOUNT. Without skipped
+frames the worker gets one block time to finish, that is the budget.
+Target only, see `fr1_test.h`.
+*/
+
+#include "../fr1_test.h"
+#include "audio.h"
+#include "dsp_fr1_fft.h"
+
+#define BENCH_N         (AUDIO_FRAME_LEN * 2)   // `SPEC_FFT_N`
+#define BENCH_SR        AUDIO_SR_48000
+#define BENCH_RUNS      16
+#define BENCH_AMP       0.5f    // -6 dBFS sine, -9 dBFS mean square
+#define BENCH_FREQ      1000.0f
+
+static dsp_fr1_fft_t fft;
+static dsp_fr1_bands_t oct;
+static dsp_fr1_bands_t third;
+static void* fft_mem = NULL;
+static float x[BENCH_N];
+static float bins[BENCH_N / 2 + 1];
+
+static void bench_fill(void){
+    for(uint32_t i = 0; i < BENCH_N; i++){
+        x[i] = BENCH_AMP * sinf(2.0f * (float)M_PI * BENCH_FREQ * i / BENCH_SR);
+    }
+}
+
+/// @brief Set up the FFT and the band tables on first use, any test may run alone.
+/// @return FR1 error code.
+static e_syserr_t bench_init(void){
+    if(fft_mem != NULL) return e_syserr_none;
+    fft_mem = malloc(dsp_fr1_fft_mem_size(BENCH_N));
+    if(fft_mem == NULL) return e_syserr_oom;
+    dsp_fr1_bands_init(&oct, 1, BENCH_N, BENCH_SR);
+    dsp_fr1_bands_init(&third, 3, BENCH_N, BENCH_SR);
+    return dsp_fr1_fft_init(&fft, BENCH_N, fft_mem);
+}
+
+static uint16_t bench_band_of(uint8_t fraction, uint16_t n_bands, float f){
+    for(uint16_t i = 0; i < n_bands; i++){
+        if(dsp_fr1_band_center(fraction, i) >= f * 0.99f) return i;
+    }
+    return 0;
+}
+
+void setUp(void){}
+
+void tearDown(void){}
+
+void test_spec_init(void){
+    TEST_ASSERT_EQUAL(e_syserr_none, bench_init());
+    TEST_ASSERT_EQUAL(DSP_FR1_OCT_BANDS, oct.n_bands);
+    TEST_ASSERT_EQUAL(DSP_FR1_THIRD_BANDS, third.n_bands);
+}
+
+void test_spec_cycles(void){
+    TEST_ASSERT_EQUAL(e_syserr_none, bench_init());
+    float db_oct[DSP_FR1_OCT_BANDS];
+    float db_third[DSP_FR1_THIRD_BANDS];
+    uint64_t cyc_fft = 0;
+    uint64_t cyc_bands = 0;
+    for(uint32_t r = 0; r < BENCH_RUNS; r++){
+        bench_fill();
+        uint32_t t0 = cpu_hal_get_cycle_count();
+        dsp_fr1_fft_power(&fft, x, bins);
+        uint32_t t1 = cpu_hal_get_cycle_count();
+        dsp_fr1_bands_sum(&oct, bins, db_oct);
+        dsp_fr1_bands_sum(&third, bins, db_third);
+        uint32_t t2 = cpu_hal_get_cycle_count();
+        cyc_fft += t1 - t0;
+        cyc_bands += t2 - t1;
+    }
+    uint32_t mhz = getCpuFrequencyMhz();
+    uint64_t budget = fr1_test_budget_cyc(BENCH_N, BENCH_SR);
+    uint32_t fft_us = (uint32_t)(cyc_fft / BENCH_RUNS / mhz);
+    uint32_t bands_us = (uint32_t)(cyc_bands / BENCH_RUNS / mhz);
+    fr1_test_msg("fft: %d us, bands: %d us, block: %d us @ %d MHz",
+                 fft_us, bands_us, (uint32_t)(budget / mhz), mhz);
+    TEST_ASSERT_TRUE_MESSAGE((cyc_fft + cyc_bands) / BENCH_RUNS < budget, "spectrum block does not fit its block time");
+}
+
+void test_spec_levels(void){
+    TEST_ASSERT_EQUAL(e_syserr_none, bench_init());
+    float db_oct[DSP_FR1_OCT_BANDS];
+    float db_third[DSP_FR1_THIRD_BANDS];
+    bench_fill();
+    dsp_fr1_fft_power(&fft, x, bins);
+    dsp_fr1_bands_sum(&oct, bins, db_oct);
+    dsp_fr1_bands_sum(&third, bins, db_third);
+    float expect = 10.0f * log10f(BENCH_AMP * BENCH_AMP / 2.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, expect, db_oct[bench_band_of(1, oct.n_bands, BENCH_FREQ)]);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, expect, db_third[bench_band_of(3, third.n_bands, BENCH_FREQ)]);
+    TEST_ASSERT_LESS_THAN_FLOAT(expect - 40.0f, db_oct[bench_band_of(1, oct.n_bands, 125.0f)]);
+}
+
+void fr1_test_run(void){
+    RUN_TEST(test_spec_init);
+    RUN_TEST(test_spec_cycles);
+    RUN_TEST(test_spec_levels);
+    free(fft_mem);
+    fft_mem = NULL;
+}
+
+FR1_TEST_MAIN()
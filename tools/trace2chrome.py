@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Convert an FR1 `trace dump` into Chrome trace JSON.
+
+Capture the serial log while running `trace dump` and convert it:
+
+    python3 tools/trace2chrome.py monitor.log -o trace.json
+
+Open the result in chrome://tracing or https://ui.perfetto.dev. Every core
+is a process, every event type a track on it. Matching begin/end events
+become complete slices, button ISRs are instants. Only the last dump of
+the log is used.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+DUMP_BEGIN = "#trace begin"
+DUMP_END = "#trace end"
+FSM_STATES = ["idle", "rec", "batt", "sett", "file", "spec", "trans"]
+
+RE_EVT = re.compile(r"#evt (\d+) (\S+)")
+RE_REC = re.compile(r"T (\d+) (\d+) ([BEi]) (\d+) (\d+)")
+
+
+def last_dump(lines):
+    """Return the lines of the last complete dump."""
+    dump = None
+    cur = None
+    for line in lines:
+        if DUMP_BEGIN in line:
+            cur = []
+        elif DUMP_END in line and cur is not None:
+            dump = cur
+            cur = None
+        elif cur is not None:
+            cur.append(line)
+    return dump
+
+
+def parse(dump):
+    """Parse event names and records, timestamps unwrapped per core."""
+    names = {}
+    recs = []
+    last = {}
+    wraps = {}
+    for line in dump:
+        m = RE_EVT.search(line)
+        if m:
+            names[int(m.group(1))] = m.group(2)
+            continue
+        m = RE_REC.search(line)
+        if not m:
+            continue
+        core, ts, ph, evt, arg = int(m.group(1)), int(m.group(2)), m.group(3), int(m.group(4)), int(m.group(5))
+        # the firmware keeps the low 32 bit of the us clock, rings are printed oldest first
+        if core in last and ts + (1 << 31) < last[core]:
+            wraps[core] = wraps.get(core, 0) + 1
+        last[core] = ts
+        recs.append((ts + (wraps.get(core, 0) << 32), core, ph, evt, arg))
+    recs.sort(key=lambda r: r[0])
+    return names, recs
+
+
+def args_of(name, arg):
+    if name == "fsm":
+        frm, to = arg >> 8, arg & 0xFF
+        return {"from": FSM_STATES[frm] if frm < len(FSM_STATES) else frm,
+                "to": FSM_STATES[to] if to < len(FSM_STATES) else to}
+    if name == "audio_frame":
+        return {"state": FSM_STATES[arg] if arg < len(FSM_STATES) else arg}
+    if name == "button":
+        return {"pin": arg}
+    if name.startswith("sd_"):
+        return {"KiB": arg}
+    return {"arg": arg}
+
+
+def convert(names, recs):
+    """Pair begin and end per core and event into complete slices."""
+    if not recs:
+        return []
+    t0 = recs[0][0]
+    out = []
+    open_ = {}
+    dropped = 0
+    for ts, core, ph, evt, arg in recs:
+        name = names.get(evt, "evt%d" % evt)
+        base = {"name": name, "pid": core, "tid": evt, "ts": ts - t0}
+        if ph == "B":
+            open_.setdefault((core, evt), []).append((ts, arg, core))
+        elif ph == "E":
+            stack = open_.get((core, evt))
+            if not stack:
+                # the task moved to the other core in between, the slice stays where it began
+                stack = next((st for (c, e), st in open_.items() if e == evt and st), None)
+            if not stack:
+                # its begin was overwritten in the ring
+                dropped += 1
+                continue
+            tb, ab, cb = stack.pop()
+            base.update(pid=cb, ts=tb - t0, ph="X", dur=ts - tb, args=args_of(name, ab))
+            out.append(base)
+        else:
+            base.update(ph="i", s="t", args=args_of(name, arg))
+            out.append(base)
+    if dropped:
+        print("%d end events without begin dropped" % dropped, file=sys.stderr)
+    cores = sorted({r[1] for r in recs})
+    evts = sorted({r[3] for r in recs})
+    for c in cores:
+        out.append({"name": "process_name", "ph": "M", "pid": c, "args": {"name": "core %d" % c}})
+        for e in evts:
+            out.append({"name": "thread_name", "ph": "M", "pid": c, "tid": e,
+                        "args": {"name": names.get(e, "evt%d" % e)}})
+    return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log", help="captured serial log holding a `trace dump`")
+    ap.add_argument("-o", "--out", default="trace.json", help="output file (default: trace.json)")
+    a = ap.parse_args()
+    with open(a.log, errors="replace") as f:
+        dump = last_dump(f.read().splitlines())
+    if dump is None:
+        sys.exit("no complete '%s' ... '%s' block found" % (DUMP_BEGIN, DUMP_END))
+    names, recs = parse(dump)
+    events = convert(names, recs)
+    with open(a.out, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+    print("%d events from %d records -> %s" % (len(events), len(recs), a.out))
+
+
+if __name__ == "__main__":
+    main()